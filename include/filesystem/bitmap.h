@@ -9,15 +9,26 @@ namespace vfs {
 
 /**
  * @brief Free block bitmap manager
- * Manages allocation and deallocation of data blocks
+ * Manages allocation and deallocation of data blocks. Bits are scanned a
+ * 64-bit word at a time, and a per-chunk free count lets searches skip
+ * full regions without touching their words.
  */
 class Bitmap {
 public:
   explicit Bitmap(uint32_t total_blocks);
 
-  // Allocate a free block
+  // Allocate a free block, next-fit from the previous allocation
   int32_t allocate();
 
+  // Allocate the first free block at or after goal, wrapping around
+  int32_t allocate(uint32_t goal);
+
+  // Allocate up to count contiguous blocks: the smallest free run that
+  // holds them all (nearest to goal on ties, or the run at goal itself),
+  // else the longest run. A goal past the end starts at the next-fit
+  // cursor. Returns the first block, or -1 if full; sets length.
+  int32_t allocate_range(uint32_t count, uint32_t goal, uint32_t &length);
+
   // Free a block
   bool free(uint32_t block_num);
 
@@ -27,6 +38,9 @@ public:
   // Get number of free blocks
   uint32_t get_free_count() const;
 
+  // Count free runs and find the longest one
+  void get_free_extents(uint32_t &runs, uint32_t &longest) const;
+
   // Serialize to bytes
   std::vector<uint8_t> serialize() const;
 
@@ -34,18 +48,28 @@ public:
   bool deserialize(const std::vector<uint8_t> &data);
 
   // Get bitmap size in bytes
-  size_t size() const { return bitmap_.size(); }
+  size_t size() const { return (total_blocks_ + 7) / 8; }
 
 private:
-  std::vector<uint8_t> bitmap_;
+  static constexpr uint32_t WORD_BITS = 64;
+  static constexpr uint32_t CHUNK_WORDS = 64; // summary granularity
+  static constexpr uint32_t CHUNK_BITS = WORD_BITS * CHUNK_WORDS;
+
+  std::vector<uint64_t> words_;      // set = allocated, also past the end
+  std::vector<uint32_t> chunk_free_; // free blocks per CHUNK_BITS
   uint32_t total_blocks_;
   uint32_t free_blocks_;
+  uint32_t next_; // next-fit cursor
   mutable std::mutex mutex_;
 
-  // Helper functions
+  // Helper functions (caller holds mutex_)
+  int32_t find_free(uint32_t start) const;
+  uint32_t next_free(uint32_t pos, uint32_t end) const; // end if none
+  uint32_t next_used(uint32_t pos, uint32_t end) const; // end if none
   void set_bit(uint32_t pos);
   void clear_bit(uint32_t pos);
   bool get_bit(uint32_t pos) const;
+  void rebuild_summary();
 };
 
 } // namespace vfs
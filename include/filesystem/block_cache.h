@@ -0,0 +1,141 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include "block_pool.h"
+#include "vfs_types.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace vfs {
+
+/**
+ * @brief Read-only view of one block, valid for the handle's lifetime
+ * Handles from the cache pin the cached buffer (no copy on a hit); handles
+ * for memory-mapped images point straight into the mapping.
+ */
+class BlockHandle {
+public:
+  BlockHandle() = default;
+  ~BlockHandle() { reset(); }
+
+  BlockHandle(const BlockHandle &other)
+      : buffer_(other.buffer_), data_(other.data_) {
+    if (buffer_ != nullptr) {
+      buffer_->retain();
+    }
+  }
+  BlockHandle(BlockHandle &&other) noexcept
+      : buffer_(other.buffer_), data_(other.data_) {
+    other.buffer_ = nullptr;
+    other.data_ = nullptr;
+  }
+  BlockHandle &operator=(BlockHandle other) noexcept {
+    std::swap(buffer_, other.buffer_);
+    std::swap(data_, other.data_);
+    return *this;
+  }
+
+  // Adopt a buffer reference the caller already owns
+  static BlockHandle adopt(BlockBuffer *buffer) {
+    BlockHandle handle;
+    handle.buffer_ = buffer;
+    handle.data_ = buffer->data;
+    return handle;
+  }
+
+  // Unowned view of memory that outlives the handle (e.g. an mmap)
+  static BlockHandle view(const char *data) {
+    BlockHandle handle;
+    handle.data_ = data;
+    return handle;
+  }
+
+  const char *data() const { return data_; }
+  size_t size() const { return BLOCK_SIZE; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+  BlockBuffer *buffer() const { return buffer_; }
+
+  void reset() {
+    if (buffer_ != nullptr) {
+      buffer_->release();
+    }
+    buffer_ = nullptr;
+    data_ = nullptr;
+  }
+
+private:
+  BlockBuffer *buffer_ = nullptr;
+  const char *data_ = nullptr;
+};
+
+/**
+ * @brief Sharded block cache with a pluggable replacement policy
+ * Blocks are spread over a power-of-two number of shards by block number,
+ * each with its own mutex, slots and policy state, so concurrent readers
+ * of different blocks contend on at most one shard lock. Cached buffers
+ * that are pinned by a BlockHandle are never evicted. Create instances
+ * with make_block_cache(); the implementation is templated on the policy.
+ */
+class BlockCache {
+public:
+  virtual ~BlockCache() = default;
+
+  // Get a pinned view of a cached block; empty handle on a miss
+  virtual BlockHandle get(uint32_t block_num) = 0;
+
+  // Get block data from cache (copying)
+  virtual bool get(uint32_t block_num, std::vector<char> &data) = 0;
+  virtual bool get(uint32_t block_num, char *out) = 0; // BLOCK_SIZE bytes
+
+  // Put block data into cache
+  virtual void put(uint32_t block_num, const std::vector<char> &data) = 0;
+  virtual void put(uint32_t block_num, const char *data) = 0; // BLOCK_SIZE
+
+  // Cache the handle's buffer itself, without copying
+  virtual void put(uint32_t block_num, const BlockHandle &handle) = 0;
+
+  // Cache a block read ahead of use unless the block is already cached
+  // (the cached copy may be newer). Counted in the readahead statistics.
+  virtual bool prefetch(uint32_t block_num, const BlockHandle &handle) = 0;
+
+  // Membership test that leaves statistics and policy state alone
+  virtual bool contains(uint32_t block_num) const = 0;
+
+  // Invalidate a block from cache
+  virtual void invalidate(uint32_t block_num) = 0;
+
+  // Clear entire cache
+  virtual void clear() = 0;
+
+  // Get cache statistics (summed over all shards)
+  virtual CacheStats get_stats() const = 0;
+
+  // Set capacity; each shard gets an equal share, rounded up. Policy
+  // history is reset.
+  virtual void set_capacity(size_t new_capacity) = 0;
+
+  virtual size_t get_capacity() const = 0;
+  virtual size_t get_size() const = 0;
+  virtual size_t get_shard_count() const = 0;
+  virtual CachePolicy get_policy() const = 0;
+};
+
+/**
+ * @brief Create a block cache
+ * @param policy Replacement policy
+ * @param capacity Total number of blocks to cache
+ * @param num_shards Shard count (rounded down to a power of two),
+ *        0 to derive it from the capacity
+ */
+std::unique_ptr<BlockCache> make_block_cache(CachePolicy policy,
+                                             size_t capacity,
+                                             size_t num_shards = 0);
+
+// Short lowercase policy name ("lru", "clock", "2q", "arc", "clock-pro")
+const char *cache_policy_name(CachePolicy policy);
+
+} // namespace vfs
+
+#endif // BLOCK_CACHE_H
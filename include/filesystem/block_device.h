@@ -0,0 +1,142 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include "vfs_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vfs {
+
+/**
+ * @brief Block-level storage abstraction (see docs/INTERFACES.md)
+ * The VFS never touches the host image file directly; every block read and
+ * write goes through an IBlockDevice. Implementations must be safe to call
+ * from several threads at once for different blocks.
+ */
+struct IBlockDevice {
+  virtual ~IBlockDevice() = default;
+
+  virtual uint32_t BlockSize() const = 0; // e.g. 4096
+  virtual uint32_t NumBlocks() const = 0; // total number of blocks
+
+  // Read/write exactly one block; false on failure or out of range.
+  virtual bool ReadBlock(uint32_t block_id, void *out) = 0;
+  virtual bool WriteBlock(uint32_t block_id, const void *data) = 0;
+
+  // Persist buffered writes (if any).
+  virtual bool Flush() = 0;
+
+  // Batched I/O: read/write `count` whole blocks. The defaults loop over
+  // ReadBlock/WriteBlock; asynchronous backends submit the batch at once.
+  virtual bool ReadBlocks(const uint32_t *block_ids, void *const *outs,
+                          size_t count);
+  virtual bool WriteBlocks(const uint32_t *block_ids,
+                           const void *const *datas, size_t count);
+
+  // Start a batched read and return; `done` runs once every block has
+  // completed, possibly on another thread. Buffers must stay valid until
+  // then. The default completes synchronously before returning.
+  using Completion = std::function<void(bool ok)>;
+  virtual void ReadBlocksAsync(std::vector<uint32_t> block_ids,
+                               std::vector<void *> outs, Completion done);
+
+  // True if ReadBlocksAsync really overlaps with the caller
+  virtual bool IsAsync() const { return false; }
+
+  // Direct pointer to a block for memory-resident devices, nullptr
+  // otherwise. Callers that get a pointer may skip their own caching.
+  virtual const char *BlockData(uint32_t /*block_id*/) const {
+    return nullptr;
+  }
+};
+
+/**
+ * @brief Raw file descriptor backend using pread/pwrite
+ * Positional I/O carries no shared stream offset, so concurrent readers
+ * and writers of different blocks never serialize on the device. Batches
+ * move runs of consecutive blocks with a single preadv/pwritev.
+ */
+class PosixBlockDevice : public IBlockDevice {
+public:
+  PosixBlockDevice(int fd, uint32_t num_blocks);
+  ~PosixBlockDevice() override;
+
+  PosixBlockDevice(const PosixBlockDevice &) = delete;
+  PosixBlockDevice &operator=(const PosixBlockDevice &) = delete;
+
+  uint32_t BlockSize() const override;
+  uint32_t NumBlocks() const override { return num_blocks_; }
+
+  bool ReadBlock(uint32_t block_id, void *out) override;
+  bool WriteBlock(uint32_t block_id, const void *data) override;
+  bool ReadBlocks(const uint32_t *block_ids, void *const *outs,
+                  size_t count) override;
+  bool WriteBlocks(const uint32_t *block_ids, const void *const *datas,
+                   size_t count) override;
+  bool Flush() override;
+
+protected:
+  // Give up ownership of the fd (it will not be closed on destruction)
+  void release_fd() { fd_ = -1; }
+
+private:
+  bool transfer_blocks(bool write, const uint32_t *block_ids,
+                       void *const *buffers, size_t count);
+
+  int fd_;
+  uint32_t num_blocks_;
+};
+
+/**
+ * @brief Memory-mapped backend
+ * The whole image is mapped MAP_SHARED. Reads and writes are plain copies
+ * to and from the mapping; Flush() msyncs it to the image file.
+ */
+class MmapBlockDevice : public IBlockDevice {
+public:
+  MmapBlockDevice(int fd, char *base, uint32_t num_blocks);
+  ~MmapBlockDevice() override;
+
+  MmapBlockDevice(const MmapBlockDevice &) = delete;
+  MmapBlockDevice &operator=(const MmapBlockDevice &) = delete;
+
+  uint32_t BlockSize() const override;
+  uint32_t NumBlocks() const override { return num_blocks_; }
+
+  bool ReadBlock(uint32_t block_id, void *out) override;
+  bool WriteBlock(uint32_t block_id, const void *data) override;
+  bool Flush() override;
+  const char *BlockData(uint32_t block_id) const override;
+
+private:
+  int fd_;
+  char *base_;
+  uint32_t num_blocks_;
+};
+
+/**
+ * @brief io_uring backend on top of the pread/pwrite device
+ * Single blocks still use pread/pwrite; batches are queued on the
+ * submission ring in one go and reaped by a completion thread.
+ * @return device, or nullptr if io_uring is unavailable (fd stays open)
+ */
+std::unique_ptr<IBlockDevice> create_io_uring_block_device(int fd,
+                                                           uint32_t num_blocks);
+
+/**
+ * @brief Open an existing image file as a block device
+ * @param image_path Path to the image file
+ * @param backend Which device implementation to use
+ * @return device, or nullptr if the file cannot be opened
+ */
+std::unique_ptr<IBlockDevice>
+open_block_device(const std::string &image_path,
+                  BlockBackend backend = BlockBackend::PREAD);
+
+} // namespace vfs
+
+#endif // BLOCK_DEVICE_H
@@ -0,0 +1,99 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include "vfs_types.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace vfs {
+
+/**
+ * @brief Reference-counted block frame shared by the cache and handles
+ * The cache owns one reference while the block is cached; every
+ * BlockHandle owns another. A buffer with more than one reference is
+ * pinned: the cache neither evicts it nor overwrites it in place.
+ * Buffers come from BlockPool and go back to it on the last release.
+ */
+struct BlockBuffer {
+  std::atomic<uint32_t> refs{0};
+  char *data = nullptr;         // BLOCK_SIZE bytes, 4 KiB aligned
+  BlockBuffer *next = nullptr;  // free list link while unused
+
+  static BlockBuffer *create();
+  void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+  void release();
+  bool pinned() const { return refs.load(std::memory_order_acquire) > 1; }
+};
+
+/**
+ * @brief Slab allocator for 4 KiB-aligned block frames
+ * Frames are carved out of slabs of SLAB_FRAMES and recycled through a
+ * shared free list fronted by a small per-thread cache, so steady-state
+ * block traffic never reaches malloc. Slabs are kept for the lifetime of
+ * the process (frames may outlive any one cache or mount).
+ */
+class BlockPool {
+public:
+  static constexpr size_t SLAB_FRAMES = 64;
+
+  struct Stats {
+    uint64_t slab_allocations;  // calls into the system allocator
+    uint64_t frames_total;      // frames carved out so far
+    uint64_t frames_in_use;
+    uint64_t frame_allocations; // allocate() calls
+    uint64_t frame_frees;       // free() calls
+  };
+
+  static BlockPool &instance();
+
+  // Returns a frame with one reference
+  BlockBuffer *allocate();
+  void free(BlockBuffer *buffer);
+
+  Stats get_stats() const;
+
+private:
+  BlockPool() = default;
+
+  friend struct ThreadFrameCache;
+  BlockBuffer *allocate_shared();
+  void free_shared(BlockBuffer *buffer);
+  void grow(); // expects mutex_ to be held
+
+  mutable std::mutex mutex_;
+  BlockBuffer *free_list_ = nullptr;
+  std::vector<char *> slabs_;
+
+  std::atomic<uint64_t> slab_allocations_{0};
+  std::atomic<uint64_t> frames_total_{0};
+  std::atomic<uint64_t> frame_allocations_{0};
+  std::atomic<uint64_t> frame_frees_{0};
+};
+
+/**
+ * @brief Thread-local scratch frame for temporary block copies
+ * Replaces short-lived std::vector<char>(BLOCK_SIZE) buffers; the frame
+ * returns to the calling thread's cache on destruction.
+ */
+class ScratchBlock {
+public:
+  ScratchBlock() : buffer_(BlockPool::instance().allocate()) {}
+  ~ScratchBlock() { BlockPool::instance().free(buffer_); }
+
+  ScratchBlock(const ScratchBlock &) = delete;
+  ScratchBlock &operator=(const ScratchBlock &) = delete;
+
+  char *data() { return buffer_->data; }
+  const char *data() const { return buffer_->data; }
+  size_t size() const { return BLOCK_SIZE; }
+
+private:
+  BlockBuffer *buffer_;
+};
+
+} // namespace vfs
+
+#endif // BLOCK_POOL_H
@@ -0,0 +1,220 @@
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include "block_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vfs {
+
+// A cache slot as seen by the replacement policies
+struct CacheSlot {
+  uint32_t block_num = 0;
+  BlockBuffer *buffer = nullptr; // null if the slot is free
+  bool readahead = false;        // prefetched and not referenced yet
+
+  bool pinned() const { return buffer != nullptr && buffer->pinned(); }
+};
+
+/**
+ * @brief Open-addressing block -> value map
+ * Sized once per capacity change, so steady-state inserts and erases
+ * never allocate. Load factor stays at or below one half.
+ */
+class BlockIndex {
+public:
+  void reset(size_t capacity);
+  bool find(uint32_t block_num, uint32_t &value) const;
+  void insert(uint32_t block_num, uint32_t value);
+  void erase(uint32_t block_num);
+  void clear();
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+  struct Entry {
+    uint32_t block_num;
+    uint32_t value; // EMPTY if unused
+  };
+
+  size_t home(uint32_t block_num) const {
+    uint32_t h = block_num * 0x9E3779B1u;
+    return (h ^ (h >> 16)) & mask_;
+  }
+  size_t position(uint32_t block_num) const; // table_.size() if absent
+
+  std::vector<Entry> table_;
+  size_t mask_ = 0;
+  size_t size_ = 0;
+};
+
+/**
+ * @brief Intrusive doubly linked lists over slot numbers
+ * Every slot is on at most one list; front is most recently used.
+ */
+class SlotLists {
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  void reset(size_t slots, size_t lists);
+  void push_front(uint32_t list, uint32_t slot);
+  void remove(uint32_t slot);
+  void move_to_front(uint32_t list, uint32_t slot);
+
+  uint32_t back(uint32_t list) const { return tail_[list]; }
+  uint32_t prev(uint32_t slot) const { return prev_[slot]; }
+  uint32_t list_of(uint32_t slot) const { return owner_[slot]; }
+  size_t size(uint32_t list) const { return size_[list]; }
+
+  // Least recently used unpinned slot on the list, or NONE
+  uint32_t unpinned_back(uint32_t list, const CacheSlot *slots) const;
+
+private:
+  std::vector<uint32_t> prev_;
+  std::vector<uint32_t> next_;
+  std::vector<uint32_t> owner_;
+  std::vector<uint32_t> head_;
+  std::vector<uint32_t> tail_;
+  std::vector<size_t> size_;
+};
+
+/**
+ * @brief Bounded FIFO of recently evicted block numbers ("ghosts")
+ * Membership tests are O(1); erased entries leave a tombstone in the ring
+ * that is skipped when the oldest entry is dropped.
+ */
+class GhostList {
+public:
+  void reset(size_t capacity);
+  bool contains(uint32_t block_num) const;
+  // Returns true if the oldest live entry had to be dropped
+  bool push(uint32_t block_num);
+  bool erase(uint32_t block_num);
+  bool pop_oldest();
+  size_t size() const { return live_; }
+
+private:
+  void skip_tombstones();
+
+  std::vector<uint32_t> ring_;
+  std::vector<uint8_t> alive_;
+  BlockIndex index_; // block -> ring position
+  size_t capacity_ = 0;
+  size_t head_ = 0;  // oldest entry
+  size_t used_ = 0;  // ring positions in use, tombstones included
+  size_t live_ = 0;
+};
+
+// Replacement policies. Each instance manages one cache shard of a fixed
+// number of slots and is only called with the shard lock held:
+//   reset(capacity)          forget everything, slots 0..capacity-1
+//   on_hit(slot)             the block in slot was accessed
+//   on_insert(slot, block)   slot now holds block (a miss was filled)
+//   on_remove(slot)          slot was invalidated; no history kept
+//   victim(incoming, slots, slot)
+//                            pick an unpinned resident slot to evict for
+//                            `incoming`, detach it and record history;
+//                            false if every candidate is pinned
+
+// Plain LRU: one recency list
+class LruPolicy {
+public:
+  void reset(size_t capacity);
+  void on_hit(uint32_t slot);
+  void on_insert(uint32_t slot, uint32_t block_num);
+  void on_remove(uint32_t slot);
+  bool victim(uint32_t incoming, const CacheSlot *slots, uint32_t &slot);
+
+private:
+  SlotLists lists_;
+};
+
+// CLOCK: reference bit per slot, second chance on the sweep
+class ClockPolicy {
+public:
+  void reset(size_t capacity);
+  void on_hit(uint32_t slot) { referenced_[slot] = 1; }
+  void on_insert(uint32_t slot, uint32_t block_num);
+  void on_remove(uint32_t slot) { resident_[slot] = 0; }
+  bool victim(uint32_t incoming, const CacheSlot *slots, uint32_t &slot);
+
+private:
+  std::vector<uint8_t> referenced_;
+  std::vector<uint8_t> resident_;
+  size_t hand_ = 0;
+};
+
+// 2Q (Johnson & Shasha): first-time blocks enter a small FIFO (A1in);
+// only blocks seen again after leaving it (remembered in A1out) reach
+// the main LRU list, so one-shot scans cannot flush hot blocks.
+class TwoQueuePolicy {
+public:
+  void reset(size_t capacity);
+  void on_hit(uint32_t slot);
+  void on_insert(uint32_t slot, uint32_t block_num);
+  void on_remove(uint32_t slot);
+  bool victim(uint32_t incoming, const CacheSlot *slots, uint32_t &slot);
+
+private:
+  enum : uint32_t { A1IN = 0, AM = 1 };
+  SlotLists lists_;
+  GhostList a1out_;
+  size_t kin_ = 1;
+  uint32_t promoted_ = 0;      // incoming block found in A1out by victim()
+  bool has_promoted_ = false;
+};
+
+// ARC (Megiddo & Modha): recency (T1) and frequency (T2) lists with ghost
+// lists B1/B2 steering the adaptive target size p of T1.
+class ArcPolicy {
+public:
+  void reset(size_t capacity);
+  void on_hit(uint32_t slot);
+  void on_insert(uint32_t slot, uint32_t block_num);
+  void on_remove(uint32_t slot);
+  bool victim(uint32_t incoming, const CacheSlot *slots, uint32_t &slot);
+
+  size_t target_t1() const { return p_; }
+
+private:
+  enum : uint32_t { T1 = 0, T2 = 1 };
+  size_t adapted_target(uint32_t block_num) const;
+
+  SlotLists lists_;
+  GhostList b1_;
+  GhostList b2_;
+  size_t capacity_ = 0;
+  size_t p_ = 0;
+};
+
+// CLOCK-Pro (Jiang, Chen & Zhang), simplified to one clock with a cold and
+// a hot hand. New blocks start cold in a test period; a reference during
+// the test period (or a re-access soon after eviction, tracked in a ghost
+// list) makes them hot. The cold target adapts to those re-accesses.
+class ClockProPolicy {
+public:
+  void reset(size_t capacity);
+  void on_hit(uint32_t slot) { referenced_[slot] = 1; }
+  void on_insert(uint32_t slot, uint32_t block_num);
+  void on_remove(uint32_t slot);
+  bool victim(uint32_t incoming, const CacheSlot *slots, uint32_t &slot);
+
+private:
+  enum : uint8_t { FREE = 0, COLD = 1, HOT = 2 };
+  void run_hot_hand();
+
+  std::vector<uint8_t> state_;
+  std::vector<uint8_t> referenced_;
+  std::vector<uint8_t> test_;
+  GhostList non_resident_;
+  size_t capacity_ = 0;
+  size_t hot_count_ = 0;
+  size_t cold_target_ = 1;
+  size_t cold_hand_ = 0;
+  size_t hot_hand_ = 0;
+};
+
+} // namespace vfs
+
+#endif // CACHE_POLICY_H
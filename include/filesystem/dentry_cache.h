@@ -0,0 +1,80 @@
+#ifndef DENTRY_CACHE_H
+#define DENTRY_CACHE_H
+
+#include "vfs_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace vfs {
+
+/**
+ * @brief Directory entry cache: (parent inode, name) -> child inode
+ * Negative entries remember names that are known not to exist, so
+ * repeated exists() checks for missing files skip the directory too.
+ * Callers keep entries exact by updating them under the parent's
+ * exclusive lock whenever a directory entry is added or removed, and
+ * only insert lookup results while holding the parent's lock. Entries are
+ * evicted least recently used first. The internal mutex is innermost.
+ */
+class DentryCache {
+public:
+  static constexpr int32_t NEGATIVE = -1;
+
+  explicit DentryCache(size_t capacity);
+
+  // Child inode or NEGATIVE on a hit, false on a miss
+  bool lookup(uint32_t parent, std::string_view name, int32_t &inode_num);
+
+  // Record a lookup result or a directory change (NEGATIVE: no such name)
+  void insert(uint32_t parent, std::string_view name, int32_t inode_num);
+  void erase(uint32_t parent, std::string_view name);
+
+  size_t size() const;
+  void clear();
+
+  CacheStats get_stats() const;
+
+private:
+  // Names are owned by the LRU nodes and the map keys view them, so a
+  // lookup hashes the caller's name without copying it
+  struct Key {
+    uint32_t parent;
+    std::string_view name;
+
+    bool operator==(const Key &other) const {
+      return parent == other.parent && name == other.name;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<std::string_view>()(key.name) ^
+             (static_cast<size_t>(key.parent) * 0x9E3779B97F4A7C15ull);
+    }
+  };
+
+  struct Node {
+    uint32_t parent;
+    std::string name;
+    int32_t inode_num;
+  };
+
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  std::list<Node> lru_; // front = most recently used
+  std::unordered_map<Key, std::list<Node>::iterator, KeyHash> entries_;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+} // namespace vfs
+
+#endif // DENTRY_CACHE_H
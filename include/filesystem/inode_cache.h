@@ -0,0 +1,82 @@
+#ifndef INODE_CACHE_H
+#define INODE_CACHE_H
+
+#include "vfs_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vfs {
+
+/**
+ * @brief Decoded inodes keyed by inode number
+ * A hit costs a 128-byte copy instead of an inode-table block lookup.
+ * Entries referenced by retain() (open files) are pinned; dirty entries
+ * stay cached until take_dirty() hands them out in inode order, which
+ * groups them by inode-table block. Other entries are evicted least
+ * recently used first once the cache is over capacity. The internal mutex
+ * is innermost: no other lock is taken while it is held.
+ */
+class InodeCache {
+public:
+  explicit InodeCache(size_t capacity);
+
+  // Copy a cached inode out; false on a miss
+  bool get(uint32_t inode_num, Inode &inode);
+
+  // Cache an inode read from the table, unless a newer copy is cached
+  void fill(uint32_t inode_num, const Inode &inode);
+
+  // Store an inode that was just written (dirty: not yet in its block)
+  void put(uint32_t inode_num, const Inode &inode, bool dirty);
+
+  // Pin and unpin an inode; a pin may be taken before the inode is cached
+  void retain(uint32_t inode_num);
+  void release(uint32_t inode_num);
+
+  // Move every dirty inode into out, sorted by inode number, and mark the
+  // entries clean
+  void take_dirty(std::vector<std::pair<uint32_t, Inode>> &out);
+
+  // Mark an inode dirty again after its write-back failed, unless it has
+  // been rewritten since take_dirty()
+  void redirty(uint32_t inode_num, const Inode &inode);
+
+  size_t dirty_count() const;
+  size_t size() const;
+  void clear();
+
+  CacheStats get_stats() const;
+
+private:
+  struct Entry {
+    Inode inode;
+    uint32_t refs = 0;
+    bool valid = false; // false while only pinned
+    bool dirty = false;
+    std::list<uint32_t>::iterator lru; // front = most recently used
+  };
+
+  Entry &entry(uint32_t inode_num); // expects mutex_ to be held
+  void touch(Entry &e);
+  void evict(); // expects mutex_ to be held
+
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, Entry> entries_;
+  std::list<uint32_t> lru_;
+  std::set<uint32_t> dirty_;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+} // namespace vfs
+
+#endif // INODE_CACHE_H
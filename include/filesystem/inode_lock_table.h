@@ -0,0 +1,68 @@
+#ifndef INODE_LOCK_TABLE_H
+#define INODE_LOCK_TABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+namespace vfs {
+
+/**
+ * @brief Per-inode reader/writer locks
+ * Inode numbers are hashed onto a fixed set of cache-line aligned stripes,
+ * so unrelated files almost never share a lock and no allocation happens on
+ * the lookup path. Whenever more than one inode is locked at a time the
+ * stripes must be taken in ascending order; lock_exclusive_pair() does this.
+ */
+class InodeLockTable {
+public:
+  static constexpr size_t STRIPES = 1024;
+
+  using ExclusiveLock = std::unique_lock<std::shared_mutex>;
+  using SharedLock = std::shared_lock<std::shared_mutex>;
+
+  std::shared_mutex &get(uint32_t inode_num) {
+    return stripes_[stripe_of(inode_num)].mutex;
+  }
+
+  SharedLock lock_shared(uint32_t inode_num) {
+    return SharedLock(get(inode_num));
+  }
+
+  ExclusiveLock lock_exclusive(uint32_t inode_num) {
+    return ExclusiveLock(get(inode_num));
+  }
+
+  // Exclusively lock two inodes (e.g. parent directory and child) in stripe
+  // order. If both land on the same stripe, the second lock is left empty.
+  std::pair<ExclusiveLock, ExclusiveLock> lock_exclusive_pair(uint32_t a,
+                                                              uint32_t b) {
+    size_t sa = stripe_of(a);
+    size_t sb = stripe_of(b);
+    if (sa == sb) {
+      return {ExclusiveLock(stripes_[sa].mutex), ExclusiveLock()};
+    }
+    if (sa > sb) {
+      std::swap(sa, sb);
+    }
+    ExclusiveLock first(stripes_[sa].mutex);
+    ExclusiveLock second(stripes_[sb].mutex);
+    return {std::move(first), std::move(second)};
+  }
+
+private:
+  struct alignas(64) Stripe {
+    std::shared_mutex mutex;
+  };
+
+  static size_t stripe_of(uint32_t inode_num) { return inode_num % STRIPES; }
+
+  std::array<Stripe, STRIPES> stripes_;
+};
+
+} // namespace vfs
+
+#endif // INODE_LOCK_TABLE_H
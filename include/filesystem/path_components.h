@@ -0,0 +1,78 @@
+#ifndef PATH_COMPONENTS_H
+#define PATH_COMPONENTS_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace vfs {
+
+/**
+ * @brief Components of a slash-separated path as views into it
+ * Empty and "." components are dropped and ".." removes the previous
+ * component (lexically, never above the root). Paths up to INLINE_DEPTH
+ * components deep are parsed without touching the heap; the path must
+ * outlive the object.
+ */
+class PathComponents {
+public:
+  static constexpr size_t INLINE_DEPTH = 32;
+
+  explicit PathComponents(std::string_view path) {
+    size_t pos = 0;
+    while (pos < path.size()) {
+      size_t end = path.find('/', pos);
+      if (end == std::string_view::npos) {
+        end = path.size();
+      }
+      std::string_view component = path.substr(pos, end - pos);
+      pos = end + 1;
+      if (component.empty() || component == ".") {
+        continue;
+      }
+      if (component == "..") {
+        if (size_ > 0) {
+          pop_back();
+        }
+        continue;
+      }
+      push_back(component);
+    }
+  }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  std::string_view operator[](size_t i) const { return data()[i]; }
+  std::string_view back() const { return data()[size_ - 1]; }
+  void pop_back() { size_--; }
+
+  const std::string_view *begin() const { return data(); }
+  const std::string_view *end() const { return data() + size_; }
+
+private:
+  const std::string_view *data() const {
+    return overflow_.empty() ? inline_.data() : overflow_.data();
+  }
+
+  void push_back(std::string_view component) {
+    if (overflow_.empty() && size_ < INLINE_DEPTH) {
+      inline_[size_++] = component;
+      return;
+    }
+    if (overflow_.empty()) {
+      overflow_.assign(inline_.begin(), inline_.end());
+    }
+    overflow_.resize(size_);
+    overflow_.push_back(component);
+    size_++;
+  }
+
+  std::array<std::string_view, INLINE_DEPTH> inline_;
+  std::vector<std::string_view> overflow_; // deeper paths only
+  size_t size_ = 0;
+};
+
+} // namespace vfs
+
+#endif // PATH_COMPONENTS_H
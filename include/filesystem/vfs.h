@@ -2,12 +2,25 @@
 #define VFS_H
 
 #include "bitmap.h"
-#include "lru_cache.h"
+#include "block_cache.h"
+#include "block_device.h"
+#include "dentry_cache.h"
+#include "inode_cache.h"
+#include "inode_lock_table.h"
+#include "path_components.h"
 #include "vfs_types.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <map>
@@ -15,6 +28,20 @@
 
 namespace vfs {
 
+/**
+ * @brief Per-fd cache of logical to physical block translations
+ * Holds the mapping of one window of file blocks: the blocks behind one
+ * pointer block (or the direct blocks), so refilling it costs a single
+ * pointer block access. Entries of 0 are unknown and looked up again.
+ */
+struct BlockMapCache {
+  std::mutex mutex;        // users of a shared fd
+  uint64_t generation = 0; // map generation the window was filled at
+  uint32_t first = 0;      // first file block of the window
+  uint32_t count = 0;      // 0 if empty
+  std::array<uint32_t, BLOCK_SIZE / sizeof(uint32_t)> physical;
+};
+
 /**
  * @brief Virtual File System implementation
  * Provides a complete file system with directory structure,
@@ -37,6 +64,29 @@ public:
   bool format(const std::string &image_path, uint32_t size_mb,
               size_t cache_capacity = 256);
 
+  /**
+   * @brief Format a new file system with explicit options
+   * @param image_path Path to the image file
+   * @param size_mb Total size in megabytes
+   * @param options version (FORMAT_V2, extent trees; FORMAT_V1 for
+   *        indirect blocks), total_inodes (0, one inode per 8 blocks) and
+   *        compact_dirs (true, DirRecord directory blocks); see
+   *        FormatOptions in vfs_types.h
+   * @param cache_capacity Number of blocks to cache (default 256)
+   * @return true if successful
+   */
+  bool format(const std::string &image_path, uint32_t size_mb,
+              const FormatOptions &options, size_t cache_capacity = 256);
+
+  /**
+   * @brief Convert an unmounted v1 image to extent-based format v2
+   * Rewrites every block map in place; not crash-safe, so back the image
+   * up first.
+   * @param image_path Path to the image file
+   * @return true if successful (also when the image already is v2)
+   */
+  bool upgrade_image(const std::string &image_path);
+
   /**
    * @brief Mount an existing file system
    * @param image_path Path to the image file
@@ -45,6 +95,19 @@ public:
    */
   bool mount(const std::string &image_path, size_t cache_capacity = 256);
 
+  /**
+   * @brief Mount an existing file system with explicit options
+   * @param image_path Path to the image file
+   * @param options Block cache capacity, shards and replacement policy,
+   *        block device backend (pread, mmap, io_uring), write-back
+   *        caching and its dirty thresholds, journal size and mode
+   *        (ordered or full), readahead window, inode and dentry cache
+   *        sizes, and atime mode; defaults and details in MountOptions
+   *        (vfs_types.h)
+   * @return true if successful
+   */
+  bool mount(const std::string &image_path, const MountOptions &options);
+
   /**
    * @brief Unmount the file system
    */
@@ -55,6 +118,12 @@ public:
    */
   bool is_mounted() const { return mounted_; }
 
+  /**
+   * @brief Write back all dirty blocks and checkpoint the journal
+   * @return 0 on success, negative error code on failure
+   */
+  int sync();
+
   // ===== File Operations =====
 
   /**
@@ -105,6 +174,39 @@ public:
    */
   ssize_t write(int fd, const void *buffer, size_t count);
 
+  /**
+   * @brief Read from a file into a scatter list
+   * Fills the segments in order in one locked pass over the block map.
+   * @param fd File descriptor
+   * @param iov Segments to fill
+   * @param iovcnt Number of segments
+   * @return number of bytes read, or negative error code
+   */
+  ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+  /**
+   * @brief Write a gather list to a file
+   * @param fd File descriptor
+   * @param iov Segments to write, in order
+   * @param iovcnt Number of segments
+   * @return number of bytes written, or negative error code
+   */
+  ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+  /**
+   * @brief readv() at an explicit offset
+   * The descriptor's offset is neither used nor moved, so several threads
+   * can read one open file concurrently.
+   * @return number of bytes read, or negative error code
+   */
+  ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+  /**
+   * @brief writev() at an explicit offset, leaving the descriptor's offset
+   * @return number of bytes written, or negative error code
+   */
+  ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
   /**
    * @brief Seek to a position in a file
    * @param fd File descriptor
@@ -137,7 +239,7 @@ public:
    * @param entries Output vector of directory entries
    * @return 0 on success, negative error code on failure
    */
-  int readdir(const std::string &path, std::vector<DirEntry> &entries);
+  int readdir(const std::string &path, std::vector<DirEntryInfo> &entries);
 
   /**
    * @brief Check if path exists
@@ -198,9 +300,25 @@ public:
    */
   CacheStats get_cache_stats() const;
 
+  /**
+   * @brief Get inode cache statistics
+   */
+  CacheStats get_inode_cache_stats() const;
+
+  /**
+   * @brief Get directory entry cache statistics
+   */
+  CacheStats get_dentry_cache_stats() const;
+
   struct JournalStats {
-    uint64_t replayed{0};
-    uint64_t pending{0};
+    uint64_t replayed{0};     // blocks replayed at mount
+    uint64_t pending{0};      // journaled blocks not yet checkpointed
+    uint64_t journaled{0};    // blocks journaled since mount
+    uint64_t commits{0};      // transactions committed
+    uint64_t syncs{0};        // journal syncs (one per commit group)
+    uint64_t checkpoints{0};  // times journal space was reclaimed
+    uint64_t ordered{0};      // file data blocks written unjournaled
+    uint64_t data_flushes{0}; // image flushes ahead of a commit
     bool recovered{false};
     bool dirty{false};
   };
@@ -210,18 +328,36 @@ public:
    */
   JournalStats get_journal_stats() const;
 
+  /**
+   * @brief Number of cached blocks not yet written back (write-back mode)
+   */
+  size_t get_dirty_block_count() const;
+
+  /**
+   * @brief Number of cached inodes not yet written to the inode table
+   */
+  size_t get_dirty_inode_count() const;
+
+  /**
+   * @brief Number of extents mapping a file (0 on v1 images or error)
+   */
+  int get_extent_count(const std::string &path);
+
 private:
   // File system state
   bool mounted_;
   std::string image_path_;
-  std::fstream image_file_;
+  std::unique_ptr<IBlockDevice> device_;
   std::string journal_path_;
   std::string checksum_path_;
 
   // Core structures
   Superblock superblock_;
   std::unique_ptr<Bitmap> bitmap_;
-  std::unique_ptr<LRUCache> cache_;
+  std::unique_ptr<Bitmap> inode_bitmap_; // inodes in use, rebuilt at mount
+  std::unique_ptr<BlockCache> cache_;
+  std::unique_ptr<InodeCache> inode_cache_;
+  std::unique_ptr<DentryCache> dentry_cache_;
   std::vector<uint32_t> block_checksums_;
   JournalStats journal_stats_;
 
@@ -238,46 +374,355 @@ private:
   int next_fd_;
 
   // Concurrency control
+  //
+  // fs_mutex_ is held shared by every public call and exclusively only by
+  // format/mount/unmount and snapshot bookkeeping. File data and directory
+  // contents are protected by the per-inode locks; the remaining mutexes
+  // guard one subsystem each. Acquisition order:
+  //   fs_mutex_ -> FileDescriptor::offset_mutex -> inode_locks_
+  //   fs_mutex_ -> inode_locks_ (stripe order) -> fd_mutex_
+  //   fs_mutex_ -> inode_locks_ -> BlockMapCache::mutex -> alloc_mutex_
+  //             -> itable_mutex_
+  //             -> writeback_mutex_ -> block_io_mutex_
+  //             -> checkpoint_mutex_
+  //             -> journal_mutex_ / snapshot_mutex_ / dirty_mutex_
+  //             -> readahead_mutex_ -> cache shard locks
+  // InodeCache's and DentryCache's own mutexes are innermost.
+  // Path resolution takes directory locks one at a time, so it must run
+  // before the caller locks any inode.
   mutable std::shared_mutex fs_mutex_;
+  InodeLockTable inode_locks_;
+  mutable std::mutex fd_mutex_;       // fd_table_, next_fd_
+  mutable std::mutex alloc_mutex_;    // inode/block allocation, sb counters
+  std::mutex itable_mutex_;           // inode table reads and writes
+  mutable std::mutex journal_mutex_;  // journal state and journal_stats_
+  std::mutex snapshot_mutex_;         // snapshot diff files
+
+  // Striped by block number: orders a cache fill after a miss against a
+  // concurrent write of the same block, and guards its checksum slot.
+  static constexpr size_t BLOCK_IO_STRIPES = 64;
+  static_assert(BLOCK_IO_STRIPES <= 64, "stripe set is a 64-bit mask");
+  std::array<std::mutex, BLOCK_IO_STRIPES> block_io_mutex_;
+  std::mutex &block_io_lock(uint32_t block_num) {
+    return block_io_mutex_[block_num % BLOCK_IO_STRIPES];
+  }
+
+  // ===== Write-back state =====
+  // A dirty block's handle pins its buffer, so the cache cannot evict it
+  // before it reaches the device. The table is ordered by block number so
+  // writeback batches come out sorted and adjacent blocks coalesce.
+  struct DirtyBlock {
+    BlockHandle data;
+    bool file_data; // not journaled in ordered mode
+    std::chrono::steady_clock::time_point since; // first dirtied
+  };
+  bool write_back_ = false;
+  MountOptions mount_options_; // as given to mount()
+  std::map<uint32_t, DirtyBlock> dirty_blocks_;
+  mutable std::mutex dirty_mutex_;  // dirty_blocks_
+  std::mutex writeback_mutex_;      // one writeback pass at a time
+  std::mutex flusher_mutex_;        // flusher_stop_
+  std::condition_variable flusher_cv_;
+  bool flusher_stop_ = false;
+  std::thread flusher_;
+
+  // ===== Journal state (vfs_journal.cpp) =====
+  // Log positions count region blocks from the start of the journal and
+  // only grow; a position's block is position % journal_capacity_. The
+  // live transactions are those between head and tail, oldest first.
+  struct LiveTx {
+    uint64_t seq;
+    uint64_t end;   // log position after its commit block
+    size_t count;   // blocks journaled
+    bool written;   // records in the file (not yet synced)
+    bool done;      // in-place writes issued
+  };
+  int journal_fd_ = -1; // kept open while mounted
+  uint32_t journal_capacity_ = 0;
+  uint64_t journal_head_ = 0;
+  uint64_t journal_tail_ = 0;
+  uint64_t journal_head_seq_ = 1;
+  uint64_t journal_next_seq_ = 1;
+  uint64_t journal_synced_seq_ = 0; // every tx up to here is durable
+  bool journal_syncing_ = false;    // a committer is in fdatasync
+  uint64_t journal_failed_seq_ = 0; // aborted here, syncs stop before it
+  // Live transactions in a ring sized by open_journal(). Each one holds at
+  // least a descriptor and a commit block of the region, so half its
+  // capacity always fits them and commits never allocate.
+  std::vector<LiveTx> journal_txs_;
+  size_t journal_txs_first_ = 0;
+  size_t journal_txs_count_ = 0;
+  LiveTx &live_tx(size_t i) { // i-th oldest
+    return journal_txs_[(journal_txs_first_ + i) % journal_txs_.size()];
+  }
+  std::condition_variable journal_cv_; // syncs, written and ended txs
+  std::mutex checkpoint_mutex_;        // one checkpoint at a time
+  std::mutex checkpointer_mutex_;      // checkpointer_stop_
+  std::condition_variable checkpointer_cv_;
+  bool checkpointer_stop_ = false;
+  std::thread checkpointer_;
+  // Ordered mode: bumped as file data is written in place, and recorded
+  // once the image is flushed; a commit flushes the image first if they
+  // differ. Under journal_mutex_, and checkpoint_mutex_ too for writes
+  // of the flushed generation.
+  uint64_t ordered_gen_ = 0;
+  uint64_t ordered_flushed_gen_ = 0;
+
+  // ===== Readahead state =====
+  // Blocks being prefetched. Writers remove their blocks from the set
+  // before updating the cache, and a completion only caches blocks that
+  // are still in it, so stale prefetched data never lands in the cache.
+  // Completions may run on the device's thread and take no I/O locks.
+  uint32_t readahead_max_ = 0; // window cap, 0 if disabled
+  std::unordered_set<uint32_t> readahead_inflight_;
+  std::atomic<size_t> readahead_batches_{0}; // submitted, not completed
+  std::mutex readahead_mutex_; // readahead_inflight_, readahead_batches_
+  std::condition_variable readahead_cv_;
 
   // ===== Low-level block operations =====
   bool read_block(uint32_t block_num, std::vector<char> &data);
+  // Zero-copy variant: the handle pins the cached buffer, which later
+  // writes replace rather than modify. On mapped images it views the
+  // mapping and does see later writes.
+  bool read_block(uint32_t block_num, BlockHandle &handle);
   bool write_block(uint32_t block_num, const std::vector<char> &data);
+  bool write_block(uint32_t block_num, const char *data); // BLOCK_SIZE bytes
+  // Batched variants, one BLOCK_SIZE buffer per block. Cache misses and
+  // writes reach the device as a single ReadBlocks/WriteBlocks call.
+  // file_data marks file contents, which ordered mode does not journal.
+  bool read_blocks(const uint32_t *block_nums, char *const *outs,
+                   size_t count);
+  bool write_blocks(const uint32_t *block_nums, const char *const *datas,
+                    size_t count, bool file_data = false);
+  bool read_missed_blocks(const uint32_t *block_nums, void *const *outs,
+                          size_t count);
+
+  // Write-back helpers
+  bool mark_dirty(const uint32_t *block_nums, const char *const *datas,
+                  size_t count, bool file_data);
+  BlockHandle find_dirty(uint32_t block_num);
+  bool writeback_dirty(bool all); // all, or only expired blocks
+  void start_flusher();
+  void stop_flusher();
+  void flusher_loop();
+  void flush_dirty_blocks(); // one flusher pass over the dirty table
+
+  // Bodies of read/write and their vectored forms; offset < 0 means the
+  // descriptor's offset, which is then advanced
+  ssize_t read_vec(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+  ssize_t write_vec(int fd, const struct iovec *iov, int iovcnt,
+                    off_t offset);
+
+  // Readahead helpers
+  void plan_readahead(FileDescriptor &file_desc, const Inode &inode,
+                      uint32_t first_block, uint32_t last_block,
+                      uint32_t &start, uint32_t &stop);
+  void start_readahead(const Inode &inode, uint32_t start, uint32_t stop);
+  void finish_readahead(const uint32_t *block_nums,
+                        BlockBuffer *const *buffers, size_t count, bool ok);
+  void cancel_readahead(const uint32_t *block_nums, size_t count);
+  void wait_for_readahead();
+
+  // Holds the I/O stripe locks covering a set of blocks
+  class BlockStripeGuard {
+  public:
+    BlockStripeGuard(VirtualFileSystem &vfs, const uint32_t *block_nums,
+                     size_t count);
+    ~BlockStripeGuard();
+
+    BlockStripeGuard(const BlockStripeGuard &) = delete;
+    BlockStripeGuard &operator=(const BlockStripeGuard &) = delete;
+
+  private:
+    VirtualFileSystem &vfs_;
+    uint64_t stripes_; // one bit per block_io_mutex_ stripe
+  };
 
   // ===== Inode operations =====
   bool read_inode(uint32_t inode_num, Inode &inode);
   bool write_inode(uint32_t inode_num, const Inode &inode);
-  uint32_t allocate_inode();
+  uint32_t allocate_inode(uint32_t mode);
   bool free_inode(uint32_t inode_num);
+  bool load_inode_bitmap(); // scan the inode table once at mount
+  bool flush_inodes();      // write dirty cached inodes to their blocks
+  void update_atime(uint32_t inode_num, Inode &inode); // per atime_mode
 
   // ===== Block operations =====
-  uint32_t allocate_block();
+  uint32_t allocate_block(uint32_t goal = 0); // goal: preferred block number
+  // Up to count contiguous blocks near goal (0: next fit); sets length
+  uint32_t allocate_range(uint32_t count, uint32_t goal, uint32_t &length);
   bool free_block(uint32_t block_num);
 
+  // ===== Block mapping =====
+  // v1 images map file blocks through direct and single/double/triple
+  // indirect pointers, v2 images through extent trees (vfs_extents.cpp).
+  // Map blocks are loaded lazily and kept per tree level across calls, so
+  // a multi-block transfer reads each pointer block once.
+  // Map blocks above the data: 3 v1 pointer levels, or the blocks of an
+  // extent tree up to depth 4, by then deeper than any v1 file needs
+  static constexpr size_t MAP_LEVELS = 4;
+  struct MapView {
+    std::array<BlockHandle, MAP_LEVELS> blocks;    // pinned, by tree level
+    std::array<uint32_t, MAP_LEVELS> block_nums{}; // 0 if nothing loaded
+  };
+  struct MapBlock {
+    ScratchBlock frame;     // mutable copy of a map block
+    uint32_t block_num = 0; // 0 if nothing loaded
+    bool dirty = false;
+  };
+  struct MapPath {
+    std::array<MapBlock, MAP_LEVELS> levels; // by tree level
+
+    // Data blocks reserved as one contiguous range for a transfer and
+    // handed out in order; `wanted` is how many it may still allocate
+    uint32_t reserved = 0;
+    uint32_t reserved_end = 0;
+    uint32_t wanted = 0;
+
+    // Data blocks the caller has mapped through this path but not written
+    // yet. They go out before any map block, so no stored pointer leads
+    // to a block whose data never reached the image.
+    const uint32_t *pending_blocks = nullptr;
+    const char *const *pending_datas = nullptr;
+    size_t pending = 0;
+  };
+  // Bumped whenever mapped blocks are freed, which invalidates every
+  // BlockMapCache; maps only ever grow otherwise
+  std::atomic<uint64_t> map_generation_{1};
+  bool uses_extents() const { return superblock_.version >= FORMAT_V2; }
+  uint32_t lookup_block(const Inode &inode, uint32_t block_index,
+                        MapView &view);
+  uint32_t map_block_for_write(Inode &inode, uint32_t block_index,
+                               MapPath &path, bool &fresh);
+  bool load_map_block(MapPath &path, MapBlock &map, uint32_t block_num);
+  bool flush_map_block(MapPath &path, MapBlock &map);
+  bool flush_map_path(MapPath &path);
+  bool write_pending_data(MapPath &path);
+  uint32_t allocate_data_block(MapPath &path, uint32_t goal);
+  void release_reservation(MapPath &path); // frees unused reserved blocks
+  void free_inode_blocks(Inode &inode); // data and map blocks
+  // Translation through a per-fd cache; the caller holds cache.mutex.
+  // Windows are filled from map blocks as stored, so writers flush their
+  // MapPath before a fill.
+  bool map_cache_covers(const BlockMapCache &cache,
+                        uint32_t block_index) const;
+  void fill_map_cache(BlockMapCache &cache, const Inode &inode,
+                      uint32_t block_index, MapView &view);
+  uint32_t lookup_cached(BlockMapCache &cache, const Inode &inode,
+                         uint32_t block_index, MapView &view);
+  // Frees a v1 pointer block `depth` levels above the data and everything
+  // below it; data blocks only if free_data is set
+  void free_indirect_tree(uint32_t block_num, uint32_t depth, bool free_data);
+
+  // Extent trees (format v2)
+  uint32_t lookup_extent(const Inode &inode, uint32_t block_index,
+                         MapView &view);
+  uint32_t map_extent_for_write(Inode &inode, uint32_t block_index,
+                                MapPath &path, bool &fresh);
+  bool add_extent_block(ExtentRoot &root, MapPath &path, uint32_t block_index,
+                        uint32_t physical_block);
+  // Loads the tree blocks covering block_index into path.levels by depth
+  // (leaf at 0); slots[d] is the entry taken in the node at depth d
+  bool load_extent_path(const ExtentRoot &root, MapPath &path,
+                        uint32_t block_index, int *slots);
+  void free_extent_blocks(Inode &inode);
+  // What the entries of a node at `depth` map: data extents in a leaf,
+  // whole subtrees in an index
+  void free_extent_entries(const Extent *entries, uint16_t count,
+                           uint16_t depth);
+  int count_extents(const Extent *entries, uint16_t count, uint16_t depth);
+  bool collect_indirect(uint32_t block_num, uint32_t depth,
+                        uint32_t first_index,
+                        std::vector<std::pair<uint32_t, uint32_t>> &mapped);
+  // (file block, physical block) pairs of a v1 block map, in file order
+  bool collect_block_map(const Inode &inode,
+                         std::vector<std::pair<uint32_t, uint32_t>> &mapped);
+  bool convert_to_extents(
+      uint32_t inode_num, Inode &inode,
+      const std::vector<std::pair<uint32_t, uint32_t>> &mapped);
+
   // ===== Path operations =====
-  int32_t resolve_path(const std::string &path);
-  int32_t resolve_path_parent(const std::string &path, std::string &name);
-  std::vector<std::string> split_path(const std::string &path);
+  int32_t resolve_path(std::string_view path);
+  int32_t resolve_path_parent(std::string_view path, std::string &name);
+  // Inode reached by looking up the first count components from the root
+  int32_t walk_path(const PathComponents &components, size_t count);
 
   // ===== Directory operations =====
+  // Directories are blocks of DirEntry slots or, with FEATURE_COMPACT_DIRS,
+  // packed DirRecords; once the first block is full it becomes the root of
+  // a hash index over leaf blocks (vfs_dir.cpp)
   bool add_dir_entry(uint32_t dir_inode, const std::string &name,
                      uint32_t inode_num, FileType type);
   bool remove_dir_entry(uint32_t dir_inode, const std::string &name);
-  int32_t find_dir_entry(uint32_t dir_inode, const std::string &name);
+  int32_t find_dir_entry(uint32_t dir_inode, std::string_view name);
+  int read_dir_entries(uint32_t dir_inode, std::vector<DirEntryInfo> &entries);
+  struct DirIndexTrail {
+    // Index blocks from the root down and the entry followed in each
+    std::array<uint32_t, DIR_INDEX_MAX_LEVELS + 1> blocks{};
+    std::array<uint32_t, DIR_INDEX_MAX_LEVELS + 1> slots{};
+    uint32_t depth = 0;
+  };
+  bool read_dir_block(const Inode &dir, uint32_t index, BlockHandle &block);
+  bool write_dir_block(Inode &dir, uint32_t index, const char *data);
+  // Leaf block that holds names with this hash, 0 if the index is corrupt
+  uint32_t find_dir_leaf(const Inode &dir, const char *root, uint32_t hash,
+                         DirIndexTrail &trail);
+  bool insert_dir_index(Inode &dir, char *root, DirIndexTrail &trail,
+                        uint32_t hash, uint32_t block);
+  bool split_dir_leaf(Inode &dir, char *root, DirIndexTrail &trail,
+                      char *leaf, uint32_t leaf_index,
+                      const DirEntryView &entry);
+  // Leaf blocks hold DirRecords instead of DirEntry slots
+  bool compact_dirs() const {
+    return (superblock_.features & FEATURE_COMPACT_DIRS) != 0;
+  }
 
   // ===== Helpers =====
+  bool write_superblock();
   void init_root_directory();
   int allocate_fd();
   void free_fd(int fd);
-
-  // Journaling helpers
-  bool replay_journal();
-  bool append_journal_entry(uint32_t block_num,
-                            const std::vector<char> &data);
-  bool flush_and_clear_journal();
+  bool get_fd(int fd, FileDescriptor &file_desc);
+  void set_fd_offset(int fd, uint64_t offset);
+  void save_fd_readahead(int fd, const FileDescriptor &file_desc);
+  std::pair<InodeLockTable::ExclusiveLock, InodeLockTable::ExclusiveLock>
+  lock_dir_entry(uint32_t parent_inode, const std::string &name,
+                 int32_t &inode_num);
+
+  // ===== Journal (vfs_journal.cpp) =====
+  // Blocks are written in place only after the transaction carrying them
+  // has committed: begin_tx() reserves journal space (checkpointing if the
+  // region is full), commit_tx() writes the records and returns once they
+  // are durable, syncing together with concurrent committers, and end_tx()
+  // marks the in-place writes issued so the space can be checkpointed.
+  struct JournalTx {
+    uint64_t seq = 0; // 0: not journaled
+    uint64_t start = 0;
+    size_t count = 0;
+  };
+  bool open_journal();
+  void close_journal();
+  bool replay_journal(const JournalHeader &header);
+  bool write_journal_header(uint64_t head, uint64_t head_seq);
+  bool begin_tx(JournalTx &tx, size_t count);
+  bool commit_tx(JournalTx &tx, const uint32_t *block_nums,
+                 const char *const *datas);
+  void end_tx(const JournalTx &tx);
+  bool journals(bool file_data) const {
+    return !file_data || mount_options_.journal_mode == JournalMode::FULL;
+  }
+  // Ordered mode: records file data written in place, and flushes the
+  // image before a commit if any was written since the last flush
+  void note_ordered_data(size_t count);
+  bool flush_ordered_data();
+  // Flushes the device and releases the journal space of ended
+  // transactions; false on I/O errors
+  bool checkpoint_journal();
+  void checkpointer_loop();
 
   // Checksums
   uint32_t calc_checksum(const std::vector<char> &data) const;
+  uint32_t calc_checksum(const char *data, size_t size) const;
   void load_checksums();
   void save_checksums();
 
@@ -0,0 +1,22 @@
+#ifndef VFS_LOG_H
+#define VFS_LOG_H
+
+#include <iostream>
+
+// Log levels for VFS_LOG_LEVEL. Errors are always printed; debug tracing
+// sits on hot paths (path resolution, inode reads) and is compiled out
+// unless the build asks for it with -DVFS_LOG_LEVEL=1.
+#define VFS_LOG_ERRORS 0
+#define VFS_LOG_DEBUG 1
+
+#ifndef VFS_LOG_LEVEL
+#define VFS_LOG_LEVEL VFS_LOG_ERRORS
+#endif
+
+#if VFS_LOG_LEVEL >= VFS_LOG_DEBUG
+#define VFS_DEBUG(msg) (std::cerr << "[VFS DEBUG] " << msg << "\n")
+#else
+#define VFS_DEBUG(msg) ((void)0)
+#endif
+
+#endif // VFS_LOG_H
@@ -1,8 +1,13 @@
 #ifndef VFS_TYPES_H
 #define VFS_TYPES_H
 
+#include <cstddef>
 #include <cstdint>
 #include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 
 namespace vfs {
 
@@ -12,6 +17,14 @@ constexpr uint32_t BLOCK_SIZE = 4096;
 constexpr uint32_t DIRECT_BLOCKS = 12;
 constexpr uint32_t MAX_FILENAME = 255;
 
+// On-disk format versions (Superblock::version)
+constexpr uint32_t FORMAT_V1 = 1; // direct + single indirect block pointers
+constexpr uint32_t FORMAT_V2 = 2; // extent trees
+
+// Optional on-disk features (Superblock::features)
+constexpr uint32_t FEATURE_COMPACT_DIRS = 0x1; // variable-length DirRecord
+constexpr uint32_t FEATURES_SUPPORTED = FEATURE_COMPACT_DIRS;
+
 // File types
 enum class FileType : uint8_t {
   UNKNOWN = 0,
@@ -43,13 +56,14 @@ struct Superblock {
   uint32_t bitmap_block;      // Starting block of bitmap
   uint64_t created_time;      // Creation timestamp
   uint64_t modified_time;     // Last modification timestamp
-  char reserved[256];         // Reserved for future use
+  uint32_t features;          // FEATURE_* bits
+  char reserved[252];         // Reserved for future use
 
   Superblock()
       : magic(MAGIC_NUMBER), version(1), block_size(BLOCK_SIZE),
         total_blocks(0), total_inodes(0), free_blocks(0), free_inodes(0),
         inode_table_block(1), data_block_start(0), bitmap_block(0),
-        created_time(0), modified_time(0), reserved{} {}
+        created_time(0), modified_time(0), features(0), reserved{} {}
 } __attribute__((packed));
 
 // Inode structure (must be fixed size and aligned)
@@ -67,16 +81,63 @@ struct Inode {
   uint32_t direct_blocks[DIRECT_BLOCKS]; // Direct block pointers
   uint32_t indirect_block;               // Single indirect block pointer
   uint32_t double_indirect;              // Double indirect block pointer
-  char padding[12];                      // Padding to make it 128 bytes
+  uint32_t triple_indirect;              // Triple indirect block pointer
+  char padding[8];                       // Padding to make it 128 bytes
 
   Inode()
       : inode_num(0), mode(0), uid(0), gid(0), size(0), atime(0), mtime(0),
         ctime(0), links_count(0), blocks_count(0), direct_blocks{},
-        indirect_block(0), double_indirect(0), padding{} {}
+        indirect_block(0), double_indirect(0), triple_indirect(0),
+        padding{} {}
 };
 
 static_assert(sizeof(Inode) == 128, "Inode size must be 128 bytes");
 
+// ===== Format v2 extent trees =====
+// A v2 inode stores an ExtentRoot in place of its block pointers (from
+// direct_blocks up to the end of the inode). Depth 0 roots hold up to
+// INODE_EXTENTS extents inline; deeper roots hold index entries whose
+// `start` is a tree block one level down. Tree blocks hold up to
+// EXTENTS_PER_BLOCK entries: index entries again above depth 0, extents
+// in the depth 0 leaves. Entries are sorted by logical block.
+constexpr uint16_t EXTENT_MAGIC = 0xF30A;
+
+struct Extent {
+  uint32_t logical; // First file block covered
+  uint32_t start;   // First physical block, or child block in an index
+  uint32_t length;  // Number of blocks (unused in index entries)
+};
+
+struct ExtentHeader {
+  uint16_t magic;       // EXTENT_MAGIC
+  uint16_t entries;     // Entries in use
+  uint16_t max_entries; // Capacity of this node
+  uint16_t depth;       // 0 = entries are extents, above: index entries
+};
+
+constexpr uint32_t INODE_EXTENTS = 5;
+constexpr uint32_t EXTENTS_PER_BLOCK =
+    (BLOCK_SIZE - sizeof(ExtentHeader)) / sizeof(Extent);
+
+struct ExtentRoot {
+  ExtentHeader header;
+  Extent entries[INODE_EXTENTS];
+};
+
+static_assert(sizeof(ExtentRoot) <=
+                  sizeof(Inode) - offsetof(Inode, direct_blocks),
+              "ExtentRoot must fit in the inode's block map area");
+
+// Options for format()
+struct FormatOptions {
+  uint32_t version;      // FORMAT_V1 or FORMAT_V2
+  uint32_t total_inodes; // 0: one inode per 8 blocks
+  bool compact_dirs;     // DirRecord directory blocks instead of DirEntry slots
+
+  FormatOptions()
+      : version(FORMAT_V2), total_inodes(0), compact_dirs(true) {}
+};
+
 // Directory entry structure (must be fixed size and aligned)
 struct DirEntry {
   uint32_t inode_num; // Inode number
@@ -95,6 +156,122 @@ struct DirEntry {
 
 static_assert(sizeof(DirEntry) == 264, "DirEntry size must be 264 bytes");
 
+// Variable-length directory record (FEATURE_COMPACT_DIRS), ext2 style:
+// records are packed back to back and rec_len reaches the next one, so
+// the last record in a block also owns the free space behind it. A record
+// with inode_num 0 is unused; rec_len 0 means the rest of the block is
+// free. The name hash is stored so a lookup compares 4 bytes first.
+struct DirRecord {
+  uint32_t inode_num; // 0: unused
+  uint16_t rec_len;   // Bytes to the next record
+  uint8_t name_len;   // Name length
+  uint8_t file_type;  // File type
+  uint32_t hash;      // Directory name hash of the name
+  // char name[name_len], padded to DIR_RECORD_ALIGN
+};
+
+static_assert(sizeof(DirRecord) == 12, "DirRecord header must be 12 bytes");
+
+constexpr uint32_t DIR_RECORD_ALIGN = 4;
+
+// Bytes a record with a name of name_len bytes needs
+constexpr uint32_t dir_record_size(uint32_t name_len) {
+  return (sizeof(DirRecord) + name_len + DIR_RECORD_ALIGN - 1) &
+         ~(DIR_RECORD_ALIGN - 1);
+}
+
+// A live entry of a directory block in either format, viewed in place
+struct DirEntryView {
+  std::string_view name;
+  uint32_t inode_num;
+  uint32_t hash;
+  uint8_t file_type;
+};
+
+// Directory listing entry returned by readdir()
+struct DirEntryInfo {
+  std::string name;
+  uint32_t inode_num;
+  FileType type;
+};
+
+// ===== Hashed directory index =====
+// A directory starts as one block of DirEntry slots. When that block is
+// full it becomes the index root: its entries, sorted by name hash, point
+// at leaf blocks of DirEntry slots (levels 0) or at interior index nodes
+// that point at leaves (levels 1). Each leaf holds every name whose hash
+// falls between its index entry and the next one; the first entry's hash
+// is ignored. Index blocks start with DIR_INDEX_MAGIC where a slot block
+// has an inode number, so the two cannot be confused.
+constexpr uint32_t DIR_INDEX_MAGIC = 0x58444E49; // 'INDX'
+
+struct DirIndexHeader {
+  uint32_t magic;    // DIR_INDEX_MAGIC
+  uint16_t count;    // entries in use
+  uint16_t limit;    // capacity of this block
+  uint16_t levels;   // root only: interior node levels below the root
+  uint16_t reserved;
+  uint32_t blocks;   // root only: blocks in the directory file
+};
+
+struct DirIndexEntry {
+  uint32_t hash;  // lowest name hash stored under this entry
+  uint32_t block; // logical block in the directory file
+};
+
+constexpr uint32_t DIR_INDEX_ENTRIES =
+    (BLOCK_SIZE - sizeof(DirIndexHeader)) / sizeof(DirIndexEntry);
+constexpr uint32_t DIR_INDEX_MAX_LEVELS = 1;
+
+// ===== Journal =====
+// The .journal file is a header block followed by a circular region of
+// MountOptions.journal_blocks blocks. A transaction occupies consecutive
+// (wrapping) blocks: a descriptor listing its block numbers and checksums,
+// the blocks themselves, then a commit block. Recovery replays committed
+// transactions from the header's head onwards while their sequence
+// numbers follow on; a missing or torn commit ends the log. A transaction
+// that failed to write is overwritten by a skip descriptor, which recovery
+// steps over.
+constexpr uint32_t JOURNAL_MAGIC = 0x4C4E524A; // 'JRNL'
+constexpr uint32_t JOURNAL_DESCRIPTOR = 1;
+constexpr uint32_t JOURNAL_COMMIT = 2;
+constexpr uint32_t JOURNAL_SKIP = 3; // descriptor of a transaction that failed
+constexpr uint32_t JOURNAL_MAX_TX_BLOCKS = 256;
+
+struct JournalHeader {
+  uint32_t magic;    // JOURNAL_MAGIC
+  uint32_t capacity; // blocks in the circular region
+  uint64_t head;     // region block of the oldest live transaction
+  uint64_t head_seq; // its sequence number
+};
+
+struct JournalBlockTag {
+  uint32_t block_num;
+  uint32_t checksum;
+};
+
+struct JournalDescriptor {
+  uint32_t magic; // JOURNAL_MAGIC
+  uint32_t type;  // JOURNAL_DESCRIPTOR or JOURNAL_SKIP
+  uint64_t seq;
+  uint32_t count;
+  uint32_t reserved;
+  JournalBlockTag tags[JOURNAL_MAX_TX_BLOCKS];
+};
+
+struct JournalCommit {
+  uint32_t magic; // JOURNAL_MAGIC
+  uint32_t type;  // JOURNAL_COMMIT
+  uint64_t seq;
+  uint32_t count;
+  uint32_t checksum; // of the descriptor block
+};
+
+static_assert(sizeof(JournalDescriptor) <= BLOCK_SIZE,
+              "JournalDescriptor must fit in a block");
+
+struct BlockMapCache; // defined in vfs.h
+
 // File descriptor structure
 struct FileDescriptor {
   uint32_t inode_num;
@@ -102,7 +279,21 @@ struct FileDescriptor {
   int flags;
   bool is_open;
 
-  FileDescriptor() : inode_num(0), offset(0), flags(0), is_open(false) {}
+  // Sequential readahead state, in file block indices
+  uint32_t ra_last;   // last block of the previous read
+  uint32_t ra_end;    // first block not yet prefetched
+  uint32_t ra_window; // current window, 0 while access looks random
+
+  // Block map translations, shared by copies of this descriptor
+  std::shared_ptr<BlockMapCache> map_cache;
+
+  // Held across a read, write or seek that uses `offset`, so calls sharing
+  // the descriptor each start where the previous one ended
+  std::shared_ptr<std::mutex> offset_mutex;
+
+  FileDescriptor()
+      : inode_num(0), offset(0), flags(0), is_open(false), ra_last(0),
+        ra_end(0), ra_window(0) {}
 };
 
 // Cache statistics
@@ -112,12 +303,94 @@ struct CacheStats {
   uint64_t evictions;
   uint64_t total_requests;
 
+  // Readahead: blocks prefetched, later hit, and dropped before any use
+  uint64_t readahead_blocks;
+  uint64_t readahead_hits;
+  uint64_t readahead_waste;
+
   double hit_rate() const {
     return total_requests > 0 ? static_cast<double>(hits) / total_requests
                               : 0.0;
   }
 };
 
+// Block device backend used to access the image file
+enum class BlockBackend : uint8_t {
+  PREAD = 0,   // pread/pwrite on a raw file descriptor
+  MMAP = 1,    // shared memory mapping, msync at journal commit points
+  IO_URING = 2 // batched asynchronous I/O, falls back to PREAD
+};
+
+// Block cache replacement policy
+enum class CachePolicy : uint8_t {
+  LRU = 0,      // least recently used
+  CLOCK = 1,    // second-chance approximation of LRU
+  TWO_Q = 2,    // 2Q, scan resistant
+  ARC = 3,      // adaptive replacement cache, scan resistant
+  CLOCK_PRO = 4 // CLOCK-Pro, scan resistant
+};
+
+// When reads update an inode's access time
+enum class AtimeMode : uint8_t {
+  STRICT = 0,   // on every open and read
+  RELATIME = 1, // only if atime is not newer than mtime/ctime, or a day old
+  NOATIME = 2   // never
+};
+
+// What the journal carries
+enum class JournalMode : uint8_t {
+  FULL = 0,   // every block, file data included
+  ORDERED = 1 // metadata only; file data reaches the image before the
+              // transaction that references it commits
+};
+
+// Options chosen at mount time
+struct MountOptions {
+  size_t cache_capacity;    // Number of blocks to cache
+  size_t cache_shards;      // Cache lock shards, 0 = derived from capacity
+  CachePolicy cache_policy; // Block cache replacement policy
+  BlockBackend backend;     // How the image file is accessed
+
+  // Write-back caching: block writes only update the cache and a flusher
+  // thread writes dirty blocks back in block order. Ignored for MMAP.
+  bool write_back;
+  uint32_t dirty_expire_ms;       // Write back blocks dirty this long
+  uint32_t dirty_ratio;           // Start writeback at this % of the cache
+
+  // Size of the circular journal region in blocks. Committed space is
+  // checkpointed in the background every dirty_expire_ms, or sooner once
+  // half the region is in use.
+  uint32_t journal_blocks;
+  JournalMode journal_mode;
+
+  // Largest sequential readahead window in blocks (capped at a quarter of
+  // the cache), 0 disables readahead
+  uint32_t readahead_blocks;
+
+  // Decoded inodes kept in memory (open files and dirty inodes may exceed
+  // it). With write-back caching inode updates are held here and written
+  // to the inode table by the flusher, sync() or unmount.
+  size_t inode_cache_capacity;
+
+  // Directory entries cached for path resolution, including names that
+  // were looked up and not found
+  size_t dentry_cache_capacity;
+
+  // Access time updates. With lazytime a new atime only marks the cached
+  // inode dirty; it reaches the inode table with the next write of that
+  // inode, the flusher, sync() or unmount.
+  AtimeMode atime_mode;
+  bool lazytime;
+
+  MountOptions()
+      : cache_capacity(256), cache_shards(0), cache_policy(CachePolicy::CLOCK),
+        backend(BlockBackend::PREAD), write_back(false),
+        dirty_expire_ms(3000), dirty_ratio(20), journal_blocks(4096),
+        journal_mode(JournalMode::ORDERED), readahead_blocks(64),
+        inode_cache_capacity(1024), dentry_cache_capacity(4096),
+        atime_mode(AtimeMode::RELATIME), lazytime(false) {}
+};
+
 // File system statistics
 struct FileSystemStats {
   uint32_t total_blocks;
@@ -126,11 +399,23 @@ struct FileSystemStats {
   uint32_t free_inodes;
   uint64_t total_size;
   uint64_t used_size;
+  uint32_t free_extents;        // runs of free blocks
+  uint32_t largest_free_extent; // in blocks
 
   double usage_percent() const {
     return total_size > 0 ? static_cast<double>(used_size) / total_size * 100.0
                           : 0.0;
   }
+
+  // Share of free space outside the largest free run: 0% when all free
+  // blocks are contiguous
+  double fragmentation_percent() const {
+    return free_blocks > 0
+               ? (1.0 - static_cast<double>(largest_free_extent) /
+                            free_blocks) *
+                     100.0
+               : 0.0;
+  }
 };
 
 } // namespace vfs
@@ -0,0 +1,186 @@
+#include "filesystem/block_device.h"
+#include "filesystem/vfs.h"
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace vfs;
+
+// Compares the block backends on a 128 MB image:
+//   1. random 4 KiB block reads straight from the device, against the
+//      seekg+read std::fstream path the VFS used before IBlockDevice;
+//   2. batches of 64 random blocks through ReadBlocks, where io_uring
+//      submits the whole batch with a single syscall;
+//   3. sequential whole-file downloads of a ~4 MB paper through the VFS
+//      with a small cache, once per backend;
+//   4. small status updates (open + 200-byte write + close) with a
+//      write-through and a write-back cache.
+
+namespace {
+
+constexpr const char *kImagePath = "/tmp/bench_block_backends.img";
+constexpr uint32_t kImageMb = 128;
+constexpr size_t kPaperSize = 4 * 1024 * 1024;
+constexpr int kRandomReads = 200000;
+constexpr int kDownloads = 20;
+constexpr int kSmallUpdates = 5000;
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::vector<uint32_t> random_blocks(uint32_t num_blocks) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<uint32_t> dist(0, num_blocks - 1);
+  std::vector<uint32_t> blocks(kRandomReads);
+  for (auto &b : blocks) {
+    b = dist(rng);
+  }
+  return blocks;
+}
+
+void report(const std::string &name, double secs, double ops, double bytes) {
+  std::cout << std::left << std::setw(28) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(0)
+            << ops / secs << " ops/s" << std::setw(10)
+            << std::setprecision(1) << bytes / secs / (1024 * 1024)
+            << " MB/s\n";
+}
+
+void bench_random_fstream(const std::vector<uint32_t> &blocks) {
+  std::fstream image(kImagePath, std::ios::in | std::ios::binary);
+  std::vector<char> buf(BLOCK_SIZE);
+  auto start = Clock::now();
+  for (uint32_t b : blocks) {
+    image.clear();
+    image.seekg(static_cast<uint64_t>(b) * BLOCK_SIZE);
+    image.read(buf.data(), BLOCK_SIZE);
+  }
+  report("random 4K / fstream", seconds_since(start), blocks.size(),
+         static_cast<double>(blocks.size()) * BLOCK_SIZE);
+}
+
+void bench_random_device(const std::string &name, BlockBackend backend,
+                         const std::vector<uint32_t> &blocks) {
+  auto device = open_block_device(kImagePath, backend);
+  std::vector<char> buf(BLOCK_SIZE);
+  auto start = Clock::now();
+  for (uint32_t b : blocks) {
+    device->ReadBlock(b, buf.data());
+  }
+  report(name, seconds_since(start), blocks.size(),
+         static_cast<double>(blocks.size()) * BLOCK_SIZE);
+}
+
+void bench_random_batched(const std::string &name, BlockBackend backend,
+                          const std::vector<uint32_t> &blocks) {
+  constexpr size_t kBatch = 64;
+  auto device = open_block_device(kImagePath, backend);
+  std::vector<char> buf(kBatch * BLOCK_SIZE);
+  std::vector<void *> outs(kBatch);
+  for (size_t i = 0; i < kBatch; ++i) {
+    outs[i] = buf.data() + i * BLOCK_SIZE;
+  }
+  auto start = Clock::now();
+  for (size_t i = 0; i + kBatch <= blocks.size(); i += kBatch) {
+    device->ReadBlocks(blocks.data() + i, outs.data(), kBatch);
+  }
+  report(name, seconds_since(start), blocks.size(),
+         static_cast<double>(blocks.size()) * BLOCK_SIZE);
+}
+
+void bench_download(const std::string &name, BlockBackend backend) {
+  VirtualFileSystem vfs;
+  MountOptions options;
+  options.cache_capacity = 64;
+  options.backend = backend;
+  if (!vfs.mount(kImagePath, options)) {
+    std::cerr << "mount failed for " << name << "\n";
+    return;
+  }
+
+  std::vector<char> buf(64 * 1024);
+  size_t total = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < kDownloads; ++i) {
+    int fd = vfs.open("/papers/P1/v1.pdf", O_RDONLY);
+    ssize_t n;
+    while ((n = vfs.read(fd, buf.data(), buf.size())) > 0) {
+      total += static_cast<size_t>(n);
+    }
+    vfs.close(fd);
+  }
+  report(name, seconds_since(start), kDownloads, static_cast<double>(total));
+  vfs.unmount();
+}
+
+void bench_small_updates(const std::string &name, bool write_back) {
+  VirtualFileSystem vfs;
+  MountOptions options;
+  options.cache_capacity = 512;
+  options.write_back = write_back;
+  if (!vfs.mount(kImagePath, options)) {
+    std::cerr << "mount failed for " << name << "\n";
+    return;
+  }
+
+  std::vector<char> status(200, 's');
+  auto start = Clock::now();
+  for (int i = 0; i < kSmallUpdates; ++i) {
+    int fd = vfs.open("/papers/P1/status.json", O_WRONLY);
+    vfs.write(fd, status.data(), status.size());
+    vfs.close(fd);
+  }
+  vfs.sync();
+  report(name, seconds_since(start), kSmallUpdates,
+         static_cast<double>(kSmallUpdates) * status.size());
+  vfs.unmount();
+}
+
+} // namespace
+
+int main() {
+  {
+    VirtualFileSystem vfs;
+    if (!vfs.format(kImagePath, kImageMb, 256)) {
+      std::cerr << "format failed\n";
+      return 1;
+    }
+    vfs.mkdir("/papers");
+    vfs.mkdir("/papers/P1");
+    vfs.create_file("/papers/P1/v1.pdf");
+    int fd = vfs.open("/papers/P1/v1.pdf", O_WRONLY);
+    std::vector<char> paper(kPaperSize);
+    for (size_t i = 0; i < paper.size(); ++i) {
+      paper[i] = static_cast<char>(i * 31);
+    }
+    vfs.write(fd, paper.data(), paper.size());
+    vfs.close(fd);
+    vfs.create_file("/papers/P1/status.json");
+    vfs.unmount();
+  }
+
+  uint32_t num_blocks = kImageMb * 1024 * 1024 / BLOCK_SIZE;
+  auto blocks = random_blocks(num_blocks);
+
+  std::cout << "=== Block backend benchmark ===\n";
+  bench_random_fstream(blocks);
+  bench_random_device("random 4K / pread", BlockBackend::PREAD, blocks);
+  bench_random_device("random 4K / mmap", BlockBackend::MMAP, blocks);
+  bench_random_device("random 4K / io_uring", BlockBackend::IO_URING, blocks);
+  bench_random_batched("batch64 4K / pread", BlockBackend::PREAD, blocks);
+  bench_random_batched("batch64 4K / io_uring", BlockBackend::IO_URING,
+                       blocks);
+  bench_download("download 4MB / pread", BlockBackend::PREAD);
+  bench_download("download 4MB / mmap", BlockBackend::MMAP);
+  bench_download("download 4MB / io_uring", BlockBackend::IO_URING);
+  bench_small_updates("status update / wthrough", false);
+  bench_small_updates("status update / wback", true);
+  return 0;
+}
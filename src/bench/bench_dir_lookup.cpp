@@ -0,0 +1,92 @@
+#include "filesystem/vfs.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace vfs;
+
+// Name lookup in one large directory: /papers is grown to 100k entries and
+// at each size random existing and missing names are resolved. With the
+// hashed index both cost a few block lookups, growing only with the depth
+// of the index rather than with the number of entries.
+
+namespace {
+
+constexpr const char *kImagePath = "/tmp/bench_dir_lookup.img";
+constexpr int kMaxEntries = 100000;
+constexpr int kLookups = 20000;
+
+std::string entry_path(int i) { return "/papers/P" + std::to_string(i); }
+
+struct Result {
+  double ns;       // per lookup
+  double requests; // block cache lookups per lookup
+};
+
+Result run(VirtualFileSystem &vfs, int entries, bool missing) {
+  std::mt19937 rng(entries);
+  uint64_t before = vfs.get_cache_stats().total_requests;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kLookups; ++i) {
+    int n = static_cast<int>(rng() % entries) + (missing ? kMaxEntries : 0);
+    if (vfs.exists(entry_path(n)) == missing) {
+      std::cout << "unexpected lookup result for " << entry_path(n) << "\n";
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  uint64_t requests = vfs.get_cache_stats().total_requests - before;
+  return {elapsed.count() / kLookups,
+          static_cast<double>(requests) / kLookups};
+}
+
+} // namespace
+
+int main() {
+  FormatOptions format;
+  format.total_inodes = kMaxEntries + 1024;
+  MountOptions options;
+  options.cache_capacity = 16384; // holds every directory block
+  options.write_back = true;
+  // Keep the dentry cache from answering lookups, so every row measures the
+  // directory index (each lookup also resolves /papers in the root)
+  options.dentry_cache_capacity = 1;
+
+  VirtualFileSystem vfs;
+  if (!vfs.format(kImagePath, 512, format, 256)) {
+    return 1;
+  }
+  vfs.unmount();
+  if (!vfs.mount(kImagePath, options) || vfs.mkdir("/papers") != 0) {
+    return 1;
+  }
+
+  std::cout << "Lookup in one directory (" << kLookups
+            << " random names per size)\n";
+  std::cout << std::left << std::setw(10) << "entries" << std::right
+            << std::setw(12) << "hit ns" << std::setw(12) << "miss ns"
+            << std::setw(14) << "blocks/hit" << std::setw(14)
+            << "blocks/miss\n";
+
+  int created = 0;
+  for (int size = 100; size <= kMaxEntries; size *= 10) {
+    for (; created < size; ++created) {
+      if (vfs.create_file(entry_path(created)) != 0) {
+        std::cerr << "create failed at " << created << "\n";
+        return 1;
+      }
+    }
+    Result hit = run(vfs, size, false);
+    Result miss = run(vfs, size, true);
+    std::cout << std::left << std::setw(10) << size << std::right
+              << std::fixed << std::setprecision(0) << std::setw(12)
+              << hit.ns << std::setw(12) << miss.ns << std::setprecision(2)
+              << std::setw(14) << hit.requests << std::setw(14)
+              << miss.requests << "\n";
+  }
+
+  vfs.unmount();
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "filesystem/vfs.h"
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace vfs;
+
+// Upload benchmark: writes papers the way the server stores an upload
+// (create, sequential 64 KiB writes, close) and syncs, once per journal
+// mode and write policy. Full journaling writes every data block twice,
+// ordered mode only journals metadata.
+
+namespace {
+
+constexpr const char *kImagePath = "/tmp/bench_journal_modes.img";
+constexpr size_t kChunk = 64 * 1024;
+
+struct Result {
+  double mb_per_s;
+  double journaled_mb;
+  uint64_t commits;
+  uint64_t syncs;
+};
+
+bool run(JournalMode mode, bool write_back, int papers, size_t paper_size,
+         Result &result) {
+  VirtualFileSystem vfs;
+  size_t image_mb = papers * paper_size / (1024 * 1024) * 2 + 32;
+  if (!vfs.format(kImagePath, image_mb, 1024)) {
+    return false;
+  }
+  vfs.unmount();
+
+  MountOptions options;
+  options.journal_mode = mode;
+  options.write_back = write_back;
+  options.cache_capacity = 1024;
+  if (!vfs.mount(kImagePath, options)) {
+    return false;
+  }
+
+  std::vector<char> chunk(kChunk);
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    chunk[i] = static_cast<char>(i * 13 + 1);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int p = 0; p < papers; ++p) {
+    std::string path = "/paper" + std::to_string(p) + ".pdf";
+    if (vfs.create_file(path) != 0) {
+      return false;
+    }
+    int fd = vfs.open(path, O_WRONLY);
+    if (fd < 0) {
+      return false;
+    }
+    for (size_t done = 0; done < paper_size; done += kChunk) {
+      size_t size = std::min(kChunk, paper_size - done);
+      if (vfs.write(fd, chunk.data(), size) != static_cast<ssize_t>(size)) {
+        return false;
+      }
+    }
+    vfs.close(fd);
+  }
+  if (vfs.sync() != 0) {
+    return false;
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  auto stats = vfs.get_journal_stats();
+  result.mb_per_s = papers * paper_size / (1024.0 * 1024.0) / elapsed;
+  result.journaled_mb = stats.journaled * BLOCK_SIZE / (1024.0 * 1024.0);
+  result.commits = stats.commits;
+  result.syncs = stats.syncs;
+  vfs.unmount();
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int papers = argc > 1 ? std::stoi(argv[1]) : 16;
+  size_t paper_size = (argc > 2 ? std::stoul(argv[2]) : 4) * 1024 * 1024;
+
+  std::cout << "=== Journal mode upload benchmark (" << papers << " x "
+            << paper_size / (1024 * 1024) << " MiB papers) ===\n";
+  std::cout << std::left << std::setw(10) << "mode" << std::setw(15)
+            << "policy" << std::setw(12) << "MB/s" << std::setw(16)
+            << "journaled MB" << std::setw(10) << "commits" << "syncs\n";
+
+  for (bool write_back : {false, true}) {
+    for (JournalMode mode : {JournalMode::FULL, JournalMode::ORDERED}) {
+      Result result{};
+      if (!run(mode, write_back, papers, paper_size, result)) {
+        std::cerr << "run failed\n";
+        return 1;
+      }
+      std::cout << std::left << std::setw(10)
+                << (mode == JournalMode::FULL ? "full" : "ordered")
+                << std::setw(15)
+                << (write_back ? "write-back" : "write-through") << std::fixed
+                << std::setprecision(1) << std::setw(12) << result.mb_per_s
+                << std::setw(16) << result.journaled_mb << std::setw(10)
+                << result.commits << result.syncs << "\n";
+    }
+  }
+  return 0;
+}
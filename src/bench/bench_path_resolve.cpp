@@ -0,0 +1,105 @@
+#include "filesystem/vfs.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace vfs;
+
+// Resolution of a 5-level path with every directory already in the dentry
+// cache, so what is left is parsing, locking and cache lookups. Heap
+// allocations are counted by replacing global operator new.
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+constexpr const char *kImagePath = "/tmp/bench_path_resolve.img";
+constexpr int kIterations = 200000;
+const std::string kPath = "/papers/P7/rounds/R2/reviews";
+const std::string kMissing = kPath + "/review.txt";
+
+// The stringstream splitter path resolution used before
+std::vector<std::string> split_path_stream(const std::string &path) {
+  std::vector<std::string> components;
+  std::stringstream ss(path);
+  std::string component;
+  while (std::getline(ss, component, '/')) {
+    if (!component.empty() && component != ".") {
+      if (component == "..") {
+        if (!components.empty()) {
+          components.pop_back();
+        }
+      } else {
+        components.push_back(component);
+      }
+    }
+  }
+  return components;
+}
+
+template <typename Fn> void report(const char *label, Fn fn) {
+  uint64_t allocations = g_allocations.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    fn();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << std::left << std::setw(28) << label << std::right
+            << std::fixed << std::setprecision(0) << std::setw(10)
+            << elapsed.count() / kIterations << std::setprecision(2)
+            << std::setw(12)
+            << static_cast<double>(g_allocations.load() - allocations) /
+                   kIterations
+            << "\n";
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+  g_allocations++;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+int main() {
+  VirtualFileSystem vfs;
+  if (!vfs.format(kImagePath, 16, 256)) {
+    return 1;
+  }
+  for (const char *dir : {"/papers", "/papers/P7", "/papers/P7/rounds",
+                          "/papers/P7/rounds/R2",
+                          "/papers/P7/rounds/R2/reviews"}) {
+    if (vfs.mkdir(dir) != 0) {
+      return 1;
+    }
+  }
+  if (!vfs.exists(kPath) || vfs.exists(kMissing)) {
+    return 1;
+  }
+
+  size_t sink = 0;
+  std::cout << "Resolving " << kPath << " (" << kIterations
+            << " iterations)\n";
+  std::cout << std::left << std::setw(28) << "" << std::right
+            << std::setw(10) << "ns/op" << std::setw(12) << "allocs/op\n";
+  report("split (stringstream)",
+         [&] { sink += split_path_stream(kPath).size(); });
+  report("split (PathComponents)",
+         [&] { sink += PathComponents(kPath).size(); });
+  report("exists(hit)", [&] { sink += vfs.exists(kPath); });
+  report("exists(miss)", [&] { sink += vfs.exists(kMissing); });
+
+  vfs.unmount();
+  return sink == 0;
+}
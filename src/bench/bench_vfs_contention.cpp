@@ -0,0 +1,120 @@
+#include "filesystem/vfs.h"
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace vfs;
+
+// Contention benchmark: every thread works on its own paper under
+// /papers/Pn (exists + open + full read + close, with a periodic rewrite),
+// so throughput should grow with the thread count once unrelated inodes no
+// longer serialize on a single file system lock.
+
+namespace {
+
+constexpr const char *kImagePath = "/tmp/bench_vfs_contention.img";
+constexpr int kMaxThreads = 8;
+constexpr size_t kPaperSize = 64 * 1024;
+
+std::string paper_path(int i) {
+  return "/papers/P" + std::to_string(i) + "/paper.pdf";
+}
+
+bool setup(VirtualFileSystem &vfs) {
+  if (!vfs.format(kImagePath, 64, 512)) {
+    return false;
+  }
+  vfs.mkdir("/papers");
+  std::vector<char> content(kPaperSize, 'x');
+  for (int i = 0; i < kMaxThreads; ++i) {
+    vfs.mkdir("/papers/P" + std::to_string(i));
+    vfs.create_file(paper_path(i));
+    int fd = vfs.open(paper_path(i), O_WRONLY);
+    if (fd < 0) {
+      return false;
+    }
+    vfs.write(fd, content.data(), content.size());
+    vfs.close(fd);
+  }
+  return true;
+}
+
+double run(VirtualFileSystem &vfs, int threads, double seconds) {
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> total_ops{0};
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      const std::string path = paper_path(t);
+      std::vector<char> buffer(kPaperSize);
+      uint64_t ops = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!vfs.exists(path)) {
+          break;
+        }
+        bool rewrite = (ops % 16) == 15;
+        int fd = vfs.open(path, rewrite ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+          break;
+        }
+        if (rewrite) {
+          vfs.write(fd, buffer.data(), 4096);
+        } else {
+          vfs.read(fd, buffer.data(), buffer.size());
+        }
+        vfs.close(fd);
+        ops++;
+      }
+      total_ops += ops;
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &w : workers) {
+    w.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return total_ops.load() / elapsed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+
+  VirtualFileSystem vfs;
+  if (!setup(vfs)) {
+    std::cerr << "setup failed\n";
+    return 1;
+  }
+
+  std::cout << "=== VFS contention benchmark (" << seconds
+            << "s per run, hardware threads: "
+            << std::thread::hardware_concurrency() << ") ===\n";
+  std::cout << std::left << std::setw(10) << "threads" << std::setw(16)
+            << "ops/s" << "speedup\n";
+
+  double baseline = 0.0;
+  for (int threads = 1; threads <= kMaxThreads; threads *= 2) {
+    double ops = run(vfs, threads, seconds);
+    if (threads == 1) {
+      baseline = ops;
+    }
+    std::cout << std::left << std::setw(10) << threads << std::setw(16)
+              << std::fixed << std::setprecision(0) << ops
+              << std::setprecision(2) << (baseline > 0 ? ops / baseline : 0)
+              << "x\n";
+  }
+
+  vfs.unmount();
+  return 0;
+}
@@ -1,14 +1,14 @@
 #include "filesystem/bitmap.h"
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
 
 namespace vfs {
 
 Bitmap::Bitmap(uint32_t total_blocks)
-    : total_blocks_(total_blocks), free_blocks_(total_blocks) {
-  // Calculate bitmap size in bytes (round up)
-  size_t bitmap_size = (total_blocks + 7) / 8;
-  bitmap_.resize(bitmap_size, 0);
+    : total_blocks_(total_blocks), free_blocks_(total_blocks), next_(0) {
+  words_.resize((total_blocks + WORD_BITS - 1) / WORD_BITS, 0);
+  rebuild_summary();
 }
 
 int32_t Bitmap::allocate() {
@@ -18,16 +18,77 @@ int32_t Bitmap::allocate() {
     return -1; // No free blocks
   }
 
-  // Find first free block
-  for (uint32_t i = 0; i < total_blocks_; ++i) {
-    if (!get_bit(i)) {
-      set_bit(i);
-      free_blocks_--;
-      return static_cast<int32_t>(i);
+  int32_t pos = find_free(next_);
+  if (pos >= 0) {
+    set_bit(pos);
+    next_ = static_cast<uint32_t>(pos) + 1 < total_blocks_ ? pos + 1 : 0;
+  }
+  return pos;
+}
+
+int32_t Bitmap::allocate(uint32_t goal) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (free_blocks_ == 0) {
+    return -1; // No free blocks
+  }
+
+  int32_t pos = find_free(goal < total_blocks_ ? goal : 0);
+  if (pos >= 0) {
+    set_bit(pos);
+  }
+  return pos;
+}
+
+int32_t Bitmap::allocate_range(uint32_t count, uint32_t goal,
+                               uint32_t &length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  length = 0;
+  if (free_blocks_ == 0 || count == 0) {
+    return -1; // No free blocks
+  }
+  bool next_fit = goal >= total_blocks_;
+  if (next_fit) {
+    goal = next_;
+  }
+
+  // Walk the free runs from the goal to the end, then from the start
+  uint32_t best = 0;
+  uint32_t best_length = 0;
+  bool fits = false;
+  bool done = false;
+  for (int pass = 0; pass < 2 && !done; ++pass) {
+    uint32_t pos = pass == 0 ? goal : 0;
+    uint32_t end = pass == 0 ? total_blocks_ : goal;
+    while (!done && (pos = next_free(pos, end)) < end) {
+      uint32_t run_end = next_used(pos, end);
+      uint32_t run = run_end - pos;
+      if (run >= count) {
+        if (!fits || run < best_length) {
+          best = pos;
+          best_length = run;
+          fits = true;
+        }
+        // Exact fits cannot be beaten; a run at the goal continues the
+        // caller's previous blocks
+        done = run == count || (pass == 0 && pos == goal);
+      } else if (!fits && run > best_length) {
+        best = pos;
+        best_length = run;
+      }
+      pos = run_end;
     }
   }
 
-  return -1;
+  length = std::min(count, best_length);
+  for (uint32_t i = best; i < best + length; ++i) {
+    set_bit(i);
+  }
+  if (next_fit) {
+    next_ = best + length < total_blocks_ ? best + length : 0;
+  }
+  return static_cast<int32_t>(best);
 }
 
 bool Bitmap::free(uint32_t block_num) {
@@ -42,7 +103,6 @@ bool Bitmap::free(uint32_t block_num) {
   }
 
   clear_bit(block_num);
-  free_blocks_++;
   return true;
 }
 
@@ -61,47 +121,148 @@ uint32_t Bitmap::get_free_count() const {
   return free_blocks_;
 }
 
+void Bitmap::get_free_extents(uint32_t &runs, uint32_t &longest) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  runs = 0;
+  longest = 0;
+  uint32_t pos = 0;
+  while ((pos = next_free(pos, total_blocks_)) < total_blocks_) {
+    uint32_t run_end = next_used(pos, total_blocks_);
+    runs++;
+    longest = std::max(longest, run_end - pos);
+    pos = run_end;
+  }
+}
+
 std::vector<uint8_t> Bitmap::serialize() const {
   std::lock_guard<std::mutex> lock(mutex_);
-  return bitmap_;
+
+  // Bit i lives in byte i / 8, bit i % 8; the tail of the last byte is 0
+  std::vector<uint8_t> data(size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(words_[i / 8] >> (i % 8 * 8));
+  }
+  if (total_blocks_ % 8 != 0) {
+    data.back() &= static_cast<uint8_t>((1u << (total_blocks_ % 8)) - 1);
+  }
+  return data;
 }
 
 bool Bitmap::deserialize(const std::vector<uint8_t> &data) {
   std::lock_guard<std::mutex> lock(mutex_);
 
-  if (data.size() != bitmap_.size()) {
+  if (data.size() != size()) {
     return false;
   }
 
-  bitmap_ = data;
+  std::fill(words_.begin(), words_.end(), 0);
+  for (size_t i = 0; i < data.size(); ++i) {
+    words_[i / 8] |= static_cast<uint64_t>(data[i]) << (i % 8 * 8);
+  }
+  next_ = 0;
 
   // Recalculate free blocks
-  free_blocks_ = 0;
-  for (uint32_t i = 0; i < total_blocks_; ++i) {
-    if (!get_bit(i)) {
-      free_blocks_++;
+  rebuild_summary();
+  return true;
+}
+
+int32_t Bitmap::find_free(uint32_t start) const {
+  // Visit chunks from the one holding start, skipping full ones by their
+  // summary count. The starting chunk is visited again at the end for the
+  // bits before start.
+  uint32_t chunks = static_cast<uint32_t>(chunk_free_.size());
+  uint32_t first_chunk = start / CHUNK_BITS;
+  for (uint32_t n = 0; n <= chunks; ++n) {
+    uint32_t chunk = (first_chunk + n) % chunks;
+    if (chunk_free_[chunk] == 0) {
+      continue;
+    }
+    size_t word = static_cast<size_t>(chunk) * CHUNK_WORDS;
+    size_t end = std::min(word + CHUNK_WORDS, words_.size());
+    uint64_t mask = ~0ULL;
+    if (n == 0) {
+      word = start / WORD_BITS;
+      mask <<= start % WORD_BITS;
+    }
+    for (; word < end; ++word, mask = ~0ULL) {
+      uint64_t free_bits = ~words_[word] & mask;
+      if (free_bits != 0) {
+        return static_cast<int32_t>(word * WORD_BITS +
+                                    __builtin_ctzll(free_bits));
+      }
     }
   }
+  return -1;
+}
 
-  return true;
+uint32_t Bitmap::next_free(uint32_t pos, uint32_t end) const {
+  while (pos < end) {
+    uint32_t chunk = pos / CHUNK_BITS;
+    if (chunk_free_[chunk] == 0) {
+      pos = (chunk + 1) * CHUNK_BITS; // full chunk
+      continue;
+    }
+    uint32_t word = pos / WORD_BITS;
+    uint64_t free_bits = ~words_[word] & (~0ULL << (pos % WORD_BITS));
+    if (free_bits != 0) {
+      return std::min(end, word * WORD_BITS +
+                               static_cast<uint32_t>(
+                                   __builtin_ctzll(free_bits)));
+    }
+    pos = (word + 1) * WORD_BITS;
+  }
+  return end;
+}
+
+uint32_t Bitmap::next_used(uint32_t pos, uint32_t end) const {
+  while (pos < end) {
+    uint32_t chunk = pos / CHUNK_BITS;
+    if (pos % CHUNK_BITS == 0 && chunk_free_[chunk] == CHUNK_BITS) {
+      pos += CHUNK_BITS; // empty chunk
+      continue;
+    }
+    uint32_t word = pos / WORD_BITS;
+    uint64_t used_bits = words_[word] & (~0ULL << (pos % WORD_BITS));
+    if (used_bits != 0) {
+      return std::min(end, word * WORD_BITS +
+                               static_cast<uint32_t>(
+                                   __builtin_ctzll(used_bits)));
+    }
+    pos = (word + 1) * WORD_BITS;
+  }
+  return end;
 }
 
 void Bitmap::set_bit(uint32_t pos) {
-  size_t byte_index = pos / 8;
-  size_t bit_index = pos % 8;
-  bitmap_[byte_index] |= (1 << bit_index);
+  words_[pos / WORD_BITS] |= 1ULL << (pos % WORD_BITS);
+  chunk_free_[pos / CHUNK_BITS]--;
+  free_blocks_--;
 }
 
 void Bitmap::clear_bit(uint32_t pos) {
-  size_t byte_index = pos / 8;
-  size_t bit_index = pos % 8;
-  bitmap_[byte_index] &= ~(1 << bit_index);
+  words_[pos / WORD_BITS] &= ~(1ULL << (pos % WORD_BITS));
+  chunk_free_[pos / CHUNK_BITS]++;
+  free_blocks_++;
 }
 
 bool Bitmap::get_bit(uint32_t pos) const {
-  size_t byte_index = pos / 8;
-  size_t bit_index = pos % 8;
-  return (bitmap_[byte_index] & (1 << bit_index)) != 0;
+  return (words_[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
+}
+
+void Bitmap::rebuild_summary() {
+  // Bits past the last block read as allocated, so scans never return them
+  if (total_blocks_ % WORD_BITS != 0) {
+    words_.back() |= ~0ULL << (total_blocks_ % WORD_BITS);
+  }
+
+  chunk_free_.assign((words_.size() + CHUNK_WORDS - 1) / CHUNK_WORDS, 0);
+  free_blocks_ = 0;
+  for (size_t word = 0; word < words_.size(); ++word) {
+    uint32_t free_bits = WORD_BITS - __builtin_popcountll(words_[word]);
+    chunk_free_[word / CHUNK_WORDS] += free_bits;
+    free_blocks_ += free_bits;
+  }
 }
 
 } // namespace vfs
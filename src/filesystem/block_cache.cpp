@@ -0,0 +1,443 @@
+#include "filesystem/block_cache.h"
+#include "filesystem/cache_policy.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace vfs {
+
+namespace {
+
+// Aim for at least this many blocks per shard so the policy still has
+// something to choose from
+constexpr size_t MIN_BLOCKS_PER_SHARD = 16;
+constexpr size_t MAX_SHARDS = 64;
+
+size_t floor_pow2(size_t n) {
+  size_t p = 1;
+  while (p * 2 <= n) {
+    p *= 2;
+  }
+  return p;
+}
+
+template <typename Policy> class ShardedBlockCache : public BlockCache {
+public:
+  ShardedBlockCache(CachePolicy policy, size_t capacity, size_t num_shards);
+  ~ShardedBlockCache() override { clear(); }
+
+  BlockHandle get(uint32_t block_num) override;
+  bool get(uint32_t block_num, std::vector<char> &data) override;
+  bool get(uint32_t block_num, char *out) override;
+  void put(uint32_t block_num, const std::vector<char> &data) override;
+  void put(uint32_t block_num, const char *data) override;
+  void put(uint32_t block_num, const BlockHandle &handle) override;
+  bool prefetch(uint32_t block_num, const BlockHandle &handle) override;
+  bool contains(uint32_t block_num) const override;
+  void invalidate(uint32_t block_num) override;
+  void clear() override;
+  CacheStats get_stats() const override;
+  void set_capacity(size_t new_capacity) override;
+
+  size_t get_capacity() const override { return capacity_; }
+  size_t get_size() const override;
+  size_t get_shard_count() const override { return num_shards_; }
+  CachePolicy get_policy() const override { return policy_; }
+
+private:
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::vector<CacheSlot> slots;
+    std::vector<uint32_t> free_slots;
+    BlockIndex index; // block -> slot
+    Policy policy;
+    size_t capacity = 0;
+
+    // Statistics
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t readahead_blocks = 0;
+    uint64_t readahead_hits = 0;
+    uint64_t readahead_waste = 0;
+  };
+
+  Shard &shard_for(uint32_t block_num) {
+    return shards_[block_num & (num_shards_ - 1)];
+  }
+  const Shard &shard_for(uint32_t block_num) const {
+    return shards_[block_num & (num_shards_ - 1)];
+  }
+
+  // Helpers below expect the shard lock to be held
+  void reset(Shard &shard, size_t capacity);
+  CacheSlot *lookup(Shard &shard, uint32_t block_num);
+  CacheSlot *slot_for_put(Shard &shard, uint32_t block_num);
+  void drop(Shard &shard, CacheSlot &slot);
+  void copy_into(Shard &shard, uint32_t block_num, const char *data,
+                 size_t size);
+
+  CachePolicy policy_;
+  size_t capacity_;
+  size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+template <typename Policy>
+ShardedBlockCache<Policy>::ShardedBlockCache(CachePolicy policy,
+                                             size_t capacity,
+                                             size_t num_shards)
+    : policy_(policy), capacity_(capacity) {
+  if (num_shards == 0) {
+    num_shards = std::min(MAX_SHARDS, capacity / MIN_BLOCKS_PER_SHARD);
+  }
+  num_shards_ = floor_pow2(std::max<size_t>(1, num_shards));
+  shards_ = std::make_unique<Shard[]>(num_shards_);
+  set_capacity(capacity);
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::reset(Shard &shard, size_t capacity) {
+  // All per-shard storage is sized here, so filling and evicting never
+  // allocates afterwards
+  shard.capacity = capacity;
+  shard.slots.assign(capacity, CacheSlot());
+  shard.free_slots.resize(capacity);
+  for (size_t i = 0; i < capacity; ++i) {
+    shard.free_slots[i] = static_cast<uint32_t>(capacity - 1 - i);
+  }
+  shard.index.reset(capacity);
+  shard.policy.reset(capacity);
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::drop(Shard &shard, CacheSlot &slot) {
+  if (slot.readahead) {
+    shard.readahead_waste++;
+    slot.readahead = false;
+  }
+  // Outstanding handles keep the buffer alive until they are released
+  slot.buffer->release();
+  slot.buffer = nullptr;
+}
+
+template <typename Policy>
+CacheSlot *ShardedBlockCache<Policy>::lookup(Shard &shard,
+                                             uint32_t block_num) {
+  uint32_t i;
+  if (!shard.index.find(block_num, i)) {
+    shard.misses++;
+    return nullptr;
+  }
+  shard.policy.on_hit(i);
+  shard.hits++;
+  CacheSlot &slot = shard.slots[i];
+  if (slot.readahead) {
+    shard.readahead_hits++;
+    slot.readahead = false;
+  }
+  return &slot;
+}
+
+template <typename Policy>
+BlockHandle ShardedBlockCache<Policy>::get(uint32_t block_num) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  CacheSlot *slot = lookup(shard, block_num);
+  if (slot == nullptr) {
+    return BlockHandle();
+  }
+  slot->buffer->retain();
+  return BlockHandle::adopt(slot->buffer);
+}
+
+template <typename Policy>
+bool ShardedBlockCache<Policy>::get(uint32_t block_num,
+                                    std::vector<char> &data) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const CacheSlot *slot = lookup(shard, block_num);
+  if (slot == nullptr) {
+    return false;
+  }
+  data.assign(slot->buffer->data, slot->buffer->data + BLOCK_SIZE);
+  return true;
+}
+
+template <typename Policy>
+bool ShardedBlockCache<Policy>::get(uint32_t block_num, char *out) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const CacheSlot *slot = lookup(shard, block_num);
+  if (slot == nullptr) {
+    return false;
+  }
+  std::memcpy(out, slot->buffer->data, BLOCK_SIZE);
+  return true;
+}
+
+template <typename Policy>
+CacheSlot *ShardedBlockCache<Policy>::slot_for_put(Shard &shard,
+                                                   uint32_t block_num) {
+  uint32_t i;
+  if (shard.index.find(block_num, i)) {
+    shard.policy.on_hit(i);
+    CacheSlot &slot = shard.slots[i];
+    if (slot.readahead) {
+      shard.readahead_waste++; // overwritten before anyone read it
+      slot.readahead = false;
+    }
+    return &slot;
+  }
+
+  if (!shard.free_slots.empty()) {
+    i = shard.free_slots.back();
+    shard.free_slots.pop_back();
+  } else if (shard.policy.victim(block_num, shard.slots.data(), i)) {
+    shard.index.erase(shard.slots[i].block_num);
+    drop(shard, shard.slots[i]);
+    shard.evictions++;
+  } else {
+    return nullptr; // Everything pinned; leave the block uncached
+  }
+
+  CacheSlot &slot = shard.slots[i];
+  slot.block_num = block_num;
+  shard.index.insert(block_num, i);
+  shard.policy.on_insert(i, block_num);
+  return &slot;
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::copy_into(Shard &shard, uint32_t block_num,
+                                          const char *data, size_t size) {
+  if (shard.capacity == 0) {
+    return;
+  }
+  CacheSlot *slot = slot_for_put(shard, block_num);
+  if (slot == nullptr) {
+    return;
+  }
+  // Handles must keep seeing the bytes they pinned, so a pinned buffer is
+  // replaced rather than overwritten
+  if (slot->buffer != nullptr && slot->buffer->pinned()) {
+    drop(shard, *slot);
+  }
+  if (slot->buffer == nullptr) {
+    slot->buffer = BlockBuffer::create();
+  }
+  size = std::min<size_t>(size, BLOCK_SIZE);
+  std::memcpy(slot->buffer->data, data, size);
+  std::memset(slot->buffer->data + size, 0, BLOCK_SIZE - size);
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::put(uint32_t block_num,
+                                    const std::vector<char> &data) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  copy_into(shard, block_num, data.data(), data.size());
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::put(uint32_t block_num, const char *data) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  copy_into(shard, block_num, data, BLOCK_SIZE);
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::put(uint32_t block_num,
+                                    const BlockHandle &handle) {
+  BlockBuffer *buffer = handle.buffer();
+  if (buffer == nullptr) {
+    put(block_num, handle.data());
+    return;
+  }
+
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.capacity == 0) {
+    return;
+  }
+  CacheSlot *slot = slot_for_put(shard, block_num);
+  if (slot == nullptr || slot->buffer == buffer) {
+    return;
+  }
+  if (slot->buffer != nullptr) {
+    drop(shard, *slot);
+  }
+  buffer->retain();
+  slot->buffer = buffer;
+}
+
+template <typename Policy>
+bool ShardedBlockCache<Policy>::prefetch(uint32_t block_num,
+                                         const BlockHandle &handle) {
+  BlockBuffer *buffer = handle.buffer();
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  uint32_t i;
+  if (buffer == nullptr || shard.capacity == 0 ||
+      shard.index.find(block_num, i)) {
+    return false;
+  }
+  CacheSlot *slot = slot_for_put(shard, block_num);
+  if (slot == nullptr) {
+    return false;
+  }
+  buffer->retain();
+  slot->buffer = buffer;
+  slot->readahead = true;
+  shard.readahead_blocks++;
+  return true;
+}
+
+template <typename Policy>
+bool ShardedBlockCache<Policy>::contains(uint32_t block_num) const {
+  const Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  uint32_t i;
+  return shard.index.find(block_num, i);
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::invalidate(uint32_t block_num) {
+  Shard &shard = shard_for(block_num);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  uint32_t i;
+  if (shard.index.find(block_num, i)) {
+    shard.policy.on_remove(i);
+    drop(shard, shard.slots[i]);
+    shard.index.erase(block_num);
+    shard.free_slots.push_back(i);
+  }
+}
+
+template <typename Policy> void ShardedBlockCache<Policy>::clear() {
+  for (size_t s = 0; s < num_shards_; ++s) {
+    Shard &shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (CacheSlot &slot : shard.slots) {
+      if (slot.buffer != nullptr) {
+        drop(shard, slot);
+      }
+    }
+    reset(shard, shard.capacity);
+  }
+}
+
+template <typename Policy>
+CacheStats ShardedBlockCache<Policy>::get_stats() const {
+  CacheStats stats{};
+  for (size_t s = 0; s < num_shards_; ++s) {
+    const Shard &shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.hits += shard.hits;
+    stats.misses += shard.misses;
+    stats.evictions += shard.evictions;
+    stats.readahead_blocks += shard.readahead_blocks;
+    stats.readahead_hits += shard.readahead_hits;
+    stats.readahead_waste += shard.readahead_waste;
+  }
+  stats.total_requests = stats.hits + stats.misses;
+  return stats;
+}
+
+template <typename Policy>
+void ShardedBlockCache<Policy>::set_capacity(size_t new_capacity) {
+  capacity_ = new_capacity;
+  size_t per_shard = (new_capacity + num_shards_ - 1) / num_shards_;
+
+  for (size_t s = 0; s < num_shards_; ++s) {
+    Shard &shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Let the policy pick what goes if the shard shrinks. Pinned buffers
+    // may have to go too: they survive in their handles, only the cache's
+    // reference is dropped.
+    while (shard.index.size() > per_shard) {
+      uint32_t i;
+      if (!shard.policy.victim(UINT32_MAX, shard.slots.data(), i)) {
+        i = 0;
+        while (shard.slots[i].buffer == nullptr) {
+          i++;
+        }
+        shard.policy.on_remove(i);
+      }
+      shard.index.erase(shard.slots[i].block_num);
+      drop(shard, shard.slots[i]);
+      shard.evictions++;
+    }
+
+    std::vector<CacheSlot> survivors;
+    for (const CacheSlot &slot : shard.slots) {
+      if (slot.buffer != nullptr) {
+        survivors.push_back(slot);
+      }
+    }
+    reset(shard, per_shard);
+    for (const CacheSlot &survivor : survivors) {
+      uint32_t i = shard.free_slots.back();
+      shard.free_slots.pop_back();
+      shard.slots[i] = survivor;
+      shard.index.insert(survivor.block_num, i);
+      shard.policy.on_insert(i, survivor.block_num);
+    }
+  }
+}
+
+template <typename Policy>
+size_t ShardedBlockCache<Policy>::get_size() const {
+  size_t size = 0;
+  for (size_t s = 0; s < num_shards_; ++s) {
+    const Shard &shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.index.size();
+  }
+  return size;
+}
+
+} // namespace
+
+std::unique_ptr<BlockCache> make_block_cache(CachePolicy policy,
+                                             size_t capacity,
+                                             size_t num_shards) {
+  switch (policy) {
+  case CachePolicy::LRU:
+    return std::make_unique<ShardedBlockCache<LruPolicy>>(policy, capacity,
+                                                          num_shards);
+  case CachePolicy::TWO_Q:
+    return std::make_unique<ShardedBlockCache<TwoQueuePolicy>>(
+        policy, capacity, num_shards);
+  case CachePolicy::ARC:
+    return std::make_unique<ShardedBlockCache<ArcPolicy>>(policy, capacity,
+                                                          num_shards);
+  case CachePolicy::CLOCK_PRO:
+    return std::make_unique<ShardedBlockCache<ClockProPolicy>>(
+        policy, capacity, num_shards);
+  case CachePolicy::CLOCK:
+  default:
+    return std::make_unique<ShardedBlockCache<ClockPolicy>>(
+        CachePolicy::CLOCK, capacity, num_shards);
+  }
+}
+
+const char *cache_policy_name(CachePolicy policy) {
+  switch (policy) {
+  case CachePolicy::LRU:
+    return "lru";
+  case CachePolicy::CLOCK:
+    return "clock";
+  case CachePolicy::TWO_Q:
+    return "2q";
+  case CachePolicy::ARC:
+    return "arc";
+  case CachePolicy::CLOCK_PRO:
+    return "clock-pro";
+  }
+  return "unknown";
+}
+
+} // namespace vfs
@@ -0,0 +1,249 @@
+#include "filesystem/block_device.h"
+#include "filesystem/vfs_types.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace vfs {
+
+namespace {
+
+// Longest run of consecutive blocks moved by one preadv/pwritev
+constexpr size_t MAX_RUN_BLOCKS = 64;
+
+// Transfer a whole iovec array, resuming after short reads/writes
+bool transfer_run(int fd, bool write, off_t offset, struct iovec *iov,
+                  int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = write ? ::pwritev(fd, iov, iovcnt, offset)
+                      : ::preadv(fd, iov, iovcnt, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    offset += n;
+    size_t left = static_cast<size_t>(n);
+    while (iovcnt > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool IBlockDevice::ReadBlocks(const uint32_t *block_ids, void *const *outs,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (!ReadBlock(block_ids[i], outs[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IBlockDevice::WriteBlocks(const uint32_t *block_ids,
+                               const void *const *datas, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (!WriteBlock(block_ids[i], datas[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void IBlockDevice::ReadBlocksAsync(std::vector<uint32_t> block_ids,
+                                   std::vector<void *> outs, Completion done) {
+  bool ok = ReadBlocks(block_ids.data(), outs.data(), block_ids.size());
+  if (done) {
+    done(ok);
+  }
+}
+
+PosixBlockDevice::PosixBlockDevice(int fd, uint32_t num_blocks)
+    : fd_(fd), num_blocks_(num_blocks) {}
+
+PosixBlockDevice::~PosixBlockDevice() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+uint32_t PosixBlockDevice::BlockSize() const { return BLOCK_SIZE; }
+
+bool PosixBlockDevice::ReadBlock(uint32_t block_id, void *out) {
+  if (block_id >= num_blocks_) {
+    return false;
+  }
+
+  char *buf = static_cast<char *>(out);
+  off_t offset = static_cast<off_t>(block_id) * BLOCK_SIZE;
+  size_t done = 0;
+  while (done < BLOCK_SIZE) {
+    ssize_t n = ::pread(fd_, buf + done, BLOCK_SIZE - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool PosixBlockDevice::WriteBlock(uint32_t block_id, const void *data) {
+  if (block_id >= num_blocks_) {
+    return false;
+  }
+
+  const char *buf = static_cast<const char *>(data);
+  off_t offset = static_cast<off_t>(block_id) * BLOCK_SIZE;
+  size_t done = 0;
+  while (done < BLOCK_SIZE) {
+    ssize_t n = ::pwrite(fd_, buf + done, BLOCK_SIZE - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool PosixBlockDevice::ReadBlocks(const uint32_t *block_ids,
+                                  void *const *outs, size_t count) {
+  return transfer_blocks(false, block_ids, outs, count);
+}
+
+bool PosixBlockDevice::WriteBlocks(const uint32_t *block_ids,
+                                   const void *const *datas, size_t count) {
+  // The buffers are only read from; iovec just lacks a const variant
+  return transfer_blocks(true, block_ids, const_cast<void *const *>(datas),
+                         count);
+}
+
+bool PosixBlockDevice::transfer_blocks(bool write, const uint32_t *block_ids,
+                                       void *const *buffers, size_t count) {
+  struct iovec iov[MAX_RUN_BLOCKS];
+  size_t i = 0;
+  while (i < count) {
+    if (block_ids[i] >= num_blocks_) {
+      return false;
+    }
+    size_t run = 1;
+    while (i + run < count && run < MAX_RUN_BLOCKS &&
+           block_ids[i + run] == block_ids[i] + run &&
+           block_ids[i + run] < num_blocks_) {
+      ++run;
+    }
+    for (size_t j = 0; j < run; ++j) {
+      iov[j].iov_base = buffers[i + j];
+      iov[j].iov_len = BLOCK_SIZE;
+    }
+    off_t offset = static_cast<off_t>(block_ids[i]) * BLOCK_SIZE;
+    if (!transfer_run(fd_, write, offset, iov, static_cast<int>(run))) {
+      return false;
+    }
+    i += run;
+  }
+  return true;
+}
+
+bool PosixBlockDevice::Flush() { return ::fdatasync(fd_) == 0; }
+
+MmapBlockDevice::MmapBlockDevice(int fd, char *base, uint32_t num_blocks)
+    : fd_(fd), base_(base), num_blocks_(num_blocks) {}
+
+MmapBlockDevice::~MmapBlockDevice() {
+  if (base_ != nullptr) {
+    ::munmap(base_, static_cast<size_t>(num_blocks_) * BLOCK_SIZE);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+uint32_t MmapBlockDevice::BlockSize() const { return BLOCK_SIZE; }
+
+bool MmapBlockDevice::ReadBlock(uint32_t block_id, void *out) {
+  if (block_id >= num_blocks_) {
+    return false;
+  }
+  std::memcpy(out, base_ + static_cast<size_t>(block_id) * BLOCK_SIZE,
+              BLOCK_SIZE);
+  return true;
+}
+
+bool MmapBlockDevice::WriteBlock(uint32_t block_id, const void *data) {
+  if (block_id >= num_blocks_) {
+    return false;
+  }
+  std::memcpy(base_ + static_cast<size_t>(block_id) * BLOCK_SIZE, data,
+              BLOCK_SIZE);
+  return true;
+}
+
+bool MmapBlockDevice::Flush() {
+  return ::msync(base_, static_cast<size_t>(num_blocks_) * BLOCK_SIZE,
+                 MS_SYNC) == 0;
+}
+
+const char *MmapBlockDevice::BlockData(uint32_t block_id) const {
+  if (block_id >= num_blocks_) {
+    return nullptr;
+  }
+  return base_ + static_cast<size_t>(block_id) * BLOCK_SIZE;
+}
+
+std::unique_ptr<IBlockDevice> open_block_device(const std::string &image_path,
+                                                BlockBackend backend) {
+  int fd = ::open(image_path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  uint32_t num_blocks = static_cast<uint32_t>(st.st_size / BLOCK_SIZE);
+
+  if (backend == BlockBackend::MMAP && num_blocks > 0) {
+    void *base = ::mmap(nullptr, static_cast<size_t>(num_blocks) * BLOCK_SIZE,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      ::close(fd);
+      return nullptr;
+    }
+    return std::make_unique<MmapBlockDevice>(fd, static_cast<char *>(base),
+                                             num_blocks);
+  }
+
+  if (backend == BlockBackend::IO_URING) {
+    if (auto device = create_io_uring_block_device(fd, num_blocks)) {
+      return device;
+    }
+    // io_uring missing or disabled (old kernel, seccomp): use pread/pwrite
+  }
+
+  return std::make_unique<PosixBlockDevice>(fd, num_blocks);
+}
+
+} // namespace vfs
@@ -0,0 +1,123 @@
+#include "filesystem/block_pool.h"
+#include <cstdlib>
+#include <new>
+
+namespace vfs {
+
+BlockBuffer *BlockBuffer::create() { return BlockPool::instance().allocate(); }
+
+void BlockBuffer::release() {
+  if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    BlockPool::instance().free(this);
+  }
+}
+
+// Per-thread magazine in front of the shared free list. It is destroyed
+// before the (never destroyed) pool, handing its frames back.
+struct ThreadFrameCache {
+  static constexpr size_t CAPACITY = 32;
+
+  BlockBuffer *frames[CAPACITY];
+  size_t count = 0;
+
+  ~ThreadFrameCache();
+};
+
+namespace {
+
+thread_local ThreadFrameCache tls_frames;
+// Set once tls_frames is gone; later frees on this thread (e.g. from
+// static destructors) go straight to the shared list
+thread_local bool tls_frames_destroyed = false;
+
+} // namespace
+
+ThreadFrameCache::~ThreadFrameCache() {
+  tls_frames_destroyed = true;
+  for (size_t i = 0; i < count; ++i) {
+    BlockPool::instance().free_shared(frames[i]);
+  }
+  count = 0;
+}
+
+BlockPool &BlockPool::instance() {
+  // Intentionally leaked: handles may still release frames during exit
+  static BlockPool *pool = new BlockPool();
+  return *pool;
+}
+
+void BlockPool::grow() {
+  // One allocation holds the frames followed by their headers; the size
+  // must be a multiple of the alignment
+  size_t frame_bytes = SLAB_FRAMES * BLOCK_SIZE;
+  size_t header_bytes =
+      (SLAB_FRAMES * sizeof(BlockBuffer) + BLOCK_SIZE - 1) / BLOCK_SIZE *
+      BLOCK_SIZE;
+  void *mem = std::aligned_alloc(BLOCK_SIZE, frame_bytes + header_bytes);
+  if (mem == nullptr) {
+    throw std::bad_alloc();
+  }
+  char *slab = static_cast<char *>(mem);
+  slabs_.push_back(slab);
+  slab_allocations_.fetch_add(1, std::memory_order_relaxed);
+  frames_total_.fetch_add(SLAB_FRAMES, std::memory_order_relaxed);
+
+  BlockBuffer *headers = reinterpret_cast<BlockBuffer *>(slab + frame_bytes);
+  for (size_t i = 0; i < SLAB_FRAMES; ++i) {
+    BlockBuffer *buffer = new (&headers[i]) BlockBuffer();
+    buffer->data = slab + i * BLOCK_SIZE;
+    buffer->next = free_list_;
+    free_list_ = buffer;
+  }
+}
+
+BlockBuffer *BlockPool::allocate_shared() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_list_ == nullptr) {
+    grow();
+  }
+  BlockBuffer *buffer = free_list_;
+  free_list_ = buffer->next;
+  return buffer;
+}
+
+void BlockPool::free_shared(BlockBuffer *buffer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer->next = free_list_;
+  free_list_ = buffer;
+}
+
+BlockBuffer *BlockPool::allocate() {
+  frame_allocations_.fetch_add(1, std::memory_order_relaxed);
+  BlockBuffer *buffer;
+  if (!tls_frames_destroyed && tls_frames.count > 0) {
+    buffer = tls_frames.frames[--tls_frames.count];
+  } else {
+    buffer = allocate_shared();
+  }
+  buffer->next = nullptr;
+  buffer->refs.store(1, std::memory_order_relaxed);
+  return buffer;
+}
+
+void BlockPool::free(BlockBuffer *buffer) {
+  frame_frees_.fetch_add(1, std::memory_order_relaxed);
+  if (!tls_frames_destroyed &&
+      tls_frames.count < ThreadFrameCache::CAPACITY) {
+    tls_frames.frames[tls_frames.count++] = buffer;
+  } else {
+    free_shared(buffer);
+  }
+}
+
+BlockPool::Stats BlockPool::get_stats() const {
+  Stats stats;
+  stats.slab_allocations = slab_allocations_.load(std::memory_order_relaxed);
+  stats.frames_total = frames_total_.load(std::memory_order_relaxed);
+  stats.frame_allocations = frame_allocations_.load(std::memory_order_relaxed);
+  stats.frame_frees = frame_frees_.load(std::memory_order_relaxed);
+  stats.frames_in_use = stats.frame_allocations - stats.frame_frees;
+  return stats;
+}
+
+} // namespace vfs
@@ -0,0 +1,480 @@
+#include "filesystem/cache_policy.h"
+#include <algorithm>
+
+namespace vfs {
+
+// ===== BlockIndex =====
+
+void BlockIndex::reset(size_t capacity) {
+  size_t buckets = 8;
+  while (buckets < capacity * 2) {
+    buckets *= 2;
+  }
+  table_.assign(buckets, Entry{0, EMPTY});
+  mask_ = buckets - 1;
+  size_ = 0;
+}
+
+size_t BlockIndex::position(uint32_t block_num) const {
+  if (table_.empty()) {
+    return 0;
+  }
+  for (size_t i = home(block_num);; i = (i + 1) & mask_) {
+    if (table_[i].value == EMPTY) {
+      return table_.size();
+    }
+    if (table_[i].block_num == block_num) {
+      return i;
+    }
+  }
+}
+
+bool BlockIndex::find(uint32_t block_num, uint32_t &value) const {
+  size_t i = position(block_num);
+  if (i >= table_.size()) {
+    return false;
+  }
+  value = table_[i].value;
+  return true;
+}
+
+void BlockIndex::insert(uint32_t block_num, uint32_t value) {
+  size_t i = home(block_num);
+  while (table_[i].value != EMPTY && table_[i].block_num != block_num) {
+    i = (i + 1) & mask_;
+  }
+  if (table_[i].value == EMPTY) {
+    size_++;
+  }
+  table_[i] = Entry{block_num, value};
+}
+
+void BlockIndex::erase(uint32_t block_num) {
+  size_t i = position(block_num);
+  if (i >= table_.size()) {
+    return;
+  }
+  table_[i].value = EMPTY;
+  size_--;
+
+  // Backward-shift deletion: pull later entries of the probe run into the
+  // hole unless that would move them before their home bucket
+  for (size_t j = (i + 1) & mask_; table_[j].value != EMPTY;
+       j = (j + 1) & mask_) {
+    size_t k = home(table_[j].block_num);
+    bool in_place = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+    if (!in_place) {
+      table_[i] = table_[j];
+      table_[j].value = EMPTY;
+      i = j;
+    }
+  }
+}
+
+void BlockIndex::clear() {
+  for (Entry &entry : table_) {
+    entry.value = EMPTY;
+  }
+  size_ = 0;
+}
+
+// ===== SlotLists =====
+
+void SlotLists::reset(size_t slots, size_t lists) {
+  prev_.assign(slots, NONE);
+  next_.assign(slots, NONE);
+  owner_.assign(slots, NONE);
+  head_.assign(lists, NONE);
+  tail_.assign(lists, NONE);
+  size_.assign(lists, 0);
+}
+
+void SlotLists::push_front(uint32_t list, uint32_t slot) {
+  prev_[slot] = NONE;
+  next_[slot] = head_[list];
+  if (head_[list] != NONE) {
+    prev_[head_[list]] = slot;
+  } else {
+    tail_[list] = slot;
+  }
+  head_[list] = slot;
+  owner_[slot] = list;
+  size_[list]++;
+}
+
+void SlotLists::remove(uint32_t slot) {
+  uint32_t list = owner_[slot];
+  if (list == NONE) {
+    return;
+  }
+  if (prev_[slot] != NONE) {
+    next_[prev_[slot]] = next_[slot];
+  } else {
+    head_[list] = next_[slot];
+  }
+  if (next_[slot] != NONE) {
+    prev_[next_[slot]] = prev_[slot];
+  } else {
+    tail_[list] = prev_[slot];
+  }
+  prev_[slot] = next_[slot] = owner_[slot] = NONE;
+  size_[list]--;
+}
+
+void SlotLists::move_to_front(uint32_t list, uint32_t slot) {
+  remove(slot);
+  push_front(list, slot);
+}
+
+uint32_t SlotLists::unpinned_back(uint32_t list,
+                                  const CacheSlot *slots) const {
+  uint32_t slot = tail_[list];
+  while (slot != NONE && slots[slot].pinned()) {
+    slot = prev_[slot];
+  }
+  return slot;
+}
+
+// ===== GhostList =====
+
+void GhostList::reset(size_t capacity) {
+  capacity_ = capacity;
+  // Twice the capacity leaves room for tombstones
+  ring_.assign(std::max<size_t>(1, capacity * 2), 0);
+  alive_.assign(ring_.size(), 0);
+  index_.reset(capacity);
+  head_ = used_ = live_ = 0;
+}
+
+bool GhostList::contains(uint32_t block_num) const {
+  uint32_t pos;
+  return index_.find(block_num, pos);
+}
+
+void GhostList::skip_tombstones() {
+  while (used_ > 0 && !alive_[head_]) {
+    head_ = (head_ + 1) % ring_.size();
+    used_--;
+  }
+}
+
+bool GhostList::pop_oldest() {
+  skip_tombstones();
+  if (live_ == 0) {
+    return false;
+  }
+  index_.erase(ring_[head_]);
+  alive_[head_] = 0;
+  head_ = (head_ + 1) % ring_.size();
+  used_--;
+  live_--;
+  return true;
+}
+
+bool GhostList::push(uint32_t block_num) {
+  if (capacity_ == 0) {
+    return false;
+  }
+  erase(block_num);
+
+  bool dropped = false;
+  skip_tombstones();
+  if (live_ >= capacity_ || used_ == ring_.size()) {
+    dropped = pop_oldest();
+  }
+
+  size_t pos = (head_ + used_) % ring_.size();
+  ring_[pos] = block_num;
+  alive_[pos] = 1;
+  index_.insert(block_num, static_cast<uint32_t>(pos));
+  used_++;
+  live_++;
+  return dropped;
+}
+
+bool GhostList::erase(uint32_t block_num) {
+  uint32_t pos;
+  if (!index_.find(block_num, pos)) {
+    return false;
+  }
+  index_.erase(block_num);
+  alive_[pos] = 0;
+  live_--;
+  return true;
+}
+
+// ===== LRU =====
+
+void LruPolicy::reset(size_t capacity) { lists_.reset(capacity, 1); }
+
+void LruPolicy::on_hit(uint32_t slot) { lists_.move_to_front(0, slot); }
+
+void LruPolicy::on_insert(uint32_t slot, uint32_t /*block_num*/) {
+  lists_.push_front(0, slot);
+}
+
+void LruPolicy::on_remove(uint32_t slot) { lists_.remove(slot); }
+
+bool LruPolicy::victim(uint32_t /*incoming*/, const CacheSlot *slots,
+                       uint32_t &slot) {
+  slot = lists_.unpinned_back(0, slots);
+  if (slot == SlotLists::NONE) {
+    return false;
+  }
+  lists_.remove(slot);
+  return true;
+}
+
+// ===== CLOCK =====
+
+void ClockPolicy::reset(size_t capacity) {
+  referenced_.assign(capacity, 0);
+  resident_.assign(capacity, 0);
+  hand_ = 0;
+}
+
+void ClockPolicy::on_insert(uint32_t slot, uint32_t /*block_num*/) {
+  // New blocks start unreferenced so a one-off scan cannot push out
+  // blocks that are actually being reused
+  resident_[slot] = 1;
+  referenced_[slot] = 0;
+}
+
+bool ClockPolicy::victim(uint32_t /*incoming*/, const CacheSlot *slots,
+                         uint32_t &slot) {
+  // Sweep the clock hand, giving referenced slots a second chance. Pinned
+  // slots are skipped; after two full turns every slot is pinned.
+  size_t n = resident_.size();
+  for (size_t step = 0; step < 2 * n; ++step) {
+    size_t i = hand_;
+    hand_ = (hand_ + 1) % n;
+    if (!resident_[i] || slots[i].pinned()) {
+      continue;
+    }
+    if (referenced_[i]) {
+      referenced_[i] = 0;
+      continue;
+    }
+    resident_[i] = 0;
+    slot = static_cast<uint32_t>(i);
+    return true;
+  }
+  return false;
+}
+
+// ===== 2Q =====
+
+void TwoQueuePolicy::reset(size_t capacity) {
+  lists_.reset(capacity, 2);
+  // Recommended tuning from the paper: Kin = 25%, Kout = 50% of the cache
+  kin_ = std::max<size_t>(1, capacity / 4);
+  a1out_.reset(std::max<size_t>(1, capacity / 2));
+  has_promoted_ = false;
+}
+
+void TwoQueuePolicy::on_hit(uint32_t slot) {
+  // Hits in A1in are deliberately ignored: correlated re-references right
+  // after the first access say nothing about long-term reuse
+  if (lists_.list_of(slot) == AM) {
+    lists_.move_to_front(AM, slot);
+  }
+}
+
+void TwoQueuePolicy::on_insert(uint32_t slot, uint32_t block_num) {
+  bool remembered = (has_promoted_ && promoted_ == block_num) ||
+                    a1out_.erase(block_num);
+  has_promoted_ = false;
+  lists_.push_front(remembered ? AM : A1IN, slot);
+}
+
+void TwoQueuePolicy::on_remove(uint32_t slot) { lists_.remove(slot); }
+
+bool TwoQueuePolicy::victim(uint32_t incoming, const CacheSlot *slots,
+                            uint32_t &slot) {
+  // Look the incoming block up in A1out before reclaiming: pushing the
+  // victim could otherwise age it out of the ghost list first
+  if (a1out_.erase(incoming)) {
+    promoted_ = incoming;
+    has_promoted_ = true;
+  }
+  bool from_a1in = lists_.size(A1IN) > kin_ || lists_.size(AM) == 0;
+  slot = lists_.unpinned_back(from_a1in ? A1IN : AM, slots);
+  if (slot == SlotLists::NONE) {
+    from_a1in = !from_a1in;
+    slot = lists_.unpinned_back(from_a1in ? A1IN : AM, slots);
+  }
+  if (slot == SlotLists::NONE) {
+    return false;
+  }
+  lists_.remove(slot);
+  if (from_a1in) {
+    a1out_.push(slots[slot].block_num);
+  }
+  return true;
+}
+
+// ===== ARC =====
+
+void ArcPolicy::reset(size_t capacity) {
+  lists_.reset(capacity, 2);
+  b1_.reset(capacity);
+  b2_.reset(capacity);
+  capacity_ = capacity;
+  p_ = 0;
+}
+
+void ArcPolicy::on_hit(uint32_t slot) { lists_.move_to_front(T2, slot); }
+
+size_t ArcPolicy::adapted_target(uint32_t block_num) const {
+  // A ghost hit in B1 means T1 was too small, one in B2 that T2 was
+  size_t b1 = b1_.size();
+  size_t b2 = b2_.size();
+  if (b1_.contains(block_num)) {
+    size_t delta = std::max<size_t>(1, b1 > 0 ? b2 / b1 : 1);
+    return std::min(capacity_, p_ + delta);
+  }
+  if (b2_.contains(block_num)) {
+    size_t delta = std::max<size_t>(1, b2 > 0 ? b1 / b2 : 1);
+    return p_ > delta ? p_ - delta : 0;
+  }
+  return p_;
+}
+
+void ArcPolicy::on_insert(uint32_t slot, uint32_t block_num) {
+  size_t p = adapted_target(block_num);
+  if (b1_.erase(block_num) || b2_.erase(block_num)) {
+    p_ = p;
+    lists_.push_front(T2, slot);
+    return;
+  }
+
+  // Complete miss: keep |T1| + |B1| <= c and the directory within 2c
+  size_t t1 = lists_.size(T1);
+  size_t t2 = lists_.size(T2);
+  if (t1 + b1_.size() >= capacity_) {
+    b1_.pop_oldest();
+  } else if (t1 + t2 + b1_.size() + b2_.size() >= 2 * capacity_) {
+    b2_.pop_oldest();
+  }
+  lists_.push_front(T1, slot);
+}
+
+void ArcPolicy::on_remove(uint32_t slot) { lists_.remove(slot); }
+
+bool ArcPolicy::victim(uint32_t incoming, const CacheSlot *slots,
+                       uint32_t &slot) {
+  // REPLACE(x, p): evict from T1 if it is over its target
+  size_t p = adapted_target(incoming);
+  size_t t1 = lists_.size(T1);
+  bool from_t1 =
+      t1 > 0 && (t1 > p || (b2_.contains(incoming) && t1 == p));
+  slot = lists_.unpinned_back(from_t1 ? T1 : T2, slots);
+  if (slot == SlotLists::NONE) {
+    from_t1 = !from_t1;
+    slot = lists_.unpinned_back(from_t1 ? T1 : T2, slots);
+  }
+  if (slot == SlotLists::NONE) {
+    return false;
+  }
+  lists_.remove(slot);
+  (from_t1 ? b1_ : b2_).push(slots[slot].block_num);
+  return true;
+}
+
+// ===== CLOCK-Pro =====
+
+void ClockProPolicy::reset(size_t capacity) {
+  state_.assign(capacity, FREE);
+  referenced_.assign(capacity, 0);
+  test_.assign(capacity, 0);
+  non_resident_.reset(capacity);
+  capacity_ = capacity;
+  hot_count_ = 0;
+  cold_target_ = std::max<size_t>(1, capacity / 4);
+  cold_hand_ = hot_hand_ = 0;
+}
+
+void ClockProPolicy::on_insert(uint32_t slot, uint32_t block_num) {
+  referenced_[slot] = 0;
+  test_[slot] = 0;
+  if (non_resident_.erase(block_num)) {
+    // Re-accessed within its test period: the cold area is too small
+    cold_target_ = std::min(capacity_ > 1 ? capacity_ - 1 : 1,
+                            cold_target_ + 1);
+    state_[slot] = HOT;
+    hot_count_++;
+    run_hot_hand();
+  } else {
+    state_[slot] = COLD;
+    test_[slot] = 1;
+  }
+}
+
+void ClockProPolicy::on_remove(uint32_t slot) {
+  if (state_[slot] == HOT) {
+    hot_count_--;
+  }
+  state_[slot] = FREE;
+}
+
+void ClockProPolicy::run_hot_hand() {
+  // Demote unreferenced hot blocks until the hot area fits again
+  size_t hot_limit = capacity_ - std::min(capacity_, cold_target_);
+  for (size_t step = 0; step < 2 * capacity_ && hot_count_ > hot_limit;
+       ++step) {
+    size_t i = hot_hand_;
+    hot_hand_ = (hot_hand_ + 1) % capacity_;
+    if (state_[i] != HOT) {
+      continue;
+    }
+    if (referenced_[i]) {
+      referenced_[i] = 0;
+      continue;
+    }
+    state_[i] = COLD;
+    test_[i] = 0;
+    hot_count_--;
+  }
+}
+
+bool ClockProPolicy::victim(uint32_t /*incoming*/, const CacheSlot *slots,
+                            uint32_t &slot) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    for (size_t step = 0; step < 2 * capacity_; ++step) {
+      size_t i = cold_hand_;
+      cold_hand_ = (cold_hand_ + 1) % capacity_;
+      if (state_[i] != COLD || slots[i].pinned()) {
+        continue;
+      }
+      if (referenced_[i]) {
+        referenced_[i] = 0;
+        if (test_[i]) {
+          // Reused during its test period: promote
+          state_[i] = HOT;
+          test_[i] = 0;
+          hot_count_++;
+          run_hot_hand();
+        } else {
+          test_[i] = 1;
+        }
+        continue;
+      }
+
+      if (test_[i] && non_resident_.push(slots[i].block_num)) {
+        // A test period expired without reuse: shrink the cold area
+        cold_target_ = std::max<size_t>(1, cold_target_ - 1);
+      }
+      state_[i] = FREE;
+      slot = static_cast<uint32_t>(i);
+      return true;
+    }
+    // Everything cold is pinned or was just promoted: force demotions
+    size_t saved_target = cold_target_;
+    cold_target_ = capacity_;
+    run_hot_hand();
+    cold_target_ = saved_target;
+  }
+  return false;
+}
+
+} // namespace vfs
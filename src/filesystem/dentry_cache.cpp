@@ -0,0 +1,74 @@
+#include "filesystem/dentry_cache.h"
+#include <algorithm>
+
+namespace vfs {
+
+DentryCache::DentryCache(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity)) {}
+
+bool DentryCache::lookup(uint32_t parent, std::string_view name,
+                         int32_t &inode_num) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(Key{parent, name});
+  if (it == entries_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  inode_num = it->second->inode_num;
+  return true;
+}
+
+void DentryCache::insert(uint32_t parent, std::string_view name,
+                         int32_t inode_num) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(Key{parent, name});
+  if (it != entries_.end()) {
+    it->second->inode_num = inode_num;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+
+  if (entries_.size() >= capacity_) {
+    const Node &victim = lru_.back();
+    entries_.erase(Key{victim.parent, victim.name});
+    lru_.pop_back();
+    evictions_++;
+  }
+  lru_.push_front(Node{parent, std::string(name), inode_num});
+  entries_.emplace(Key{parent, lru_.front().name}, lru_.begin());
+}
+
+void DentryCache::erase(uint32_t parent, std::string_view name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(Key{parent, name});
+  if (it != entries_.end()) {
+    auto node = it->second;
+    entries_.erase(it);
+    lru_.erase(node);
+  }
+}
+
+size_t DentryCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void DentryCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  lru_.clear();
+}
+
+CacheStats DentryCache::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CacheStats stats{};
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.total_requests = hits_ + misses_;
+  return stats;
+}
+
+} // namespace vfs
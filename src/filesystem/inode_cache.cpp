@@ -0,0 +1,148 @@
+#include "filesystem/inode_cache.h"
+#include <algorithm>
+
+namespace vfs {
+
+InodeCache::InodeCache(size_t capacity)
+    : capacity_(std::max<size_t>(1, capacity)) {}
+
+InodeCache::Entry &InodeCache::entry(uint32_t inode_num) {
+  auto it = entries_.find(inode_num);
+  if (it != entries_.end()) {
+    return it->second;
+  }
+  Entry &e = entries_[inode_num];
+  lru_.push_front(inode_num);
+  e.lru = lru_.begin();
+  return e;
+}
+
+void InodeCache::touch(Entry &e) { lru_.splice(lru_.begin(), lru_, e.lru); }
+
+void InodeCache::evict() {
+  // Pinned and dirty entries are skipped; if nothing else is left the
+  // cache stays over capacity until they are released or written back
+  auto it = lru_.end();
+  while (entries_.size() > capacity_ && it != lru_.begin()) {
+    --it;
+    auto found = entries_.find(*it);
+    const Entry &e = found->second;
+    if (e.refs > 0 || e.dirty) {
+      continue;
+    }
+    it = lru_.erase(it);
+    entries_.erase(found);
+    evictions_++;
+  }
+}
+
+bool InodeCache::get(uint32_t inode_num, Inode &inode) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(inode_num);
+  if (it == entries_.end() || !it->second.valid) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  touch(it->second);
+  inode = it->second.inode;
+  return true;
+}
+
+void InodeCache::fill(uint32_t inode_num, const Inode &inode) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &e = entry(inode_num);
+  if (e.valid) {
+    return; // written after the caller read the table
+  }
+  e.inode = inode;
+  e.valid = true;
+  evict();
+}
+
+void InodeCache::put(uint32_t inode_num, const Inode &inode, bool dirty) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &e = entry(inode_num);
+  e.inode = inode;
+  e.valid = true;
+  if (dirty) {
+    e.dirty = true;
+    dirty_.insert(inode_num);
+  }
+  touch(e);
+  evict();
+}
+
+void InodeCache::retain(uint32_t inode_num) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entry(inode_num).refs++;
+}
+
+void InodeCache::release(uint32_t inode_num) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(inode_num);
+  if (it == entries_.end() || it->second.refs == 0) {
+    return;
+  }
+  Entry &e = it->second;
+  if (--e.refs == 0 && !e.valid) {
+    lru_.erase(e.lru);
+    entries_.erase(it);
+    return;
+  }
+  evict();
+}
+
+void InodeCache::take_dirty(std::vector<std::pair<uint32_t, Inode>> &out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  out.clear();
+  out.reserve(dirty_.size());
+  for (uint32_t inode_num : dirty_) {
+    Entry &e = entries_.at(inode_num);
+    out.emplace_back(inode_num, e.inode);
+    e.dirty = false;
+  }
+  dirty_.clear();
+  evict();
+}
+
+void InodeCache::redirty(uint32_t inode_num, const Inode &inode) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &e = entry(inode_num);
+  if (e.dirty) {
+    return;
+  }
+  e.inode = inode;
+  e.valid = true;
+  e.dirty = true;
+  dirty_.insert(inode_num);
+}
+
+size_t InodeCache::dirty_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dirty_.size();
+}
+
+size_t InodeCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void InodeCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  lru_.clear();
+  dirty_.clear();
+}
+
+CacheStats InodeCache::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CacheStats stats{};
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.total_requests = hits_ + misses_;
+  return stats;
+}
+
+} // namespace vfs
@@ -0,0 +1,482 @@
+#include "filesystem/block_device.h"
+#include "filesystem/vfs_types.h"
+
+#ifdef VFS_HAVE_IO_URING
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+// <linux/io_uring.h> pulls in <linux/fs.h>, whose 1 KiB BLOCK_SIZE macro
+// would shadow vfs::BLOCK_SIZE below
+#undef BLOCK_SIZE
+
+namespace vfs {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+/**
+ * @brief Block device that batches reads/writes through io_uring
+ * Submitters fill SQEs under sq_mutex_ and enter the kernel once per batch;
+ * a dedicated thread waits for completions and finishes batches. The number
+ * of requests in flight is capped at the CQ size so completions can never
+ * overflow the ring. If the ring fails, its outstanding batches fail and
+ * later requests take the pread/pwrite path.
+ */
+class IoUringBlockDevice : public PosixBlockDevice {
+public:
+  static constexpr unsigned RING_ENTRIES = 256;
+  // How often the reaper checks for a ring a submitter found dead
+  static constexpr int REAP_POLL_MS = 50;
+
+  IoUringBlockDevice(int fd, uint32_t num_blocks)
+      : PosixBlockDevice(fd, num_blocks), file_fd_(fd) {}
+
+  ~IoUringBlockDevice() override { shutdown(); }
+
+  bool init();
+  using PosixBlockDevice::release_fd;
+
+  bool ReadBlocks(const uint32_t *block_ids, void *const *outs,
+                  size_t count) override;
+  bool WriteBlocks(const uint32_t *block_ids, const void *const *datas,
+                   size_t count) override;
+  void ReadBlocksAsync(std::vector<uint32_t> block_ids,
+                       std::vector<void *> outs, Completion done) override;
+  bool IsAsync() const override { return !dead(); }
+
+private:
+  struct Batch {
+    std::atomic<size_t> remaining;
+    std::atomic<bool> ok;
+    size_t inflight = 0; // queued entries not yet reaped, under sq_mutex_
+    Completion done;
+    // Keeps async request arguments alive until completion
+    std::vector<uint32_t> block_ids;
+    std::vector<void *> outs;
+  };
+
+  bool submit(uint8_t opcode, const uint32_t *block_ids, void *const *bufs,
+              size_t count, Batch *batch);
+  bool run_sync(uint8_t opcode, const uint32_t *block_ids, void *const *bufs,
+                size_t count);
+  void reap_loop();
+  void shutdown();
+  bool dead() const { return dead_.load(std::memory_order_acquire); }
+  // Counts n entries of a batch as finished, collecting it into finished
+  // once none remain. Caller holds sq_mutex_.
+  void retire_locked(Batch *batch, size_t n, bool ok,
+                     std::vector<Batch *> &finished);
+  // Marks the ring dead and fails every entry still in flight. Caller
+  // holds sq_mutex_.
+  void kill_locked(std::vector<Batch *> &finished);
+  static void finish(const std::vector<Batch *> &finished);
+
+  int file_fd_;
+  int ring_fd_ = -1;
+
+  // Submission ring
+  void *sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned sq_entries_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+
+  // Completion ring
+  void *cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned cq_entries_ = 0;
+
+  std::mutex sq_mutex_;
+  std::condition_variable space_cv_;
+  unsigned inflight_ = 0;    // queued but not yet reaped
+  unsigned unsubmitted_ = 0; // published in the SQ, not yet entered
+  std::unordered_set<Batch *> live_; // batches with entries in flight
+  std::atomic<bool> dead_{false};
+
+  std::thread reaper_;
+};
+
+bool IoUringBlockDevice::init() {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd_ = io_uring_setup(RING_ENTRIES, &params);
+  if (ring_fd_ < 0) {
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+  }
+  void *sqes = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+
+  char *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  cq_entries_ = params.cq_entries;
+
+  reaper_ = std::thread(&IoUringBlockDevice::reap_loop, this);
+  return true;
+}
+
+void IoUringBlockDevice::shutdown() {
+  if (reaper_.joinable()) {
+    // A NOP with no batch attached tells the reaper to exit; on a dead
+    // ring it has already exited
+    submit(IORING_OP_NOP, nullptr, nullptr, 1, nullptr);
+    reaper_.join();
+  }
+  if (sqes_ != nullptr) {
+    ::munmap(sqes_, sq_entries_ * sizeof(io_uring_sqe));
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    ::munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ >= 0) {
+    ::close(ring_fd_);
+  }
+}
+
+void IoUringBlockDevice::retire_locked(Batch *batch, size_t n, bool ok,
+                                       std::vector<Batch *> &finished) {
+  if (!ok) {
+    batch->ok = false;
+  }
+  if (batch->remaining.fetch_sub(n) == n) {
+    live_.erase(batch);
+    finished.push_back(batch);
+  }
+}
+
+void IoUringBlockDevice::kill_locked(std::vector<Batch *> &finished) {
+  dead_ = true;
+  // Copied first: retiring a batch removes it from live_
+  std::vector<Batch *> live(live_.begin(), live_.end());
+  for (Batch *batch : live) {
+    size_t n = batch->inflight;
+    batch->inflight = 0;
+    retire_locked(batch, n, false, finished);
+  }
+  live_.clear();
+  inflight_ = 0;
+  unsubmitted_ = 0;
+  space_cv_.notify_all();
+}
+
+void IoUringBlockDevice::finish(const std::vector<Batch *> &finished) {
+  for (Batch *batch : finished) {
+    if (batch->done) {
+      batch->done(batch->ok.load());
+    }
+    delete batch;
+  }
+}
+
+bool IoUringBlockDevice::submit(uint8_t opcode, const uint32_t *block_ids,
+                                void *const *bufs, size_t count,
+                                Batch *batch) {
+  // Batches finish after the lock is dropped: completions may submit
+  std::vector<Batch *> finished;
+  std::unique_lock<std::mutex> lock(sq_mutex_);
+
+  size_t queued = 0;
+  while (queued < count) {
+    space_cv_.wait(lock,
+                   [this]() { return inflight_ < cq_entries_ || dead(); });
+    if (dead()) {
+      break;
+    }
+
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail_;
+    unsigned to_submit = 0;
+    while (queued < count && (tail + to_submit) - head < sq_entries_ &&
+           inflight_ < cq_entries_) {
+      unsigned index = (tail + to_submit) & *sq_mask_;
+      io_uring_sqe *sqe = &sqes_[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = opcode;
+      sqe->fd = opcode == IORING_OP_NOP ? -1 : file_fd_;
+      if (opcode != IORING_OP_NOP) {
+        sqe->addr = reinterpret_cast<uint64_t>(bufs[queued]);
+        sqe->len = BLOCK_SIZE;
+        sqe->off = static_cast<uint64_t>(block_ids[queued]) * BLOCK_SIZE;
+      }
+      sqe->user_data = reinterpret_cast<uint64_t>(batch);
+      sq_array_[index] = index;
+      to_submit++;
+      queued++;
+      inflight_++;
+    }
+    if (batch != nullptr && to_submit > 0) {
+      batch->inflight += to_submit;
+      live_.insert(batch);
+    }
+    __atomic_store_n(sq_tail_, tail + to_submit, __ATOMIC_RELEASE);
+    unsubmitted_ += to_submit;
+
+    // Entries the kernel did not take stay in the ring and are handed in
+    // again by the next submitter.
+    while (unsubmitted_ > 0) {
+      int ret = io_uring_enter(ring_fd_, unsubmitted_, 0, 0);
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;
+        }
+        // The ring is unusable: fail everything in flight
+        kill_locked(finished);
+        break;
+      }
+      unsubmitted_ -= static_cast<unsigned>(ret);
+    }
+  }
+
+  // Entries never queued fail here
+  if (queued < count && batch != nullptr) {
+    retire_locked(batch, count - queued, false, finished);
+  }
+  bool ok = !dead();
+  lock.unlock();
+  finish(finished);
+  return ok;
+}
+
+void IoUringBlockDevice::reap_loop() {
+  std::vector<Batch *> finished;
+  while (true) {
+    // Polled rather than blocking in io_uring_enter, which would never
+    // return once a submitter has failed the ring with nothing in flight.
+    // The enter runs completion work the kernel left for us.
+    pollfd pfd{ring_fd_, POLLIN, 0};
+    int ret = ::poll(&pfd, 1, REAP_POLL_MS);
+    if (ret > 0 && (pfd.revents & (POLLERR | POLLNVAL)) != 0) {
+      errno = EBADF;
+      ret = -1;
+    } else if (ret > 0) {
+      ret = io_uring_enter(ring_fd_, 0, 0, IORING_ENTER_GETEVENTS);
+    }
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      std::unique_lock<std::mutex> lock(sq_mutex_);
+      kill_locked(finished);
+      lock.unlock();
+      finish(finished);
+      return;
+    }
+
+    bool stop = false;
+    {
+      std::lock_guard<std::mutex> lock(sq_mutex_);
+      if (dead()) {
+        // A submitter failed the ring and its entries
+        return;
+      }
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      unsigned reaped = 0;
+      while (head != tail) {
+        io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+        Batch *batch = reinterpret_cast<Batch *>(cqe->user_data);
+        if (batch == nullptr) {
+          stop = true;
+        } else {
+          batch->inflight--;
+          retire_locked(batch, 1,
+                        cqe->res == static_cast<int32_t>(BLOCK_SIZE),
+                        finished);
+        }
+        head++;
+        reaped++;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      if (reaped > 0) {
+        inflight_ -= reaped;
+        space_cv_.notify_all();
+      }
+    }
+    finish(finished);
+    finished.clear();
+    if (stop) {
+      return;
+    }
+  }
+}
+
+bool IoUringBlockDevice::run_sync(uint8_t opcode, const uint32_t *block_ids,
+                                  void *const *bufs, size_t count) {
+  std::promise<bool> result;
+  auto future = result.get_future();
+  Batch *batch = new Batch();
+  batch->remaining = count;
+  batch->ok = true;
+  batch->done = [&result](bool ok) { result.set_value(ok); };
+  // A dead ring still finishes the batch, failed
+  submit(opcode, block_ids, bufs, count, batch);
+  return future.get();
+}
+
+bool IoUringBlockDevice::ReadBlocks(const uint32_t *block_ids,
+                                    void *const *outs, size_t count) {
+  if (count <= 1 || dead()) {
+    return IBlockDevice::ReadBlocks(block_ids, outs, count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (block_ids[i] >= NumBlocks()) {
+      return false;
+    }
+  }
+  if (run_sync(IORING_OP_READ, block_ids, outs, count)) {
+    return true;
+  }
+  // Short reads or an old kernel without IORING_OP_READ: retry plainly
+  return IBlockDevice::ReadBlocks(block_ids, outs, count);
+}
+
+bool IoUringBlockDevice::WriteBlocks(const uint32_t *block_ids,
+                                     const void *const *datas, size_t count) {
+  if (count <= 1 || dead()) {
+    return IBlockDevice::WriteBlocks(block_ids, datas, count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (block_ids[i] >= NumBlocks()) {
+      return false;
+    }
+  }
+  if (run_sync(IORING_OP_WRITE, block_ids, const_cast<void *const *>(datas),
+               count)) {
+    return true;
+  }
+  return IBlockDevice::WriteBlocks(block_ids, datas, count);
+}
+
+void IoUringBlockDevice::ReadBlocksAsync(std::vector<uint32_t> block_ids,
+                                         std::vector<void *> outs,
+                                         Completion done) {
+  if (block_ids.empty()) {
+    if (done) {
+      done(true);
+    }
+    return;
+  }
+  for (uint32_t block_id : block_ids) {
+    if (block_id >= NumBlocks()) {
+      if (done) {
+        done(false);
+      }
+      return;
+    }
+  }
+  if (dead()) {
+    IBlockDevice::ReadBlocksAsync(std::move(block_ids), std::move(outs),
+                                  std::move(done));
+    return;
+  }
+
+  Batch *batch = new Batch();
+  batch->remaining = block_ids.size();
+  batch->ok = true;
+  batch->block_ids = std::move(block_ids);
+  batch->outs = std::move(outs);
+  batch->done = std::move(done);
+  // The reaper frees the batch once the last entry completes; submit()
+  // does not touch it after queueing that entry.
+  const uint32_t *ids = batch->block_ids.data();
+  void *const *bufs = batch->outs.data();
+  size_t count = batch->block_ids.size();
+  submit(IORING_OP_READ, ids, bufs, count, batch);
+}
+
+} // namespace
+
+std::unique_ptr<IBlockDevice> create_io_uring_block_device(int fd,
+                                                           uint32_t num_blocks) {
+  auto device = std::make_unique<IoUringBlockDevice>(fd, num_blocks);
+  if (!device->init()) {
+    // The caller keeps the fd for its fallback device
+    device->release_fd();
+    return nullptr;
+  }
+  return device;
+}
+
+} // namespace vfs
+
+#else // !VFS_HAVE_IO_URING
+
+namespace vfs {
+
+std::unique_ptr<IBlockDevice> create_io_uring_block_device(int /*fd*/,
+                                                           uint32_t /*num_blocks*/) {
+  return nullptr;
+}
+
+} // namespace vfs
+
+#endif // VFS_HAVE_IO_URING
@@ -1,4 +1,5 @@
 #include "filesystem/vfs.h"
+#include "filesystem/vfs_log.h"
 #include <algorithm>
 #include <cstring>
 #include <fcntl.h>
@@ -10,8 +11,19 @@
 
 namespace vfs {
 
+namespace {
+
+// Largest batch of cache misses handed to read_missed_blocks
+constexpr size_t READ_BATCH = 256;
+
+} // namespace
+
 VirtualFileSystem::VirtualFileSystem()
     : mounted_(false),
+      inode_cache_(std::make_unique<InodeCache>(
+          MountOptions().inode_cache_capacity)),
+      dentry_cache_(std::make_unique<DentryCache>(
+          MountOptions().dentry_cache_capacity)),
       next_fd_(3) { // Start from 3 (0,1,2 reserved for stdin/stdout/stderr)
 }
 
@@ -23,6 +35,18 @@ VirtualFileSystem::~VirtualFileSystem() {
 
 bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
                                size_t cache_capacity) {
+  return format(image_path, size_mb, FormatOptions(), cache_capacity);
+}
+
+bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
+                               const FormatOptions &options,
+                               size_t cache_capacity) {
+  if (options.version != FORMAT_V1 && options.version != FORMAT_V2) {
+    std::cerr << "[VFS ERROR] format: Unsupported format version "
+              << options.version << "\n";
+    return false;
+  }
+
   std::unique_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (mounted_) {
@@ -31,7 +55,8 @@ bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
 
   uint64_t total_size = static_cast<uint64_t>(size_mb) * 1024 * 1024;
   uint32_t total_blocks = total_size / BLOCK_SIZE;
-  uint32_t total_inodes = total_blocks / 8;
+  uint32_t total_inodes =
+      options.total_inodes > 0 ? options.total_inodes : total_blocks / 8;
   if (total_inodes < 64)
     total_inodes = 64;
 
@@ -43,11 +68,17 @@ bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
   uint32_t inode_table_start = 1;
   uint32_t bitmap_start = inode_table_start + inode_blocks;
   uint32_t data_start = bitmap_start + bitmap_blocks;
+  if (data_start >= total_blocks) {
+    std::cerr << "[VFS ERROR] format: " << total_inodes
+              << " inodes do not fit in " << size_mb << "MB\n";
+    return false;
+  }
   uint32_t data_blocks = total_blocks - data_start;
 
   // Initialize superblock
   superblock_ = Superblock();
   superblock_.magic = MAGIC_NUMBER;
+  superblock_.version = options.version;
   superblock_.total_blocks = total_blocks;
   superblock_.total_inodes = total_inodes;
   superblock_.free_blocks = data_blocks - 1;
@@ -57,6 +88,7 @@ bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
   superblock_.data_block_start = data_start;
   superblock_.created_time = std::time(nullptr);
   superblock_.modified_time = superblock_.created_time;
+  superblock_.features = options.compact_dirs ? FEATURE_COMPACT_DIRS : 0;
 
   // 1. Create and physically fill the file
   std::ofstream ofs(image_path, std::ios::binary | std::ios::trunc);
@@ -85,7 +117,16 @@ bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
   root.atime = root.mtime = root.ctime = std::time(nullptr);
   root.links_count = 2;
   root.blocks_count = 1;
-  root.direct_blocks[0] = data_start;
+  if (options.version == FORMAT_V1) {
+    root.direct_blocks[0] = data_start;
+  } else {
+    ExtentRoot extents{};
+    extents.header = ExtentHeader{EXTENT_MAGIC, 1, INODE_EXTENTS, 0};
+    extents.entries[0] = Extent{0, data_start, 1};
+    std::memcpy(reinterpret_cast<char *>(&root) +
+                    offsetof(Inode, direct_blocks),
+                &extents, sizeof(extents));
+  }
 
   uint32_t inodes_per_block = BLOCK_SIZE / sizeof(Inode);
   uint32_t root_block_num = inode_table_start + (1 / inodes_per_block);
@@ -140,6 +181,13 @@ bool VirtualFileSystem::format(const std::string &image_path, uint32_t size_mb,
 
 bool VirtualFileSystem::mount(const std::string &image_path,
                               size_t cache_capacity) {
+  MountOptions options;
+  options.cache_capacity = cache_capacity;
+  return mount(image_path, options);
+}
+
+bool VirtualFileSystem::mount(const std::string &image_path,
+                              const MountOptions &options) {
   std::unique_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (mounted_) {
@@ -147,17 +195,35 @@ bool VirtualFileSystem::mount(const std::string &image_path,
   }
 
   // Open image file
-  image_file_.open(image_path, std::ios::in | std::ios::out | std::ios::binary);
-  if (!image_file_) {
+  device_ = open_block_device(image_path, options.backend);
+  if (!device_) {
     return false;
   }
 
   // Read superblock
-  image_file_.seekg(0);
-  image_file_.read(reinterpret_cast<char *>(&superblock_), sizeof(Superblock));
+  std::vector<char> super_block(BLOCK_SIZE);
+  if (!device_->ReadBlock(0, super_block.data())) {
+    device_.reset();
+    return false;
+  }
+  std::memcpy(&superblock_, super_block.data(), sizeof(Superblock));
 
-  if (superblock_.magic != MAGIC_NUMBER) {
-    image_file_.close();
+  if (superblock_.magic != MAGIC_NUMBER ||
+      superblock_.total_blocks > device_->NumBlocks()) {
+    device_.reset();
+    return false;
+  }
+  if (superblock_.version != FORMAT_V1 && superblock_.version != FORMAT_V2) {
+    std::cerr << "[VFS ERROR] mount: Unsupported format version "
+              << superblock_.version << "\n";
+    device_.reset();
+    return false;
+  }
+  if (superblock_.features & ~FEATURES_SUPPORTED) {
+    std::cerr << "[VFS ERROR] mount: Unsupported features 0x" << std::hex
+              << (superblock_.features & ~FEATURES_SUPPORTED) << std::dec
+              << "\n";
+    device_.reset();
     return false;
   }
 
@@ -174,64 +240,108 @@ bool VirtualFileSystem::mount(const std::string &image_path,
   std::vector<uint8_t> bitmap_data;
   for (uint32_t i = 0; i < bitmap_blocks; ++i) {
     std::vector<char> block(BLOCK_SIZE);
-    image_file_.seekg((superblock_.bitmap_block + i) * BLOCK_SIZE);
-    image_file_.read(block.data(), BLOCK_SIZE);
+    device_->ReadBlock(superblock_.bitmap_block + i, block.data());
     bitmap_data.insert(bitmap_data.end(), block.begin(), block.end());
   }
   bitmap_data.resize((data_blocks + 7) / 8);
   bitmap_->deserialize(bitmap_data);
 
   // Initialize cache
-  cache_ = std::make_unique<LRUCache>(cache_capacity);
+  cache_ = make_block_cache(options.cache_policy, options.cache_capacity,
+                            options.cache_shards);
+  inode_cache_ = std::make_unique<InodeCache>(options.inode_cache_capacity);
+  dentry_cache_ = std::make_unique<DentryCache>(options.dentry_cache_capacity);
+
+  // Mapped images are read straight from the mapping, which would not see
+  // blocks held back in the cache, so they always write through
+  write_back_ = options.write_back && device_->BlockData(0) == nullptr;
+  mount_options_ = options;
+
+  // A mapping needs no readahead: the kernel already does it for us
+  readahead_max_ = device_->BlockData(0) == nullptr
+                       ? std::min<uint32_t>(options.readahead_blocks,
+                                            options.cache_capacity / 4)
+                       : 0;
 
   image_path_ = image_path;
   journal_path_ = image_path_ + ".journal";
   checksum_path_ = image_path_ + ".checksum";
   load_checksums();
-  replay_journal();
+  // Unjournaled writes could be torn by a crash, so no journal, no mount
+  if (!open_journal()) {
+    std::cerr << "[VFS ERROR] Failed to open journal " << journal_path_
+              << "\n";
+    device_.reset();
+    return false;
+  }
+  if (!load_inode_bitmap()) {
+    std::cerr << "[VFS ERROR] Failed to read inode table\n";
+    close_journal();
+    device_.reset();
+    return false;
+  }
   load_snapshots();
   mounted_ = true;
 
+  // Lazytime inodes are flushed by the same thread
+  if (write_back_ || options.lazytime) {
+    start_flusher();
+  }
+
   return true;
 }
 
 void VirtualFileSystem::unmount() {
+  // The flusher takes fs_mutex_ shared, so it must be gone before we wait
+  // for the exclusive lock
+  stop_flusher();
+
   std::unique_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return;
   }
 
+  // In-flight prefetches still reference the device and the cache
+  wait_for_readahead();
+
+  // Dirty inodes become dirty table blocks first
+  flush_inodes();
+
+  if (write_back_) {
+    writeback_dirty(true);
+    std::lock_guard<std::mutex> dirty_lock(dirty_mutex_);
+    dirty_blocks_.clear();
+  }
+
   // Write superblock
   superblock_.modified_time = std::time(nullptr);
-  image_file_.seekp(0);
-  image_file_.write(reinterpret_cast<const char *>(&superblock_),
-                    sizeof(Superblock));
+  write_superblock();
 
   // Write bitmap
   auto bitmap_data = bitmap_->serialize();
   uint32_t bitmap_blocks = (bitmap_data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
   for (uint32_t i = 0; i < bitmap_blocks; ++i) {
-    image_file_.seekp((superblock_.bitmap_block + i) * BLOCK_SIZE);
     size_t offset = i * BLOCK_SIZE;
     size_t to_write =
         std::min(static_cast<size_t>(BLOCK_SIZE), bitmap_data.size() - offset);
-    if (to_write > 0) {
-      image_file_.write(
-          reinterpret_cast<const char *>(bitmap_data.data() + offset),
-          to_write);
-    }
+    std::vector<char> block(BLOCK_SIZE, 0);
+    std::memcpy(block.data(), bitmap_data.data() + offset, to_write);
+    device_->WriteBlock(superblock_.bitmap_block + i, block.data());
   }
 
   save_checksums();
-  flush_and_clear_journal();
+  // Checkpoints what is left and stops the checkpointer
+  close_journal();
 
   // Close file handles
   fd_table_.clear();
-  image_file_.close();
+  device_.reset();
 
   // Clear cache
   cache_->clear();
+  inode_cache_->clear();
+  dentry_cache_->clear();
 
   mounted_ = false;
 }
@@ -239,30 +349,53 @@ void VirtualFileSystem::unmount() {
 // Block-level I/O
 bool VirtualFileSystem::read_block(uint32_t block_num,
                                    std::vector<char> &data) {
-  if (data.size() != BLOCK_SIZE) {
-    data.resize(BLOCK_SIZE);
+  BlockHandle handle;
+  if (!read_block(block_num, handle)) {
+    return false;
   }
+  data.assign(handle.data(), handle.data() + BLOCK_SIZE);
+  return true;
+}
 
-  // Check cache first
-  if (cache_->get(block_num, data)) {
+bool VirtualFileSystem::read_block(uint32_t block_num, BlockHandle &handle) {
+  // A memory-mapped image is its own cache: hand out a view of the mapping
+  // rather than duplicating the block in the block cache.
+  if (const char *mapped = device_->BlockData(block_num)) {
+    handle = BlockHandle::view(mapped);
     return true;
   }
 
-  // Read from disk
-  uint64_t offset = static_cast<uint64_t>(block_num) * BLOCK_SIZE;
-  image_file_.clear(); // CRITICAL: Clear error flags
-  image_file_.seekg(offset);
-  image_file_.read(data.data(), BLOCK_SIZE);
+  // Check cache first; a hit pins the cached buffer without copying it
+  handle = cache_->get(block_num);
+  if (handle) {
+    return true;
+  }
 
-  if (!image_file_) {
+  // Read from disk into a fresh buffer that the cache then adopts. The
+  // disk read and the cache fill happen under the block's I/O lock so a
+  // concurrent write_block cannot be overwritten by stale data.
+  std::lock_guard<std::mutex> io_lock(block_io_lock(block_num));
+  if (write_back_) {
+    // Dirty but uncached (every cache slot was pinned): the device copy
+    // is stale
+    handle = find_dirty(block_num);
+    if (handle) {
+      return true;
+    }
+  }
+  BlockBuffer *buffer = BlockBuffer::create();
+  handle = BlockHandle::adopt(buffer);
+  if (!device_->ReadBlock(block_num, buffer->data)) {
     std::cerr << "[VFS ERROR] read_block: Failed to read block " << block_num
-              << " at offset " << offset << "\n";
+              << " at offset "
+              << static_cast<uint64_t>(block_num) * BLOCK_SIZE << "\n";
+    handle.reset();
     return false;
   }
 
   if (block_num < block_checksums_.size() && block_checksums_[block_num] != 0) {
     uint32_t expect = block_checksums_[block_num];
-    uint32_t got = calc_checksum(data);
+    uint32_t got = calc_checksum(buffer->data, BLOCK_SIZE);
     if (expect != got) {
       std::cerr << "[VFS WARN] Checksum mismatch on block " << block_num
                 << " expect " << expect << " got " << got << "\n";
@@ -270,7 +403,7 @@ bool VirtualFileSystem::read_block(uint32_t block_num,
   }
 
   // Update cache
-  cache_->put(block_num, data);
+  cache_->put(block_num, handle);
 
   return true;
 }
@@ -280,63 +413,238 @@ bool VirtualFileSystem::write_block(uint32_t block_num,
   if (data.size() != BLOCK_SIZE) {
     return false;
   }
+  return write_block(block_num, data.data());
+}
 
-  // Capture original block for snapshots
-  std::vector<char> original;
-  if (!snapshots_.empty()) {
-    read_block(block_num, original);
-  }
+bool VirtualFileSystem::write_block(uint32_t block_num, const char *data) {
+  return write_blocks(&block_num, &data, 1);
+}
 
-  append_journal_entry(block_num, data);
+bool VirtualFileSystem::read_blocks(const uint32_t *block_nums,
+                                    char *const *outs, size_t count) {
+  // Misses are collected on the stack and sent to the device as one batch
+  // per READ_BATCH blocks
+  std::array<uint32_t, READ_BATCH> miss_blocks;
+  std::array<void *, READ_BATCH> miss_outs;
+  size_t misses = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (const char *mapped = device_->BlockData(block_nums[i])) {
+      std::lock_guard<std::mutex> io_lock(block_io_lock(block_nums[i]));
+      std::memcpy(outs[i], mapped, BLOCK_SIZE);
+    } else if (!cache_->get(block_nums[i], outs[i])) {
+      miss_blocks[misses] = block_nums[i];
+      miss_outs[misses] = outs[i];
+      misses++;
+    }
 
-  // Write to disk
-  uint64_t offset = static_cast<uint64_t>(block_num) * BLOCK_SIZE;
-  image_file_.clear(); // Clear any error flags
-  image_file_.seekp(offset);
-  image_file_.write(data.data(), BLOCK_SIZE);
-  image_file_.flush(); // Force write to OS buffer
+    if (misses == READ_BATCH || (i + 1 == count && misses > 0)) {
+      if (!read_missed_blocks(miss_blocks.data(), miss_outs.data(), misses)) {
+        return false;
+      }
+      misses = 0;
+    }
+  }
+  return true;
+}
 
-  if (!image_file_) {
-    std::cerr << "[VFS ERROR] write_block: Failed to write block " << block_num
-              << "\n";
+bool VirtualFileSystem::read_missed_blocks(const uint32_t *block_nums,
+                                           void *const *outs, size_t count) {
+  BlockStripeGuard io_locks(*this, block_nums, count);
+
+  // Blocks still dirty in memory are newer than the device; read only the
+  // others
+  std::array<uint32_t, READ_BATCH> device_blocks;
+  std::array<void *, READ_BATCH> device_outs;
+  if (write_back_ && count <= READ_BATCH) {
+    size_t n = 0;
+    std::lock_guard<std::mutex> dirty_lock(dirty_mutex_);
+    for (size_t i = 0; i < count; ++i) {
+      auto it = dirty_blocks_.find(block_nums[i]);
+      if (it != dirty_blocks_.end()) {
+        std::memcpy(outs[i], it->second.data.data(), BLOCK_SIZE);
+      } else {
+        device_blocks[n] = block_nums[i];
+        device_outs[n] = outs[i];
+        n++;
+      }
+    }
+    block_nums = device_blocks.data();
+    outs = device_outs.data();
+    count = n;
+  }
+  if (count == 0) {
+    return true;
+  }
+
+  if (!device_->ReadBlocks(block_nums, outs, count)) {
+    std::cerr << "[VFS ERROR] read_blocks: Failed to read " << count
+              << " blocks starting at " << block_nums[0] << "\n";
     return false;
   }
 
-  if (block_num < block_checksums_.size()) {
-    block_checksums_[block_num] = calc_checksum(data);
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t block_num = block_nums[i];
+    const char *data = static_cast<const char *>(outs[i]);
+    if (block_num < block_checksums_.size() &&
+        block_checksums_[block_num] != 0) {
+      uint32_t expect = block_checksums_[block_num];
+      uint32_t got = calc_checksum(data, BLOCK_SIZE);
+      if (expect != got) {
+        std::cerr << "[VFS WARN] Checksum mismatch on block " << block_num
+                  << " expect " << expect << " got " << got << "\n";
+      }
+    }
+    cache_->put(block_num, data);
   }
 
+  return true;
+}
+
+bool VirtualFileSystem::write_blocks(const uint32_t *block_nums,
+                                     const char *const *datas, size_t count,
+                                     bool file_data) {
+  if (count == 0) {
+    return true;
+  }
+  // Larger batches become several journal transactions
+  if (count > JOURNAL_MAX_TX_BLOCKS) {
+    return write_blocks(block_nums, datas, JOURNAL_MAX_TX_BLOCKS,
+                        file_data) &&
+           write_blocks(block_nums + JOURNAL_MAX_TX_BLOCKS,
+                        datas + JOURNAL_MAX_TX_BLOCKS,
+                        count - JOURNAL_MAX_TX_BLOCKS, file_data);
+  }
+
+  // Capture original blocks for snapshots
+  std::vector<std::vector<char>> originals;
   if (!snapshots_.empty()) {
-    snapshot_record_block(block_num, original);
+    originals.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      read_block(block_nums[i], originals[i]);
+    }
   }
 
-  // Update cache
-  cache_->put(block_num, data);
+  if (write_back_) {
+    // Journal and device writes are left to the flusher
+    bool ok = mark_dirty(block_nums, datas, count, file_data);
+    if (!snapshots_.empty()) {
+      for (size_t i = 0; i < count; ++i) {
+        snapshot_record_block(block_nums[i], originals[i]);
+      }
+    }
+    return ok;
+  }
+
+  // Each batch is one transaction: committed before it is written in
+  // place. Unjournaled file data goes straight to the image, and the next
+  // commit flushes it there first. An operation that writes several
+  // batches is not atomic as a whole; callers write referenced blocks
+  // before the blocks that refer to them.
+  JournalTx tx;
+  bool journaled = journals(file_data);
+  if (journaled && !begin_tx(tx, count)) {
+    return false;
+  }
+  if (!commit_tx(tx, block_nums, datas)) {
+    end_tx(tx);
+    return false;
+  }
+
+  // Write to disk as one batch
+  {
+    BlockStripeGuard io_locks(*this, block_nums, count);
+    bool written = device_->WriteBlocks(
+        block_nums, reinterpret_cast<const void *const *>(datas), count);
+    end_tx(tx);
+    if (written && !journaled) {
+      note_ordered_data(count);
+    }
+    if (!written) {
+      std::cerr << "[VFS ERROR] write_blocks: Failed to write " << count
+                << " blocks starting at " << block_nums[0] << "\n";
+      for (size_t i = 0; i < count; ++i) {
+        cache_->invalidate(block_nums[i]);
+      }
+      return false;
+    }
+
+    cancel_readahead(block_nums, count);
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t block_num = block_nums[i];
+      if (block_num < block_checksums_.size()) {
+        block_checksums_[block_num] = calc_checksum(datas[i], BLOCK_SIZE);
+      }
+
+      // Update cache (mapped blocks are read from the mapping)
+      if (device_->BlockData(block_num) == nullptr) {
+        cache_->put(block_num, datas[i]);
+      }
+    }
+  }
+
+  if (!snapshots_.empty()) {
+    for (size_t i = 0; i < count; ++i) {
+      snapshot_record_block(block_nums[i], originals[i]);
+    }
+  }
 
   return true;
 }
 
+VirtualFileSystem::BlockStripeGuard::BlockStripeGuard(
+    VirtualFileSystem &vfs, const uint32_t *block_nums, size_t count)
+    : vfs_(vfs), stripes_(0) {
+  for (size_t i = 0; i < count; ++i) {
+    stripes_ |= uint64_t(1) << (block_nums[i] % BLOCK_IO_STRIPES);
+  }
+  // Always lock stripes in ascending order so batches cannot deadlock
+  for (size_t s = 0; s < BLOCK_IO_STRIPES; ++s) {
+    if (stripes_ & (uint64_t(1) << s)) {
+      vfs_.block_io_mutex_[s].lock();
+    }
+  }
+}
+
+VirtualFileSystem::BlockStripeGuard::~BlockStripeGuard() {
+  for (size_t s = 0; s < BLOCK_IO_STRIPES; ++s) {
+    if (stripes_ & (uint64_t(1) << s)) {
+      vfs_.block_io_mutex_[s].unlock();
+    }
+  }
+}
+
 // Inode operations
 bool VirtualFileSystem::read_inode(uint32_t inode_num, Inode &inode) {
   if (inode_num >= superblock_.total_inodes) {
-    std::cerr << "[VFS DEBUG] read_inode: Inode " << inode_num
-              << " out of bounds (" << superblock_.total_inodes << ")\n";
+    VFS_DEBUG("read_inode: Inode " << inode_num << " out of bounds ("
+                                   << superblock_.total_inodes << ")");
     return false;
   }
 
+  if (inode_cache_->get(inode_num, inode)) {
+    return true;
+  }
+
   uint32_t inodes_per_block = BLOCK_SIZE / sizeof(Inode);
   uint32_t block_num =
       superblock_.inode_table_block + (inode_num / inodes_per_block);
   uint32_t offset_in_block = (inode_num % inodes_per_block) * sizeof(Inode);
 
-  std::vector<char> block_data;
-  if (!read_block(block_num, block_data)) {
-    std::cerr << "[VFS DEBUG] read_inode: Failed to read block " << block_num
-              << " for inode " << inode_num << "\n";
+  // A miss reads the table under the same lock as writers and write-back,
+  // so it never sees a block that is about to receive a cached inode.
+  // Only the 128-byte inode is copied out of the pinned table block.
+  std::lock_guard<std::mutex> lock(itable_mutex_);
+  BlockHandle block;
+  if (!read_block(block_num, block)) {
+    VFS_DEBUG("read_inode: Failed to read block " << block_num
+                                                    << " for inode "
+                                                    << inode_num);
     return false;
   }
 
-  std::memcpy(&inode, block_data.data() + offset_in_block, sizeof(Inode));
+  std::memcpy(&inode, block.data() + offset_in_block, sizeof(Inode));
+  inode_cache_->fill(inode_num, inode);
   return true;
 }
 
@@ -345,53 +653,173 @@ bool VirtualFileSystem::write_inode(uint32_t inode_num, const Inode &inode) {
     return false;
   }
 
+  // With write-back caching the table block is only touched when dirty
+  // inodes are flushed
+  if (write_back_) {
+    inode_cache_->put(inode_num, inode, true);
+    return true;
+  }
+
   uint32_t inodes_per_block = BLOCK_SIZE / sizeof(Inode);
   uint32_t block_num =
       superblock_.inode_table_block + (inode_num / inodes_per_block);
   uint32_t offset_in_block = (inode_num % inodes_per_block) * sizeof(Inode);
 
-  std::vector<char> block_data;
-  if (!read_block(block_num, block_data)) {
+  // Inodes share table blocks, so the read-modify-write must not interleave
+  // with another thread updating a neighbouring inode.
+  std::lock_guard<std::mutex> lock(itable_mutex_);
+  ScratchBlock block_data;
+  BlockHandle current;
+  if (!read_block(block_num, current)) {
     return false;
   }
+  std::memcpy(block_data.data(), current.data(), BLOCK_SIZE);
+  current.reset();
 
   std::memcpy(block_data.data() + offset_in_block, &inode, sizeof(Inode));
 
-  if (!write_block(block_num, block_data)) {
+  if (!write_block(block_num, block_data.data())) {
     return false;
   }
+  inode_cache_->put(inode_num, inode, false);
 
   // std::cerr << "[VFS DEBUG] write_inode: Successfully wrote inode " <<
   // inode_num << " to block " << block_num << "\n";
   return true;
 }
 
-uint32_t VirtualFileSystem::allocate_inode() {
-  // Find free inode, skip 0 (NULL) and 1 (ROOT)
-  for (uint32_t i = 2; i < superblock_.total_inodes; ++i) {
-    Inode inode;
-    if (read_inode(i, inode) && inode.mode == 0) {
-      if (superblock_.free_inodes > 0) {
-        superblock_.free_inodes--;
+void VirtualFileSystem::update_atime(uint32_t inode_num, Inode &inode) {
+  uint64_t now = std::time(nullptr);
+  switch (mount_options_.atime_mode) {
+  case AtimeMode::NOATIME:
+    return;
+  case AtimeMode::RELATIME:
+    if (inode.atime > inode.mtime && inode.atime > inode.ctime &&
+        now < inode.atime + 24 * 60 * 60) {
+      return;
+    }
+    break;
+  case AtimeMode::STRICT:
+    break;
+  }
+
+  inode.atime = now;
+  if (mount_options_.lazytime) {
+    inode_cache_->put(inode_num, inode, true);
+  } else {
+    write_inode(inode_num, inode);
+  }
+}
+
+bool VirtualFileSystem::flush_inodes() {
+  std::lock_guard<std::mutex> lock(itable_mutex_);
+  std::vector<std::pair<uint32_t, Inode>> dirty;
+  inode_cache_->take_dirty(dirty);
+
+  // Sorted by inode number, so each table block is rewritten once
+  const uint32_t inodes_per_block = BLOCK_SIZE / sizeof(Inode);
+  ScratchBlock block_data;
+  size_t i = 0;
+  while (i < dirty.size()) {
+    size_t first = i;
+    uint32_t table_index = dirty[i].first / inodes_per_block;
+    uint32_t block_num = superblock_.inode_table_block + table_index;
+
+    BlockHandle current;
+    bool ok = read_block(block_num, current);
+    if (ok) {
+      std::memcpy(block_data.data(), current.data(), BLOCK_SIZE);
+      current.reset();
+    }
+    for (; i < dirty.size() && dirty[i].first / inodes_per_block == table_index;
+         ++i) {
+      std::memcpy(block_data.data() +
+                      (dirty[i].first % inodes_per_block) * sizeof(Inode),
+                  &dirty[i].second, sizeof(Inode));
+    }
+
+    if (!ok || !write_block(block_num, block_data.data())) {
+      std::cerr << "[VFS ERROR] flush_inodes: Failed to write inode block "
+                << block_num << "\n";
+      for (size_t j = first; j < dirty.size(); ++j) {
+        inode_cache_->redirty(dirty[j].first, dirty[j].second);
       }
-      return i;
+      return false;
     }
   }
-  return static_cast<uint32_t>(-1);
+  return true;
+}
+
+bool VirtualFileSystem::load_inode_bitmap() {
+  // Replay writes straight to the device, so read the table from there
+  // rather than pulling every inode block through the cache
+  const uint32_t total = superblock_.total_inodes;
+  const uint32_t per_block = BLOCK_SIZE / sizeof(Inode);
+  std::vector<uint8_t> used((total + 7) / 8, 0);
+  ScratchBlock block;
+  for (uint32_t b = 0; b * per_block < total; ++b) {
+    if (!device_->ReadBlock(superblock_.inode_table_block + b, block.data())) {
+      return false;
+    }
+    const Inode *inodes = reinterpret_cast<const Inode *>(block.data());
+    for (uint32_t j = 0; j < per_block && b * per_block + j < total; ++j) {
+      uint32_t inode_num = b * per_block + j;
+      // 0 (NULL) and 1 (ROOT) are always reserved
+      if (inode_num < 2 || inodes[j].mode != 0) {
+        used[inode_num / 8] |= static_cast<uint8_t>(1u << (inode_num % 8));
+      }
+    }
+  }
+
+  inode_bitmap_ = std::make_unique<Bitmap>(total);
+  inode_bitmap_->deserialize(used);
+  superblock_.free_inodes = inode_bitmap_->get_free_count();
+  return true;
+}
+
+uint32_t VirtualFileSystem::allocate_inode(uint32_t mode) {
+  std::lock_guard<std::mutex> lock(alloc_mutex_);
+
+  int32_t i = inode_bitmap_->allocate();
+  if (i < 0) {
+    return static_cast<uint32_t>(-1);
+  }
+
+  // Claim the slot before releasing the allocator lock so a concurrent
+  // create cannot hand out the same inode.
+  Inode claimed;
+  claimed.inode_num = i;
+  claimed.mode = mode;
+  if (!write_inode(i, claimed)) {
+    inode_bitmap_->free(i);
+    return static_cast<uint32_t>(-1);
+  }
+  if (superblock_.free_inodes > 0) {
+    superblock_.free_inodes--;
+  }
+  return i;
 }
 
 bool VirtualFileSystem::free_inode(uint32_t inode_num) {
+  std::lock_guard<std::mutex> lock(alloc_mutex_);
+
   Inode inode;
   inode = Inode();
   if (write_inode(inode_num, inode)) {
+    inode_bitmap_->free(inode_num);
     superblock_.free_inodes++;
     return true;
   }
   return false;
 }
 
-uint32_t VirtualFileSystem::allocate_block() {
-  int32_t block_num = bitmap_->allocate();
+uint32_t VirtualFileSystem::allocate_block(uint32_t goal) {
+  std::lock_guard<std::mutex> lock(alloc_mutex_);
+
+  // Without a goal the bitmap continues after its previous allocation
+  uint32_t data_start = superblock_.data_block_start;
+  int32_t block_num = goal > data_start ? bitmap_->allocate(goal - data_start)
+                                        : bitmap_->allocate();
   if (block_num >= 0) {
     superblock_.free_blocks--;
     return superblock_.data_block_start + block_num;
@@ -399,20 +827,50 @@ uint32_t VirtualFileSystem::allocate_block() {
   return static_cast<uint32_t>(-1);
 }
 
+uint32_t VirtualFileSystem::allocate_range(uint32_t count, uint32_t goal,
+                                           uint32_t &length) {
+  std::lock_guard<std::mutex> lock(alloc_mutex_);
+
+  uint32_t data_start = superblock_.data_block_start;
+  int32_t block_num = bitmap_->allocate_range(
+      count, goal > data_start ? goal - data_start : UINT32_MAX, length);
+  if (block_num >= 0) {
+    superblock_.free_blocks -= length;
+    return data_start + block_num;
+  }
+  return static_cast<uint32_t>(-1);
+}
+
 bool VirtualFileSystem::free_block(uint32_t block_num) {
   if (block_num < superblock_.data_block_start) {
     return false;
   }
 
+  std::lock_guard<std::mutex> lock(alloc_mutex_);
   uint32_t data_block = block_num - superblock_.data_block_start;
   if (bitmap_->free(data_block)) {
     superblock_.free_blocks++;
+    cancel_readahead(&block_num, 1);
     cache_->invalidate(block_num);
+    if (write_back_) {
+      // Contents of a freed block never need to reach the device
+      std::lock_guard<std::mutex> dirty_lock(dirty_mutex_);
+      dirty_blocks_.erase(block_num);
+    }
     return true;
   }
   return false;
 }
 
+bool VirtualFileSystem::write_superblock() {
+  // The superblock shares block 0 with nothing else, but keep the tail of
+  // the block intact in case it was written by a newer version.
+  std::vector<char> block(BLOCK_SIZE, 0);
+  device_->ReadBlock(0, block.data());
+  std::memcpy(block.data(), &superblock_, sizeof(Superblock));
+  return device_->WriteBlock(0, block.data());
+}
+
 void VirtualFileSystem::init_root_directory() {
   // 1. Initialize Inode 0 as NULL/Reserved
   Inode null_inode;
@@ -431,11 +889,10 @@ void VirtualFileSystem::init_root_directory() {
   root.links_count = 2; // . and ..
 
   // Allocate the first block for root directory entries
-  uint32_t block_num = allocate_block();
-  if (block_num != static_cast<uint32_t>(-1)) {
-    root.direct_blocks[0] = block_num;
-    root.blocks_count = 1;
-
+  MapPath map;
+  bool fresh = false;
+  uint32_t block_num = map_block_for_write(root, 0, map, fresh);
+  if (block_num != 0) {
     // Initialize root directory block with zero entries
     std::vector<char> zero_block(BLOCK_SIZE, 0);
     write_block(block_num, zero_block);
@@ -448,16 +905,15 @@ void VirtualFileSystem::init_root_directory() {
   superblock_.modified_time = std::time(nullptr);
 
   // 4. Force write superblock and flush everything
-  image_file_.seekp(0);
-  image_file_.write(reinterpret_cast<const char *>(&superblock_),
-                    sizeof(Superblock));
-  image_file_.flush();
+  write_superblock();
+  device_->Flush();
 
   std::cout << "[VFS] Root directory (Inode 1) initialized successfully.\n";
 }
 
 FileSystemStats VirtualFileSystem::get_fs_stats() const {
   std::shared_lock<std::shared_mutex> lock(fs_mutex_);
+  std::lock_guard<std::mutex> alloc_lock(alloc_mutex_);
 
   FileSystemStats stats;
   stats.total_blocks = superblock_.total_blocks;
@@ -469,6 +925,7 @@ FileSystemStats VirtualFileSystem::get_fs_stats() const {
   stats.used_size = static_cast<uint64_t>(superblock_.total_blocks -
                                           superblock_.free_blocks) *
                     BLOCK_SIZE;
+  bitmap_->get_free_extents(stats.free_extents, stats.largest_free_extent);
 
   return stats;
 }
@@ -477,14 +934,27 @@ CacheStats VirtualFileSystem::get_cache_stats() const {
   return cache_->get_stats();
 }
 
+CacheStats VirtualFileSystem::get_inode_cache_stats() const {
+  return inode_cache_->get_stats();
+}
+
+CacheStats VirtualFileSystem::get_dentry_cache_stats() const {
+  return dentry_cache_->get_stats();
+}
+
 VirtualFileSystem::JournalStats VirtualFileSystem::get_journal_stats() const {
+  std::lock_guard<std::mutex> lock(journal_mutex_);
   return journal_stats_;
 }
 
 uint32_t VirtualFileSystem::calc_checksum(const std::vector<char> &data) const {
+  return calc_checksum(data.data(), data.size());
+}
+
+uint32_t VirtualFileSystem::calc_checksum(const char *data, size_t size) const {
   uint32_t h = 0;
-  for (unsigned char c : data) {
-    h = (h * 131) + c;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h * 131) + static_cast<unsigned char>(data[i]);
   }
   return h;
 }
@@ -514,82 +984,6 @@ void VirtualFileSystem::save_checksums() {
             block_checksums_.size() * sizeof(uint32_t));
 }
 
-bool VirtualFileSystem::append_journal_entry(uint32_t block_num,
-                                             const std::vector<char> &data) {
-  if (journal_path_.empty()) {
-    return false;
-  }
-  std::ofstream jf(journal_path_, std::ios::binary | std::ios::app);
-  if (!jf) {
-    return false;
-  }
-  uint32_t size = static_cast<uint32_t>(data.size());
-  uint32_t checksum = calc_checksum(data);
-  jf.write(reinterpret_cast<const char *>(&block_num), sizeof(block_num));
-  jf.write(reinterpret_cast<const char *>(&size), sizeof(size));
-  jf.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
-  jf.write(data.data(), data.size());
-  jf.flush();
-  journal_stats_.pending++;
-  journal_stats_.dirty = true;
-  return jf.good();
-}
-
-bool VirtualFileSystem::replay_journal() {
-  if (journal_path_.empty()) {
-    return true;
-  }
-  std::ifstream jf(journal_path_, std::ios::binary);
-  if (!jf) {
-    return true; // No journal to replay
-  }
-
-  while (jf) {
-    uint32_t block_num = 0;
-    uint32_t size = 0;
-    uint32_t checksum = 0;
-    jf.read(reinterpret_cast<char *>(&block_num), sizeof(block_num));
-    jf.read(reinterpret_cast<char *>(&size), sizeof(size));
-    jf.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
-    if (!jf) {
-      break;
-    }
-    if (size != BLOCK_SIZE) {
-      break;
-    }
-    std::vector<char> data(size);
-    jf.read(data.data(), size);
-    if (!jf) {
-      break;
-    }
-    if (calc_checksum(data) != checksum) {
-      std::cerr << "[JOURNAL] checksum mismatch, skipping entry\n";
-      continue;
-    }
-    uint64_t offset = static_cast<uint64_t>(block_num) * BLOCK_SIZE;
-    image_file_.seekp(offset);
-    image_file_.write(data.data(), BLOCK_SIZE);
-    journal_stats_.replayed++;
-  }
-
-  image_file_.flush();
-  flush_and_clear_journal();
-  if (journal_stats_.replayed > 0) {
-    journal_stats_.recovered = true;
-  }
-  return true;
-}
-
-bool VirtualFileSystem::flush_and_clear_journal() {
-  if (journal_path_.empty()) {
-    return true;
-  }
-  std::ofstream clear(journal_path_, std::ios::trunc);
-  journal_stats_.pending = 0;
-  journal_stats_.dirty = false;
-  return clear.good();
-}
-
 void VirtualFileSystem::load_snapshots() {
   snapshots_.clear();
   if (image_path_.empty())
@@ -641,6 +1035,7 @@ bool VirtualFileSystem::snapshot_record_block(
   if (data.size() != BLOCK_SIZE) {
     data.assign(BLOCK_SIZE, 0);
   }
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
   for (auto &kv : snapshots_) {
     auto &meta = kv.second;
     if (meta.blocks.find(block_num) != meta.blocks.end()) {
@@ -0,0 +1,646 @@
+#include "filesystem/vfs.h"
+#include "filesystem/vfs_log.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace vfs {
+
+namespace {
+
+constexpr size_t SLOTS_PER_BLOCK = BLOCK_SIZE / sizeof(DirEntry);
+constexpr size_t MAX_LEAF_ENTRIES = BLOCK_SIZE / sizeof(DirRecord);
+
+// FNV-1a
+uint32_t name_hash(const char *name, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool is_index_block(const char *data) {
+  uint32_t magic;
+  std::memcpy(&magic, data, sizeof(magic));
+  return magic == DIR_INDEX_MAGIC;
+}
+
+DirIndexHeader *index_header(char *data) {
+  return reinterpret_cast<DirIndexHeader *>(data);
+}
+
+const DirIndexHeader *index_header(const char *data) {
+  return reinterpret_cast<const DirIndexHeader *>(data);
+}
+
+DirIndexEntry *index_entries(char *data) {
+  return reinterpret_cast<DirIndexEntry *>(data + sizeof(DirIndexHeader));
+}
+
+const DirIndexEntry *index_entries(const char *data) {
+  return reinterpret_cast<const DirIndexEntry *>(data +
+                                                 sizeof(DirIndexHeader));
+}
+
+void init_index_block(char *data) {
+  std::memset(data, 0, BLOCK_SIZE);
+  DirIndexHeader *header = index_header(data);
+  header->magic = DIR_INDEX_MAGIC;
+  header->limit = DIR_INDEX_ENTRIES;
+}
+
+// The entry covering hash: the last one whose hash is not above it
+uint32_t index_slot(const char *data, uint32_t hash) {
+  const DirIndexEntry *entries = index_entries(data);
+  const DirIndexEntry *end = entries + index_header(data)->count;
+  const DirIndexEntry *it =
+      std::upper_bound(entries + 1, end, hash,
+                       [](uint32_t h, const DirIndexEntry &e) {
+                         return h < e.hash;
+                       });
+  return static_cast<uint32_t>(it - entries) - 1;
+}
+
+void index_insert(char *data, uint32_t pos, uint32_t hash, uint32_t block) {
+  DirIndexHeader *header = index_header(data);
+  DirIndexEntry *entries = index_entries(data);
+  std::memmove(entries + pos + 1, entries + pos,
+               (header->count - pos) * sizeof(DirIndexEntry));
+  entries[pos] = {hash, block};
+  header->count++;
+}
+
+// ----- Leaf blocks -----
+// A leaf holds either fixed DirEntry slots or packed DirRecords. Entries
+// are addressed by byte offset; both formats start with the inode number.
+// An all-zero block is an empty leaf in both.
+
+const DirEntry *slot_at(const char *data, size_t slot) {
+  return reinterpret_cast<const DirEntry *>(data + slot * sizeof(DirEntry));
+}
+
+DirRecord *record_at(char *data, size_t offset) {
+  return reinterpret_cast<DirRecord *>(data + offset);
+}
+
+const DirRecord *record_at(const char *data, size_t offset) {
+  return reinterpret_cast<const DirRecord *>(data + offset);
+}
+
+uint32_t entry_size(bool compact, size_t name_len) {
+  return compact ? dir_record_size(name_len) : sizeof(DirEntry);
+}
+
+uint32_t entry_inode(const char *data, size_t offset) {
+  uint32_t inode_num;
+  std::memcpy(&inode_num, data + offset, sizeof(inode_num));
+  return inode_num;
+}
+
+// Calls fn(offset, view) for every live entry. A record that does not fit
+// its block ends the walk rather than running off the end.
+template <typename Fn>
+void for_each_entry(const char *data, bool compact, Fn fn) {
+  if (!compact) {
+    for (size_t slot = 0; slot < SLOTS_PER_BLOCK; ++slot) {
+      const DirEntry *entry = slot_at(data, slot);
+      if (entry->inode_num != 0) {
+        fn(slot * sizeof(DirEntry),
+           DirEntryView{{entry->name, entry->name_len},
+                        entry->inode_num,
+                        name_hash(entry->name, entry->name_len),
+                        entry->file_type});
+      }
+    }
+    return;
+  }
+  for (size_t offset = 0; offset + sizeof(DirRecord) <= BLOCK_SIZE;) {
+    const DirRecord *record = record_at(data, offset);
+    if (record->rec_len < sizeof(DirRecord) ||
+        offset + record->rec_len > BLOCK_SIZE ||
+        dir_record_size(record->name_len) > record->rec_len) {
+      return;
+    }
+    if (record->inode_num != 0) {
+      const char *name = data + offset + sizeof(DirRecord);
+      fn(offset, DirEntryView{{name, record->name_len}, record->inode_num,
+                              record->hash, record->file_type});
+    }
+    offset += record->rec_len;
+  }
+}
+
+// Offset of the entry holding `name`, or -1. Records compare the stored
+// hash before the name.
+int find_entry(const char *data, bool compact, std::string_view name,
+               uint32_t hash) {
+  if (!compact) {
+    for (size_t slot = 0; slot < SLOTS_PER_BLOCK; ++slot) {
+      const DirEntry *entry = slot_at(data, slot);
+      if (entry->inode_num != 0 && entry->name_len == name.size() &&
+          std::memcmp(entry->name, name.data(), name.size()) == 0) {
+        return static_cast<int>(slot * sizeof(DirEntry));
+      }
+    }
+    return -1;
+  }
+  int found = -1;
+  for_each_entry(data, true, [&](size_t offset, const DirEntryView &entry) {
+    if (found < 0 && entry.hash == hash && entry.name == name) {
+      found = static_cast<int>(offset);
+    }
+  });
+  return found;
+}
+
+// Adds entry to the leaf, false if it has no room
+bool insert_entry(char *data, bool compact, const DirEntryView &entry) {
+  if (!compact) {
+    for (size_t slot = 0; slot < SLOTS_PER_BLOCK; ++slot) {
+      DirEntry *dst = reinterpret_cast<DirEntry *>(data + slot * sizeof(DirEntry));
+      if (dst->inode_num == 0) {
+        *dst = DirEntry();
+        dst->inode_num = entry.inode_num;
+        dst->name_len = entry.name.size();
+        dst->file_type = entry.file_type;
+        std::memcpy(dst->name, entry.name.data(), entry.name.size());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // First fit: an unused record, the slack behind a live one, or the free
+  // tail of the block
+  uint32_t need = dir_record_size(entry.name.size());
+  size_t offset = 0;
+  size_t at = 0;
+  uint32_t rec_len = 0;
+  while (offset + sizeof(DirRecord) <= BLOCK_SIZE) {
+    DirRecord *record = record_at(data, offset);
+    if (record->rec_len == 0) {
+      if (BLOCK_SIZE - offset < need) {
+        return false;
+      }
+      at = offset;
+      rec_len = BLOCK_SIZE - offset;
+      break;
+    }
+    if (record->rec_len < sizeof(DirRecord) ||
+        offset + record->rec_len > BLOCK_SIZE) {
+      return false; // corrupt
+    }
+    uint32_t used =
+        record->inode_num != 0 ? dir_record_size(record->name_len) : 0;
+    if (record->rec_len - used >= need) {
+      at = offset + used;
+      rec_len = record->rec_len - used;
+      if (used != 0) {
+        record->rec_len = used;
+      }
+      break;
+    }
+    offset += record->rec_len;
+  }
+  if (rec_len == 0) {
+    return false;
+  }
+
+  DirRecord *record = record_at(data, at);
+  record->inode_num = entry.inode_num;
+  record->rec_len = rec_len;
+  record->name_len = entry.name.size();
+  record->file_type = entry.file_type;
+  record->hash = entry.hash;
+  std::memcpy(data + at + sizeof(DirRecord), entry.name.data(),
+              entry.name.size());
+  return true;
+}
+
+// Frees the entry at offset; a record merges into the one before it
+void remove_entry(char *data, bool compact, size_t offset) {
+  if (compact && offset > 0) {
+    size_t prev = 0;
+    while (prev + record_at(data, prev)->rec_len < offset) {
+      prev += record_at(data, prev)->rec_len;
+    }
+    record_at(data, prev)->rec_len += record_at(data, offset)->rec_len;
+    return;
+  }
+  uint32_t unused = 0;
+  std::memcpy(data + offset, &unused, sizeof(unused));
+}
+
+} // namespace
+
+bool VirtualFileSystem::read_dir_block(const Inode &dir, uint32_t index,
+                                       BlockHandle &block) {
+  MapView view;
+  uint32_t block_num = lookup_block(dir, index, view);
+  return block_num != 0 && read_block(block_num, block);
+}
+
+bool VirtualFileSystem::write_dir_block(Inode &dir, uint32_t index,
+                                        const char *data) {
+  MapPath path;
+  bool fresh = false;
+  uint32_t block_num = map_block_for_write(dir, index, path, fresh);
+  // The block goes out before any map block that points at it
+  return block_num != 0 && write_block(block_num, data) &&
+         flush_map_path(path);
+}
+
+uint32_t VirtualFileSystem::find_dir_leaf(const Inode &dir, const char *root,
+                                          uint32_t hash,
+                                          DirIndexTrail &trail) {
+  uint32_t levels = index_header(root)->levels;
+  if (levels > DIR_INDEX_MAX_LEVELS) {
+    return 0;
+  }
+
+  const char *node = root;
+  uint32_t node_index = 0;
+  BlockHandle handle;
+  for (uint32_t level = 0;; ++level) {
+    if (!is_index_block(node) || index_header(node)->count == 0) {
+      return 0;
+    }
+    uint32_t slot = index_slot(node, hash);
+    trail.blocks[level] = node_index;
+    trail.slots[level] = slot;
+    trail.depth = level + 1;
+    node_index = index_entries(node)[slot].block;
+    if (level == levels) {
+      return node_index;
+    }
+    if (!read_dir_block(dir, node_index, handle)) {
+      return 0;
+    }
+    node = handle.data();
+  }
+}
+
+bool VirtualFileSystem::insert_dir_index(Inode &dir, char *root,
+                                         DirIndexTrail &trail, uint32_t hash,
+                                         uint32_t block) {
+  DirIndexHeader *root_header = index_header(root);
+  ScratchBlock node;
+
+  if (trail.depth == 1) {
+    if (root_header->count < root_header->limit) {
+      index_insert(root, trail.slots[0] + 1, hash, block);
+      return true;
+    }
+    if (root_header->levels >= DIR_INDEX_MAX_LEVELS) {
+      std::cerr << "[VFS ERROR] insert_dir_index: Directory index full\n";
+      return false;
+    }
+    // Move the root's entries into an interior node below it
+    init_index_block(node.data());
+    index_header(node.data())->count = root_header->count;
+    std::memcpy(index_entries(node.data()), index_entries(root),
+                root_header->count * sizeof(DirIndexEntry));
+    uint32_t node_index = root_header->blocks++;
+    root_header->count = 1;
+    root_header->levels = 1;
+    index_entries(root)[0] = {0, node_index};
+    trail.blocks[1] = node_index;
+    trail.slots[1] = trail.slots[0];
+    trail.slots[0] = 0;
+    trail.depth = 2;
+  } else {
+    BlockHandle handle;
+    if (!read_dir_block(dir, trail.blocks[1], handle)) {
+      return false;
+    }
+    std::memcpy(node.data(), handle.data(), BLOCK_SIZE);
+  }
+
+  DirIndexHeader *node_header = index_header(node.data());
+  uint32_t pos = trail.slots[1] + 1;
+  if (node_header->count < node_header->limit) {
+    index_insert(node.data(), pos, hash, block);
+    return write_dir_block(dir, trail.blocks[1], node.data());
+  }
+
+  // Split the interior node; its upper half gets its own root entry
+  if (root_header->count >= root_header->limit) {
+    std::cerr << "[VFS ERROR] insert_dir_index: Directory index full\n";
+    return false;
+  }
+  ScratchBlock upper;
+  init_index_block(upper.data());
+  uint32_t half = node_header->count / 2;
+  uint32_t moved = node_header->count - half;
+  std::memcpy(index_entries(upper.data()), index_entries(node.data()) + half,
+              moved * sizeof(DirIndexEntry));
+  index_header(upper.data())->count = moved;
+  node_header->count = half;
+  if (pos <= half) {
+    index_insert(node.data(), pos, hash, block);
+  } else {
+    index_insert(upper.data(), pos - half, hash, block);
+  }
+
+  uint32_t upper_index = root_header->blocks++;
+  index_insert(root, trail.slots[0] + 1, index_entries(upper.data())[0].hash,
+               upper_index);
+  return write_dir_block(dir, trail.blocks[1], node.data()) &&
+         write_dir_block(dir, upper_index, upper.data());
+}
+
+bool VirtualFileSystem::split_dir_leaf(Inode &dir, char *root,
+                                       DirIndexTrail &trail, char *leaf,
+                                       uint32_t leaf_index,
+                                       const DirEntryView &entry) {
+  // The full leaf plus the new entry, ordered by hash
+  bool compact = compact_dirs();
+  std::array<DirEntryView, MAX_LEAF_ENTRIES + 1> items;
+  size_t count = 0;
+  size_t total = 0;
+  for_each_entry(leaf, compact, [&](size_t, const DirEntryView &existing) {
+    items[count++] = existing;
+    total += entry_size(compact, existing.name.size());
+  });
+  items[count++] = entry;
+  total += entry_size(compact, entry.name.size());
+  std::sort(items.begin(), items.begin() + count,
+            [](const DirEntryView &a, const DirEntryView &b) {
+              return a.hash < b.hash;
+            });
+
+  // Split at half the bytes; names with equal hashes must stay in one leaf
+  size_t mid = 0;
+  for (size_t bytes = 0; mid < count; ++mid) {
+    bytes += entry_size(compact, items[mid].name.size());
+    if (bytes > total / 2) {
+      break;
+    }
+  }
+  mid = std::max<size_t>(mid, 1);
+  size_t half = mid;
+  while (mid < count && items[mid].hash == items[mid - 1].hash) {
+    ++mid;
+  }
+  if (mid == count) {
+    mid = half;
+    while (mid > 0 && items[mid].hash == items[mid - 1].hash) {
+      --mid;
+    }
+  }
+
+  // Names are views into the old leaf, so the halves are built elsewhere
+  ScratchBlock lower, upper;
+  std::memset(lower.data(), 0, BLOCK_SIZE);
+  std::memset(upper.data(), 0, BLOCK_SIZE);
+  bool fits = mid > 0;
+  for (size_t i = 0; fits && i < count; ++i) {
+    fits = insert_entry(i < mid ? lower.data() : upper.data(), compact,
+                        items[i]);
+  }
+  if (!fits) {
+    std::cerr << "[VFS ERROR] split_dir_leaf: Too many names with hash "
+              << entry.hash << "\n";
+    return false;
+  }
+
+  // Blocks are written in file order so the directory stays contiguous.
+  // If the index is full, the new leaf is left unreferenced and the root
+  // (not rewritten) hands its block out again at the next split.
+  uint32_t upper_index = index_header(root)->blocks++;
+  return write_dir_block(dir, upper_index, upper.data()) &&
+         insert_dir_index(dir, root, trail, items[mid].hash, upper_index) &&
+         write_dir_block(dir, leaf_index, lower.data());
+}
+
+bool VirtualFileSystem::add_dir_entry(uint32_t dir_inode,
+                                      const std::string &name,
+                                      uint32_t inode_num, FileType type) {
+  if (name.length() > MAX_FILENAME) {
+    return false;
+  }
+
+  Inode inode;
+  if (!read_inode(dir_inode, inode)) {
+    VFS_DEBUG("add_dir_entry: Failed to read parent inode " << dir_inode);
+    return false;
+  }
+
+  if ((inode.mode & S_IFMT) != S_IFDIR) {
+    VFS_DEBUG("add_dir_entry: Parent inode "
+              << dir_inode << " is NOT a directory (mode=" << std::oct
+              << inode.mode << std::dec << ")");
+    return false; // Not a directory
+  }
+
+  bool compact = compact_dirs();
+  DirEntryView entry{name, inode_num, name_hash(name.data(), name.size()),
+                     static_cast<uint8_t>(type)};
+
+  // Until the entry is in place the cached lookup result is unknown
+  dentry_cache_->erase(dir_inode, name);
+
+  // Block 0 is either the only leaf block or the index root
+  ScratchBlock root;
+  BlockHandle block;
+  if (read_dir_block(inode, 0, block)) {
+    std::memcpy(root.data(), block.data(), BLOCK_SIZE);
+    block.reset();
+  } else {
+    std::memset(root.data(), 0, BLOCK_SIZE); // empty directory
+  }
+
+  bool root_dirty = false;
+  if (!is_index_block(root.data())) {
+    if (insert_entry(root.data(), compact, entry)) {
+      if (!write_dir_block(inode, 0, root.data())) {
+        VFS_DEBUG("add_dir_entry: write_block failed");
+        return false;
+      }
+    } else {
+      // The first block is full: its entries move to leaf 1 and block 0
+      // becomes the index root
+      if (!write_dir_block(inode, 1, root.data())) {
+        return false;
+      }
+      init_index_block(root.data());
+      index_header(root.data())->blocks = 2;
+      index_header(root.data())->count = 1;
+      index_entries(root.data())[0] = {0, 1};
+      root_dirty = true;
+    }
+  }
+
+  if (is_index_block(root.data())) {
+    DirIndexTrail trail;
+    uint32_t leaf_index = find_dir_leaf(inode, root.data(), entry.hash, trail);
+    if (leaf_index == 0 || !read_dir_block(inode, leaf_index, block)) {
+      std::cerr << "[VFS ERROR] add_dir_entry: Corrupt index in directory "
+                << dir_inode << "\n";
+      return false;
+    }
+    ScratchBlock leaf;
+    std::memcpy(leaf.data(), block.data(), BLOCK_SIZE);
+    block.reset();
+
+    if (insert_entry(leaf.data(), compact, entry)) {
+      if (!write_dir_block(inode, leaf_index, leaf.data())) {
+        return false;
+      }
+    } else {
+      if (!split_dir_leaf(inode, root.data(), trail, leaf.data(), leaf_index,
+                          entry)) {
+        return false;
+      }
+      root_dirty = true;
+    }
+    if (root_dirty && !write_dir_block(inode, 0, root.data())) {
+      return false;
+    }
+  }
+
+  inode.size += entry_size(compact, name.size());
+  inode.mtime = std::time(nullptr);
+  if (!write_inode(dir_inode, inode)) {
+    VFS_DEBUG("add_dir_entry: write_inode failed");
+    return false;
+  }
+  dentry_cache_->insert(dir_inode, name, inode_num);
+  return true;
+}
+
+bool VirtualFileSystem::remove_dir_entry(uint32_t dir_inode,
+                                         const std::string &name) {
+  Inode inode;
+  if (!read_inode(dir_inode, inode)) {
+    return false;
+  }
+
+  if ((inode.mode & S_IFMT) != S_IFDIR) {
+    return false;
+  }
+
+  BlockHandle block;
+  if (!read_dir_block(inode, 0, block)) {
+    return false;
+  }
+
+  bool compact = compact_dirs();
+  uint32_t hash = name_hash(name.data(), name.size());
+  uint32_t index = 0;
+  if (is_index_block(block.data())) {
+    DirIndexTrail trail;
+    index = find_dir_leaf(inode, block.data(), hash, trail);
+    if (index == 0 || !read_dir_block(inode, index, block)) {
+      return false;
+    }
+  }
+
+  int offset = find_entry(block.data(), compact, name, hash);
+  if (offset < 0) {
+    return false;
+  }
+  ScratchBlock data;
+  std::memcpy(data.data(), block.data(), BLOCK_SIZE);
+  block.reset();
+
+  remove_entry(data.data(), compact, offset);
+  if (!write_dir_block(inode, index, data.data())) {
+    return false; // the entry is still on disk, and cached as such
+  }
+  inode.size -= entry_size(compact, name.size());
+  inode.mtime = std::time(nullptr);
+  if (!write_inode(dir_inode, inode)) {
+    // The entry is gone but the inode is stale; look it up afresh
+    dentry_cache_->erase(dir_inode, name);
+    return false;
+  }
+  dentry_cache_->insert(dir_inode, name, DentryCache::NEGATIVE);
+  return true;
+}
+
+int32_t VirtualFileSystem::find_dir_entry(uint32_t dir_inode,
+                                          std::string_view name) {
+  int32_t inode_num;
+  if (dentry_cache_->lookup(dir_inode, name, inode_num)) {
+    return inode_num;
+  }
+
+  Inode inode;
+  if (!read_inode(dir_inode, inode)) {
+    return -1;
+  }
+
+  // Missing names are cached too; read errors are not
+  BlockHandle block;
+  if ((inode.mode & S_IFMT) != S_IFDIR || !read_dir_block(inode, 0, block)) {
+    dentry_cache_->insert(dir_inode, name, DentryCache::NEGATIVE);
+    return -1;
+  }
+
+  // An indexed directory is searched in the one leaf the hash selects
+  uint32_t hash = name_hash(name.data(), name.size());
+  if (is_index_block(block.data())) {
+    DirIndexTrail trail;
+    uint32_t leaf = find_dir_leaf(inode, block.data(), hash, trail);
+    if (leaf == 0 || !read_dir_block(inode, leaf, block)) {
+      return -1;
+    }
+  }
+
+  // Entries are compared in place in the pinned directory block
+  int offset = find_entry(block.data(), compact_dirs(), name, hash);
+  inode_num = DentryCache::NEGATIVE;
+  if (offset >= 0) {
+    inode_num = entry_inode(block.data(), offset);
+  }
+  dentry_cache_->insert(dir_inode, name, inode_num);
+  return inode_num;
+}
+
+int VirtualFileSystem::read_dir_entries(uint32_t dir_inode,
+                                        std::vector<DirEntryInfo> &entries) {
+  Inode inode;
+  if (!read_inode(dir_inode, inode)) {
+    return -1;
+  }
+
+  if ((inode.mode & S_IFMT) != S_IFDIR) {
+    return -2; // Not a directory
+  }
+
+  entries.clear();
+
+  BlockHandle block;
+  if (!read_dir_block(inode, 0, block)) {
+    return 0; // Empty directory
+  }
+
+  // An indexed directory lists its leaves in block order, skipping the
+  // interior index nodes
+  uint32_t first = 0;
+  uint32_t blocks = 1;
+  if (is_index_block(block.data())) {
+    first = 1;
+    blocks = index_header(block.data())->blocks;
+  }
+
+  for (uint32_t index = first; index < blocks; ++index) {
+    if (index > 0 &&
+        (!read_dir_block(inode, index, block) || is_index_block(block.data()))) {
+      continue;
+    }
+    for_each_entry(block.data(), compact_dirs(),
+                   [&](size_t, const DirEntryView &entry) {
+                     entries.push_back(
+                         DirEntryInfo{std::string(entry.name), entry.inode_num,
+                                      static_cast<FileType>(entry.file_type)});
+                   });
+  }
+
+  return 0;
+}
+
+} // namespace vfs
@@ -0,0 +1,543 @@
+#include "filesystem/vfs.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace vfs {
+
+namespace {
+
+// One node of an extent tree: the inode's root or a tree block
+struct ExtentNode {
+  ExtentHeader *header;
+  Extent *entries;
+};
+
+ExtentRoot empty_root() {
+  ExtentRoot root;
+  std::memset(&root, 0, sizeof(root));
+  root.header.magic = EXTENT_MAGIC;
+  root.header.max_entries = INODE_EXTENTS;
+  return root;
+}
+
+ExtentRoot load_root(const Inode &inode) {
+  ExtentRoot root;
+  std::memcpy(&root,
+              reinterpret_cast<const char *>(&inode) +
+                  offsetof(Inode, direct_blocks),
+              sizeof(root));
+  // Freshly allocated inodes are all zeroes
+  return root.header.magic == EXTENT_MAGIC ? root : empty_root();
+}
+
+void store_root(Inode &inode, const ExtentRoot &root) {
+  std::memcpy(reinterpret_cast<char *>(&inode) + offsetof(Inode, direct_blocks),
+              &root, sizeof(root));
+}
+
+ExtentNode block_node(char *frame) {
+  return {reinterpret_cast<ExtentHeader *>(frame),
+          reinterpret_cast<Extent *>(frame + sizeof(ExtentHeader))};
+}
+
+const Extent *block_entries(const char *frame) {
+  return reinterpret_cast<const Extent *>(frame + sizeof(ExtentHeader));
+}
+
+// A tree block at `depth`; index blocks are never empty
+bool valid_node(const char *frame, uint16_t depth) {
+  const auto *header = reinterpret_cast<const ExtentHeader *>(frame);
+  return header->magic == EXTENT_MAGIC && header->depth == depth &&
+         header->entries <= EXTENTS_PER_BLOCK &&
+         (depth == 0 || header->entries > 0);
+}
+
+// Index of the last entry starting at or before block, -1 if none
+int find_entry(const Extent *entries, uint16_t count, uint32_t block) {
+  const Extent *it = std::upper_bound(
+      entries, entries + count, block,
+      [](uint32_t b, const Extent &e) { return b < e.logical; });
+  return static_cast<int>(it - entries) - 1;
+}
+
+// Index entry covering block; the first one also covers everything before
+int find_child(const Extent *entries, uint16_t count, uint32_t block) {
+  return std::max(0, find_entry(entries, count, block));
+}
+
+} // namespace
+
+uint32_t VirtualFileSystem::lookup_extent(const Inode &inode,
+                                          uint32_t block_index,
+                                          MapView &view) {
+  ExtentRoot root = load_root(inode);
+  const Extent *entries = root.entries;
+  uint16_t count = root.header.entries;
+  if (root.header.depth > MAP_LEVELS) {
+    return 0;
+  }
+
+  // Down the index levels; view.blocks[d] holds the node at depth d
+  for (int depth = root.header.depth - 1; depth >= 0; --depth) {
+    if (count == 0) {
+      return 0;
+    }
+    uint32_t child = entries[find_child(entries, count, block_index)].start;
+    if (view.block_nums[depth] != child) {
+      if (!read_block(child, view.blocks[depth]) ||
+          !valid_node(view.blocks[depth].data(), depth)) {
+        view.block_nums[depth] = 0;
+        return 0;
+      }
+      view.block_nums[depth] = child;
+    }
+    const char *data = view.blocks[depth].data();
+    entries = block_entries(data);
+    count = reinterpret_cast<const ExtentHeader *>(data)->entries;
+  }
+
+  int e = find_entry(entries, count, block_index);
+  if (e < 0 || block_index - entries[e].logical >= entries[e].length) {
+    return 0; // Hole
+  }
+  return entries[e].start + (block_index - entries[e].logical);
+}
+
+bool VirtualFileSystem::load_extent_path(const ExtentRoot &root,
+                                         MapPath &path, uint32_t block_index,
+                                         int *slots) {
+  if (root.header.depth > MAP_LEVELS) {
+    return false;
+  }
+  const Extent *entries = root.entries;
+  uint16_t count = root.header.entries;
+  for (int depth = root.header.depth; depth > 0; --depth) {
+    if (count == 0) {
+      return false;
+    }
+    slots[depth] = find_child(entries, count, block_index);
+    MapBlock &child = path.levels[depth - 1];
+    if (!load_map_block(path, child, entries[slots[depth]].start) ||
+        !valid_node(child.frame.data(), depth - 1)) {
+      return false;
+    }
+    entries = block_entries(child.frame.data());
+    count = reinterpret_cast<const ExtentHeader *>(child.frame.data())->entries;
+  }
+  return true;
+}
+
+uint32_t VirtualFileSystem::map_extent_for_write(Inode &inode,
+                                                 uint32_t block_index,
+                                                 MapPath &path,
+                                                 bool &fresh) {
+  fresh = false;
+
+  ExtentRoot root = load_root(inode);
+  int slots[MAP_LEVELS + 1];
+  if (!load_extent_path(root, path, block_index, slots)) {
+    return 0;
+  }
+  ExtentNode node = root.header.depth == 0
+                        ? ExtentNode{&root.header, root.entries}
+                        : block_node(path.levels[0].frame.data());
+
+  // Already mapped, or allocate where the previous extent would continue so
+  // sequential writes keep extending it
+  uint32_t goal = 0;
+  int e = find_entry(node.entries, node.header->entries, block_index);
+  if (e >= 0) {
+    const Extent &prev = node.entries[e];
+    if (block_index - prev.logical < prev.length) {
+      return prev.start + (block_index - prev.logical);
+    }
+    goal = prev.start + (block_index - prev.logical);
+  }
+
+  uint32_t physical_block = allocate_data_block(path, goal);
+  if (physical_block == static_cast<uint32_t>(-1)) {
+    return 0; // No free blocks
+  }
+  if (!add_extent_block(root, path, block_index, physical_block)) {
+    free_block(physical_block);
+    return 0;
+  }
+  store_root(inode, root);
+  inode.blocks_count++;
+  fresh = true;
+  return physical_block;
+}
+
+bool VirtualFileSystem::add_extent_block(ExtentRoot &root, MapPath &path,
+                                         uint32_t block_index,
+                                         uint32_t physical_block) {
+  // Nodes by depth: the root at the top, tree blocks from the path below
+  int slots[MAP_LEVELS + 1];
+  auto node_at = [&](int depth) {
+    return depth == root.header.depth
+               ? ExtentNode{&root.header, root.entries}
+               : block_node(path.levels[depth].frame.data());
+  };
+  auto touch = [&](int depth) { // root changes go out with the inode
+    if (depth < root.header.depth) {
+      path.levels[depth].dirty = true;
+    }
+  };
+
+  for (;;) {
+    if (!load_extent_path(root, path, block_index, slots)) {
+      return false;
+    }
+    ExtentNode leaf = node_at(0);
+    ExtentHeader &header = *leaf.header;
+    int e = find_entry(leaf.entries, header.entries, block_index);
+
+    // Grow the previous extent forwards or the next one backwards
+    if (e >= 0) {
+      Extent &prev = leaf.entries[e];
+      if (prev.logical + prev.length == block_index &&
+          prev.start + prev.length == physical_block) {
+        prev.length++;
+        touch(0);
+        return true;
+      }
+    }
+    if (e + 1 < header.entries) {
+      Extent &next = leaf.entries[e + 1];
+      if (next.logical == block_index + 1 &&
+          next.start == physical_block + 1) {
+        next.logical--;
+        next.start--;
+        next.length++;
+        touch(0);
+        return true;
+      }
+    }
+
+    uint16_t pos = static_cast<uint16_t>(e + 1);
+    if (header.entries < header.max_entries) {
+      std::memmove(leaf.entries + pos + 1, leaf.entries + pos,
+                   (header.entries - pos) * sizeof(Extent));
+      leaf.entries[pos] = Extent{block_index, physical_block, 1};
+      header.entries++;
+      touch(0);
+      return true;
+    }
+
+    // The leaf is full. Split the lowest full node whose parent has room
+    // for one more index entry, then look again.
+    int full = 0;
+    while (full < root.header.depth &&
+           node_at(full + 1).header->entries ==
+               node_at(full + 1).header->max_entries) {
+      full++;
+    }
+
+    if (full == root.header.depth) {
+      // Every level is full: move the root's entries into a new block and
+      // put the tree one level deeper
+      uint16_t depth = root.header.depth;
+      if (depth == MAP_LEVELS) {
+        std::cerr << "[VFS ERROR] Extent tree full, file too fragmented\n";
+        return false;
+      }
+      MapBlock &map = path.levels[depth];
+      if (!flush_map_block(path, map)) {
+        return false;
+      }
+      uint32_t block = allocate_block(physical_block);
+      if (block == static_cast<uint32_t>(-1)) {
+        return false;
+      }
+      std::memset(map.frame.data(), 0, BLOCK_SIZE);
+      ExtentNode child = block_node(map.frame.data());
+      *child.header = ExtentHeader{EXTENT_MAGIC, root.header.entries,
+                                   EXTENTS_PER_BLOCK, depth};
+      std::memcpy(child.entries, root.entries,
+                  root.header.entries * sizeof(Extent));
+      map.block_num = block;
+      map.dirty = true;
+
+      root.header.depth = depth + 1;
+      root.header.entries = 1;
+      root.entries[0] = Extent{0, block, 0};
+      continue;
+    }
+
+    // Start a sibling after the full node. Appends leave it as it is (an
+    // index hands over its last entry, so the sibling is not empty);
+    // inserts in the middle move the upper half across.
+    ExtentNode node = node_at(full);
+    MapBlock &map = path.levels[full];
+    uint16_t entries = node.header->entries;
+    bool append = full == 0 ? pos == entries : slots[full] == entries - 1;
+    uint16_t keep = !append ? entries / 2 : full == 0 ? entries : entries - 1;
+    uint32_t sibling = allocate_block(map.block_num + 1);
+    if (sibling == static_cast<uint32_t>(-1)) {
+      return false;
+    }
+    ScratchBlock frame;
+    std::memset(frame.data(), 0, BLOCK_SIZE);
+    ExtentNode right = block_node(frame.data());
+    *right.header = ExtentHeader{EXTENT_MAGIC,
+                                 static_cast<uint16_t>(entries - keep),
+                                 EXTENTS_PER_BLOCK,
+                                 static_cast<uint16_t>(full)};
+    std::memcpy(right.entries, node.entries + keep,
+                right.header->entries * sizeof(Extent));
+    uint32_t first = keep < entries ? node.entries[keep].logical : block_index;
+    if (!write_pending_data(path) || !write_block(sibling, frame.data())) {
+      free_block(sibling);
+      return false;
+    }
+    node.header->entries = keep;
+    map.dirty = true;
+
+    ExtentNode parent = node_at(full + 1);
+    Extent *index = parent.entries + slots[full + 1] + 1;
+    std::memmove(index + 1, index,
+                 (parent.header->entries - (slots[full + 1] + 1)) *
+                     sizeof(Extent));
+    *index = Extent{first, sibling, 0};
+    parent.header->entries++;
+    touch(full + 1);
+  }
+}
+
+void VirtualFileSystem::free_extent_blocks(Inode &inode) {
+  ExtentRoot root = load_root(inode);
+  if (root.header.depth <= MAP_LEVELS) {
+    free_extent_entries(root.entries, root.header.entries, root.header.depth);
+  }
+  store_root(inode, empty_root());
+  inode.blocks_count = 0;
+}
+
+void VirtualFileSystem::free_extent_entries(const Extent *entries,
+                                            uint16_t count, uint16_t depth) {
+  for (uint16_t i = 0; i < count; ++i) {
+    if (depth == 0) {
+      for (uint32_t b = 0; b < entries[i].length; ++b) {
+        free_block(entries[i].start + b);
+      }
+      continue;
+    }
+    BlockHandle child;
+    if (read_block(entries[i].start, child) &&
+        valid_node(child.data(), depth - 1)) {
+      free_extent_entries(
+          block_entries(child.data()),
+          reinterpret_cast<const ExtentHeader *>(child.data())->entries,
+          depth - 1);
+    }
+    free_block(entries[i].start);
+  }
+}
+
+int VirtualFileSystem::count_extents(const Extent *entries, uint16_t count,
+                                     uint16_t depth) {
+  if (depth == 0) {
+    return count;
+  }
+  int total = 0;
+  for (uint16_t i = 0; i < count; ++i) {
+    BlockHandle child;
+    if (read_block(entries[i].start, child) &&
+        valid_node(child.data(), depth - 1)) {
+      total += count_extents(
+          block_entries(child.data()),
+          reinterpret_cast<const ExtentHeader *>(child.data())->entries,
+          depth - 1);
+    }
+  }
+  return total;
+}
+
+bool VirtualFileSystem::collect_indirect(
+    uint32_t block_num, uint32_t depth, uint32_t first_index,
+    std::vector<std::pair<uint32_t, uint32_t>> &mapped) {
+  BlockHandle block;
+  if (!read_block(block_num, block)) {
+    return false;
+  }
+  uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
+  uint32_t span = 1; // file blocks under each pointer
+  for (uint32_t level = 1; level < depth; ++level) {
+    span *= ptrs_per_block;
+  }
+  const uint32_t *ptrs = reinterpret_cast<const uint32_t *>(block.data());
+  for (uint32_t i = 0; i < ptrs_per_block; ++i) {
+    if (ptrs[i] == 0) {
+      continue;
+    }
+    uint32_t index = first_index + i * span;
+    if (depth == 1) {
+      mapped.emplace_back(index, ptrs[i]);
+    } else if (!collect_indirect(ptrs[i], depth - 1, index, mapped)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VirtualFileSystem::collect_block_map(
+    const Inode &inode, std::vector<std::pair<uint32_t, uint32_t>> &mapped) {
+  for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
+    if (inode.direct_blocks[i] != 0) {
+      mapped.emplace_back(i, inode.direct_blocks[i]);
+    }
+  }
+  uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
+  uint32_t roots[] = {inode.indirect_block, inode.double_indirect,
+                      inode.triple_indirect};
+  uint64_t first_index = DIRECT_BLOCKS;
+  uint64_t span = ptrs_per_block;
+  for (uint32_t depth = 1; depth <= 3; ++depth) {
+    if (roots[depth - 1] != 0 &&
+        !collect_indirect(roots[depth - 1], depth,
+                          static_cast<uint32_t>(first_index), mapped)) {
+      return false;
+    }
+    first_index += span;
+    span *= ptrs_per_block;
+  }
+  return true;
+}
+
+bool VirtualFileSystem::convert_to_extents(
+    uint32_t inode_num, Inode &inode,
+    const std::vector<std::pair<uint32_t, uint32_t>> &mapped) {
+  uint32_t roots[] = {inode.indirect_block, inode.double_indirect,
+                      inode.triple_indirect};
+
+  ExtentRoot root = empty_root();
+  MapPath path;
+  for (const auto &m : mapped) {
+    if (!add_extent_block(root, path, m.first, m.second)) {
+      std::cerr << "[VFS ERROR] upgrade: Cannot map inode " << inode_num
+                << "\n";
+      return false;
+    }
+  }
+  if (!flush_map_path(path)) {
+    return false;
+  }
+
+  // The old map is only given up once the inode points at the new one
+  store_root(inode, root);
+  if (!write_inode(inode_num, inode)) {
+    return false;
+  }
+  for (uint32_t depth = 1; depth <= 3; ++depth) {
+    if (roots[depth - 1] != 0) {
+      free_indirect_tree(roots[depth - 1], depth, false);
+    }
+  }
+  return true;
+}
+
+bool VirtualFileSystem::upgrade_image(const std::string &image_path) {
+  if (!mount(image_path)) {
+    return false;
+  }
+
+  bool ok = true;
+  if (!uses_extents()) {
+    std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+
+    // Check every inode before changing any: a v1 image cannot read the
+    // extent roots of inodes converted before a failure
+    std::vector<std::pair<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>>>
+        plan;
+    uint64_t blocks_needed = 0;
+    for (uint32_t i = 1; i < superblock_.total_inodes && ok; ++i) {
+      Inode inode;
+      std::vector<std::pair<uint32_t, uint32_t>> mapped;
+      if (!read_inode(i, inode) ||
+          (inode.mode != 0 && !collect_block_map(inode, mapped))) {
+        std::cerr << "[VFS ERROR] upgrade: Cannot read inode " << i << "\n";
+        ok = false;
+        break;
+      }
+      if (inode.mode == 0) {
+        continue;
+      }
+
+      // Appending in file order merges contiguous runs and fills each
+      // leaf before starting the next
+      uint64_t extents = 0;
+      for (size_t m = 0; m < mapped.size(); ++m) {
+        if (m == 0 || mapped[m].first != mapped[m - 1].first + 1 ||
+            mapped[m].second != mapped[m - 1].second + 1) {
+          extents++;
+        }
+      }
+      // Tree blocks level by level until the root holds the top one; an
+      // index block split on append keeps one entry less
+      uint64_t nodes = extents;
+      size_t depth = 0;
+      while (nodes > INODE_EXTENTS) {
+        uint64_t per = depth == 0 ? EXTENTS_PER_BLOCK : EXTENTS_PER_BLOCK - 1;
+        nodes = (nodes + per - 1) / per;
+        blocks_needed += nodes;
+        depth++;
+      }
+      if (depth > MAP_LEVELS) {
+        std::cerr << "[VFS ERROR] upgrade: Inode " << i
+                  << " is too fragmented for an extent tree\n";
+        ok = false;
+        break;
+      }
+      plan.emplace_back(i, std::move(mapped));
+    }
+    if (ok && blocks_needed > superblock_.free_blocks) {
+      std::cerr << "[VFS ERROR] upgrade: " << blocks_needed
+                << " free blocks needed for extent tree blocks\n";
+      ok = false;
+    }
+
+    for (size_t p = 0; p < plan.size() && ok; ++p) {
+      Inode inode;
+      ok = read_inode(plan[p].first, inode) &&
+           convert_to_extents(plan[p].first, inode, plan[p].second);
+    }
+    if (ok) {
+      superblock_.version = FORMAT_V2;
+      ok = write_superblock();
+    }
+  }
+  unmount();
+
+  if (ok) {
+    std::cout << "[VFS] " << image_path << " uses format v2.\n";
+  }
+  return ok;
+}
+
+int VirtualFileSystem::get_extent_count(const std::string &path) {
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
+
+  if (!mounted_ || !uses_extents()) {
+    return 0;
+  }
+
+  int32_t inode_num = resolve_path(path);
+  if (inode_num < 0) {
+    return 0;
+  }
+  auto inode_lock = inode_locks_.lock_shared(inode_num);
+
+  Inode inode;
+  if (!read_inode(inode_num, inode)) {
+    return 0;
+  }
+
+  ExtentRoot root = load_root(inode);
+  if (root.header.depth > MAP_LEVELS) {
+    return 0;
+  }
+  return count_extents(root.entries, root.header.entries, root.header.depth);
+}
+
+} // namespace vfs
@@ -1,47 +1,27 @@
 #include "filesystem/vfs.h"
+#include "filesystem/vfs_log.h"
 #include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
-#include <sstream>
 
 namespace fs = std::filesystem;
 
 namespace vfs {
 
-// Path operations
-std::vector<std::string>
-VirtualFileSystem::split_path(const std::string &path) {
-  std::vector<std::string> components;
-  std::stringstream ss(path);
-  std::string component;
-
-  while (std::getline(ss, component, '/')) {
-    if (!component.empty() && component != ".") {
-      if (component == "..") {
-        if (!components.empty()) {
-          components.pop_back();
-        }
-      } else {
-        components.push_back(component);
-      }
-    }
-  }
-
-  return components;
-}
-
-int32_t VirtualFileSystem::resolve_path(const std::string &path) {
-  auto components = split_path(path);
-  if (components.empty()) {
-    return 1; // Root is inode 1
-  }
-
+// Path operations. Components are views into the caller's path, so
+// resolution allocates nothing until a name has to be stored.
+int32_t VirtualFileSystem::walk_path(const PathComponents &components,
+                                     size_t count) {
   uint32_t current_inode = 1; // Start from root (inode 1)
 
-  for (const auto &component : components) {
-    int32_t next_inode = find_dir_entry(current_inode, component);
+  for (size_t i = 0; i < count; ++i) {
+    auto dir_lock = inode_locks_.lock_shared(current_inode);
+    int32_t next_inode = find_dir_entry(current_inode, components[i]);
     if (next_inode < 0) {
+      VFS_DEBUG("walk_path: Component '" << components[i]
+                                          << "' not found in directory inode "
+                                          << current_inode);
       return -1; // Path not found
     }
     current_inode = next_inode;
@@ -50,211 +30,90 @@ int32_t VirtualFileSystem::resolve_path(const std::string &path) {
   return current_inode;
 }
 
-int32_t VirtualFileSystem::resolve_path_parent(const std::string &path,
+int32_t VirtualFileSystem::resolve_path(std::string_view path) {
+  PathComponents components(path);
+  return walk_path(components, components.size());
+}
+
+int32_t VirtualFileSystem::resolve_path_parent(std::string_view path,
                                                std::string &name) {
-  auto components = split_path(path);
+  PathComponents components(path);
   if (components.empty()) {
-    std::cerr << "[VFS DEBUG] resolve_path_parent: Empty components for path '"
-              << path << "', cannot determine parent.\n";
+    VFS_DEBUG("resolve_path_parent: Empty components for path '"
+              << path << "', cannot determine parent.");
     return -1;
   }
 
-  name = components.back();
-  components.pop_back();
-  std::cerr << "[VFS DEBUG] resolve_path_parent: Path '" << path
-            << "', target name is '" << name << "'.\n";
-
-  if (components.empty()) {
-    std::cerr << "[VFS DEBUG] resolve_path_parent: Parent of '" << path
-              << "' is root (inode 1).\n";
-    return 1; // Parent is root (inode 1)
-  }
-
-  // Reconstruct parent path
-  uint32_t current_inode = 1; // Start from root (inode 1)
-  std::cerr << "[VFS DEBUG] resolve_path_parent: Starting parent path "
-               "resolution from inode "
-            << current_inode << "\n";
-  for (const auto &component : components) {
-    int32_t next_inode = find_dir_entry(current_inode, component);
-    if (next_inode < 0) {
-      std::cerr << "[VFS DEBUG] resolve_path_parent: Component '" << component
-                << "' not found in directory inode " << current_inode
-                << " during parent resolution.\n";
-      return -1;
-    }
-    current_inode = next_inode;
-  }
-
-  return current_inode;
+  name.assign(components.back());
+  VFS_DEBUG("resolve_path_parent: Path '" << path << "', target name is '"
+                                          << name << "'.");
+  return walk_path(components, components.size() - 1);
 }
 
-// Directory operations
-bool VirtualFileSystem::add_dir_entry(uint32_t dir_inode,
-                                      const std::string &name,
-                                      uint32_t inode_num, FileType type) {
-  if (name.length() > MAX_FILENAME) {
-    return false;
-  }
-
-  Inode inode;
-  if (!read_inode(dir_inode, inode)) {
-    std::cerr << "[VFS DEBUG] add_dir_entry: Failed to read parent inode "
-              << dir_inode << "\n";
-    return false;
-  }
-
-  if ((inode.mode & S_IFMT) != S_IFDIR) {
-    std::cerr << "[VFS DEBUG] add_dir_entry: Parent inode " << dir_inode
-              << " is NOT a directory (mode=" << std::oct << inode.mode
-              << std::dec << ")\n";
-    return false; // Not a directory
-  }
-
-  // Create directory entry
-  DirEntry entry;
-  entry.inode_num = inode_num;
-  entry.name_len = name.length();
-  entry.file_type = static_cast<uint8_t>(type);
-  entry.rec_len = sizeof(DirEntry);
-  strncpy(entry.name, name.c_str(), MAX_FILENAME);
-
-  // Allocate block if directory is empty
-  if (inode.blocks_count == 0) {
-    uint32_t block_num = allocate_block();
-    if (block_num == static_cast<uint32_t>(-1)) {
-      return false;
+std::pair<InodeLockTable::ExclusiveLock, InodeLockTable::ExclusiveLock>
+VirtualFileSystem::lock_dir_entry(uint32_t parent_inode,
+                                  const std::string &name,
+                                  int32_t &inode_num) {
+  // The child is only known after a lookup in the parent, but both locks
+  // have to be taken in stripe order. Look up, lock both, then re-check
+  // that the entry was not replaced in between.
+  while (true) {
+    {
+      auto parent_lock = inode_locks_.lock_shared(parent_inode);
+      inode_num = find_dir_entry(parent_inode, name);
     }
-    inode.direct_blocks[0] = block_num;
-    inode.blocks_count = 1;
-
-    std::vector<char> zero_block(BLOCK_SIZE, 0);
-    if (!write_block(block_num, zero_block)) {
-      std::cerr << "[VFS DEBUG] add_dir_entry: Failed to write zero block "
-                << block_num << "\n";
-      return false;
+    if (inode_num < 0) {
+      return {};
     }
-  }
 
-  // Write entry to directory block
-  std::vector<char> block_data;
-  if (!read_block(inode.direct_blocks[0], block_data)) {
-    std::cerr << "[VFS DEBUG] add_dir_entry: read_block failed for block "
-              << inode.direct_blocks[0] << "\n";
-    return false;
-  }
-
-  // Find free space in directory
-  size_t offset = 0;
-  while (offset + sizeof(DirEntry) <= BLOCK_SIZE) {
-    DirEntry *existing =
-        reinterpret_cast<DirEntry *>(block_data.data() + offset);
-    if (existing->inode_num == 0) {
-      // Found free slot
-      std::memcpy(block_data.data() + offset, &entry, sizeof(DirEntry));
-      inode.size += sizeof(DirEntry);
-      inode.mtime = std::time(nullptr);
-      if (!write_inode(dir_inode, inode)) {
-        std::cerr << "[VFS DEBUG] add_dir_entry: write_inode failed\n";
-        return false;
-      }
-      if (!write_block(inode.direct_blocks[0], block_data)) {
-        std::cerr << "[VFS DEBUG] add_dir_entry: write_block failed\n";
-        return false;
-      }
-      return true;
+    auto locks = inode_locks_.lock_exclusive_pair(parent_inode, inode_num);
+    if (find_dir_entry(parent_inode, name) == inode_num) {
+      return locks;
     }
-    offset += sizeof(DirEntry);
   }
-
-  std::cerr << "[VFS DEBUG] add_dir_entry: Directory full at inode "
-            << dir_inode << "\n";
-  return false; // Directory full
 }
 
-bool VirtualFileSystem::remove_dir_entry(uint32_t dir_inode,
-                                         const std::string &name) {
-  Inode inode;
-  if (!read_inode(dir_inode, inode)) {
-    return false;
-  }
-
-  if ((inode.mode & S_IFMT) != S_IFDIR) {
-    return false;
-  }
+// File descriptor management (callers hold fd_mutex_)
+int VirtualFileSystem::allocate_fd() {
+  int fd = next_fd_++;
+  fd_table_[fd] = FileDescriptor();
+  return fd;
+}
 
-  if (inode.blocks_count == 0) {
-    return false;
-  }
+void VirtualFileSystem::free_fd(int fd) { fd_table_.erase(fd); }
 
-  std::vector<char> block_data;
-  if (!read_block(inode.direct_blocks[0], block_data)) {
+bool VirtualFileSystem::get_fd(int fd, FileDescriptor &file_desc) {
+  std::lock_guard<std::mutex> lock(fd_mutex_);
+  auto it = fd_table_.find(fd);
+  if (it == fd_table_.end() || !it->second.is_open) {
     return false;
   }
-
-  size_t offset = 0;
-  while (offset + sizeof(DirEntry) <= BLOCK_SIZE) {
-    DirEntry *entry = reinterpret_cast<DirEntry *>(block_data.data() + offset);
-    if (entry->inode_num != 0 &&
-        std::string(entry->name, entry->name_len) == name) {
-      // Found entry, mark as free
-      entry->inode_num = 0;
-      inode.size -= sizeof(DirEntry);
-      inode.mtime = std::time(nullptr);
-      write_inode(dir_inode, inode);
-      return write_block(inode.direct_blocks[0], block_data);
-    }
-    offset += sizeof(DirEntry);
-  }
-
-  return false;
+  file_desc = it->second;
+  return true;
 }
 
-int32_t VirtualFileSystem::find_dir_entry(uint32_t dir_inode,
-                                          const std::string &name) {
-  Inode inode;
-  if (!read_inode(dir_inode, inode)) {
-    return -1;
-  }
-
-  if ((inode.mode & S_IFMT) != S_IFDIR) {
-    return -1;
-  }
-
-  if (inode.blocks_count == 0) {
-    return -1;
+void VirtualFileSystem::set_fd_offset(int fd, uint64_t offset) {
+  std::lock_guard<std::mutex> lock(fd_mutex_);
+  auto it = fd_table_.find(fd);
+  if (it != fd_table_.end()) {
+    it->second.offset = offset;
   }
-
-  std::vector<char> block_data;
-  if (!read_block(inode.direct_blocks[0], block_data)) {
-    return -1;
-  }
-
-  size_t offset = 0;
-  while (offset + sizeof(DirEntry) <= BLOCK_SIZE) {
-    DirEntry *entry = reinterpret_cast<DirEntry *>(block_data.data() + offset);
-    if (entry->inode_num != 0 &&
-        std::string(entry->name, entry->name_len) == name) {
-      return entry->inode_num;
-    }
-    offset += sizeof(DirEntry);
-  }
-
-  return -1;
 }
 
-// File descriptor management
-int VirtualFileSystem::allocate_fd() {
-  int fd = next_fd_++;
-  fd_table_[fd] = FileDescriptor();
-  return fd;
+void VirtualFileSystem::save_fd_readahead(int fd,
+                                          const FileDescriptor &file_desc) {
+  std::lock_guard<std::mutex> lock(fd_mutex_);
+  auto it = fd_table_.find(fd);
+  if (it != fd_table_.end()) {
+    it->second.ra_last = file_desc.ra_last;
+    it->second.ra_end = file_desc.ra_end;
+    it->second.ra_window = file_desc.ra_window;
+  }
 }
 
-void VirtualFileSystem::free_fd(int fd) { fd_table_.erase(fd); }
-
 // Public file operations
 int VirtualFileSystem::create_file(const std::string &path, uint32_t mode) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
@@ -266,13 +125,15 @@ int VirtualFileSystem::create_file(const std::string &path, uint32_t mode) {
     return -1; // Parent directory not found
   }
 
+  auto parent_lock = inode_locks_.lock_exclusive(parent_inode);
+
   // Check if file already exists
   if (find_dir_entry(parent_inode, name) >= 0) {
     return -2; // File already exists
   }
 
   // Allocate inode
-  uint32_t inode_num = allocate_inode();
+  uint32_t inode_num = allocate_inode(S_IFREG | (mode & 0777));
   if (inode_num == static_cast<uint32_t>(-1)) {
     return -3; // No free inodes
   }
@@ -303,7 +164,7 @@ int VirtualFileSystem::create_file(const std::string &path, uint32_t mode) {
 }
 
 int VirtualFileSystem::mkdir(const std::string &path, uint32_t mode) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
@@ -315,11 +176,13 @@ int VirtualFileSystem::mkdir(const std::string &path, uint32_t mode) {
     return -1;
   }
 
+  auto parent_lock = inode_locks_.lock_exclusive(parent_inode);
+
   if (find_dir_entry(parent_inode, name) >= 0) {
     return -2; // Already exists
   }
 
-  uint32_t inode_num = allocate_inode();
+  uint32_t inode_num = allocate_inode(S_IFDIR | (mode & 0777));
   if (inode_num == static_cast<uint32_t>(-1)) {
     return -3;
   }
@@ -369,6 +232,7 @@ bool VirtualFileSystem::is_directory(const std::string &path) {
     return false;
   }
 
+  auto inode_lock = inode_locks_.lock_shared(inode_num);
   Inode inode;
   if (!read_inode(inode_num, inode)) {
     return false;
@@ -378,7 +242,7 @@ bool VirtualFileSystem::is_directory(const std::string &path) {
 }
 
 int VirtualFileSystem::readdir(const std::string &path,
-                               std::vector<DirEntry> &entries) {
+                               std::vector<DirEntryInfo> &entries) {
   std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
@@ -390,45 +254,13 @@ int VirtualFileSystem::readdir(const std::string &path,
     return -1;
   }
 
-  Inode inode;
-  if (!read_inode(inode_num, inode)) {
-    return -1;
-  }
-
-  if ((inode.mode & S_IFMT) != S_IFDIR) {
-    return -2; // Not a directory
-  }
-
-  entries.clear();
-
-  if (inode.blocks_count == 0) {
-    return 0; // Empty directory
-  }
-
-  std::vector<char> block_data;
-  if (!read_block(inode.direct_blocks[0], block_data)) {
-    return -1;
-  }
-
-  size_t offset = 0;
-  while (offset + sizeof(DirEntry) <= BLOCK_SIZE) {
-    DirEntry *entry = reinterpret_cast<DirEntry *>(block_data.data() + offset);
-    if (entry->inode_num != 0) {
-      entries.push_back(*entry);
-    }
-    offset += sizeof(DirEntry);
-  }
-
-  return 0;
+  auto dir_lock = inode_locks_.lock_shared(inode_num);
+  return read_dir_entries(inode_num, entries);
 }
 
 // Backup operations (simplified implementation)
 bool VirtualFileSystem::create_backup(const std::string &backup_name) {
-  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
-
-  if (!mounted_) {
-    return false;
-  }
+  // create_snapshot takes fs_mutex_ exclusively and checks mounted_ itself
   return create_snapshot(backup_name);
 }
 
@@ -452,6 +284,10 @@ bool VirtualFileSystem::create_snapshot(const std::string &name) {
     return false;
   }
 
+  // Inode updates made before the snapshot must not be recorded as the
+  // snapshot's old contents when they are written back later
+  flush_inodes();
+
   std::string diff_path = image_path_ + ".snap." + name + ".diff";
   SnapshotMeta meta;
   meta.name = name;
@@ -1,11 +1,15 @@
 #include "filesystem/vfs.h"
+#include <algorithm>
+#include <array>
+#include <climits>
 #include <fcntl.h>
+#include <optional>
 #include <unistd.h>
 #include <cstring>
 namespace vfs {
 
 int VirtualFileSystem::open(const std::string &path, int flags) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
@@ -16,6 +20,17 @@ int VirtualFileSystem::open(const std::string &path, int flags) {
     return -1; // File not found
   }
 
+  // Truncation rewrites the block map and needs the inode exclusively; a
+  // plain open only refreshes atime.
+  bool truncate = (flags & O_TRUNC) && ((flags & O_WRONLY) || (flags & O_RDWR));
+  InodeLockTable::ExclusiveLock exclusive_lock;
+  InodeLockTable::SharedLock shared_lock;
+  if (truncate) {
+    exclusive_lock = inode_locks_.lock_exclusive(inode_num);
+  } else {
+    shared_lock = inode_locks_.lock_shared(inode_num);
+  }
+
   Inode inode;
   if (!read_inode(inode_num, inode)) {
     return -1;
@@ -26,83 +41,605 @@ int VirtualFileSystem::open(const std::string &path, int flags) {
   }
 
   // Handle truncation if requested (and writing is allowed)
-  if ((flags & O_TRUNC) && ((flags & O_WRONLY) || (flags & O_RDWR))) {
-    // Free direct blocks
-    for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
-      if (inode.direct_blocks[i] != 0) {
-        free_block(inode.direct_blocks[i]);
-        inode.direct_blocks[i] = 0;
-      }
-    }
-
-    // Free indirect block
-    if (inode.indirect_block != 0) {
-      std::vector<char> indirect_data;
-      if (read_block(inode.indirect_block, indirect_data)) {
-        uint32_t *ptrs = reinterpret_cast<uint32_t *>(indirect_data.data());
-        uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
-
-        for (uint32_t i = 0; i < ptrs_per_block; ++i) {
-          if (ptrs[i] != 0) {
-            free_block(ptrs[i]);
-          }
-        }
-      }
-      free_block(inode.indirect_block);
-      inode.indirect_block = 0;
-    }
-
-    // Double indirect would go here if/when supported
-
+  if (truncate) {
+    free_inode_blocks(inode);
     inode.size = 0;
-    inode.blocks_count = 0;
     inode.mtime = std::time(nullptr);
     write_inode(inode_num, inode);
   }
 
-  int fd = allocate_fd();
-  FileDescriptor &file_desc = fd_table_[fd];
-  file_desc.inode_num = inode_num;
-  file_desc.offset = 0;
-  file_desc.flags = flags;
-  file_desc.is_open = true;
+  int fd;
+  {
+    std::lock_guard<std::mutex> fd_lock(fd_mutex_);
+    fd = allocate_fd();
+    FileDescriptor &file_desc = fd_table_[fd];
+    file_desc.inode_num = inode_num;
+    file_desc.offset = 0;
+    file_desc.flags = flags;
+    file_desc.is_open = true;
+    file_desc.map_cache = std::make_shared<BlockMapCache>();
+    file_desc.offset_mutex = std::make_shared<std::mutex>();
+    inode_cache_->retain(inode_num); // keep an open file's inode cached
+  }
 
-  // Update access time
-  inode.atime = std::time(nullptr);
-  write_inode(inode_num, inode);
+  update_atime(inode_num, inode);
 
   return fd;
 }
 
 int VirtualFileSystem::close(int fd) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
   }
 
+  std::lock_guard<std::mutex> fd_lock(fd_mutex_);
   auto it = fd_table_.find(fd);
   if (it == fd_table_.end() || !it->second.is_open) {
     return -1; // Invalid file descriptor
   }
 
+  inode_cache_->release(it->second.inode_num);
   free_fd(fd);
   return 0;
 }
 
+namespace {
+
+constexpr uint32_t PTRS_PER_BLOCK = BLOCK_SIZE / sizeof(uint32_t);
+
+// Splits a file block index into the offsets taken at each pointer block
+// on its way down. Returns the number of pointer blocks (0 for direct
+// blocks, 1..3 for single/double/triple indirect), or -1 past the triple
+// indirect range.
+int indirect_path(uint32_t block_index, uint32_t *offsets) {
+  if (block_index < DIRECT_BLOCKS) {
+    return 0;
+  }
+  uint64_t index = block_index - DIRECT_BLOCKS;
+  uint64_t span = PTRS_PER_BLOCK;
+  for (int depth = 1; depth <= 3; ++depth) {
+    if (index < span) {
+      for (int level = depth - 1; level >= 0; --level) {
+        offsets[level] = static_cast<uint32_t>(index % PTRS_PER_BLOCK);
+        index /= PTRS_PER_BLOCK;
+      }
+      return depth;
+    }
+    index -= span;
+    span *= PTRS_PER_BLOCK;
+  }
+  return -1;
+}
+
+uint32_t indirect_root(const Inode &inode, int depth) {
+  return depth == 1 ? inode.indirect_block
+         : depth == 2 ? inode.double_indirect
+                      : inode.triple_indirect;
+}
+
+uint32_t &indirect_root(Inode &inode, int depth) {
+  return depth == 1 ? inode.indirect_block
+         : depth == 2 ? inode.double_indirect
+                      : inode.triple_indirect;
+}
+
+} // namespace
+
+uint32_t VirtualFileSystem::lookup_block(const Inode &inode,
+                                         uint32_t block_index,
+                                         MapView &view) {
+  if (uses_extents()) {
+    return lookup_extent(inode, block_index, view);
+  }
+
+  uint32_t offsets[MAP_LEVELS];
+  int depth = indirect_path(block_index, offsets);
+  if (depth <= 0) {
+    return depth == 0 ? inode.direct_blocks[block_index] : 0;
+  }
+
+  // Walk down the pointer blocks, reusing those already pinned in the view
+  uint32_t block_num = indirect_root(inode, depth);
+  for (int level = 0; level < depth && block_num != 0; ++level) {
+    if (view.block_nums[level] != block_num) {
+      if (!read_block(block_num, view.blocks[level])) {
+        view.block_nums[level] = 0;
+        return 0;
+      }
+      view.block_nums[level] = block_num;
+    }
+    block_num = reinterpret_cast<const uint32_t *>(
+        view.blocks[level].data())[offsets[level]];
+  }
+  return block_num;
+}
+
+uint32_t VirtualFileSystem::map_block_for_write(Inode &inode,
+                                                uint32_t block_index,
+                                                MapPath &path, bool &fresh) {
+  if (uses_extents()) {
+    return map_extent_for_write(inode, block_index, path, fresh);
+  }
+  fresh = false;
+
+  uint32_t offsets[MAP_LEVELS];
+  int depth = indirect_path(block_index, offsets);
+  if (depth < 0) {
+    return 0; // Beyond the triple indirect range
+  }
+
+  // Follow (allocating as needed) the pointer blocks down to the data
+  // pointer. Inode fields are written back by the caller; pointer block
+  // changes mark their level dirty.
+  uint32_t *slot = depth == 0 ? &inode.direct_blocks[block_index]
+                              : &indirect_root(inode, depth);
+  for (int level = 0; level <= depth; ++level) {
+    bool data = level == depth;
+    if (*slot == 0) {
+      if (!data && !flush_map_block(path, path.levels[level])) {
+        return 0;
+      }
+      uint32_t block_num =
+          data ? allocate_data_block(path, 0) : allocate_block();
+      if (block_num == static_cast<uint32_t>(-1)) {
+        return 0; // No free blocks
+      }
+      *slot = block_num;
+      if (level > 0) {
+        path.levels[level - 1].dirty = true;
+      }
+      if (data) {
+        inode.blocks_count++;
+        fresh = true;
+      } else {
+        MapBlock &map = path.levels[level];
+        std::memset(map.frame.data(), 0, BLOCK_SIZE);
+        map.block_num = block_num;
+        map.dirty = true;
+      }
+    } else if (!data && !load_map_block(path, path.levels[level], *slot)) {
+      return 0;
+    }
+    if (!data) {
+      slot = &reinterpret_cast<uint32_t *>(
+          path.levels[level].frame.data())[offsets[level]];
+    }
+  }
+  return *slot;
+}
+
+bool VirtualFileSystem::load_map_block(MapPath &path, MapBlock &map,
+                                       uint32_t block_num) {
+  if (map.block_num == block_num) {
+    return true;
+  }
+  if (!flush_map_block(path, map)) {
+    return false;
+  }
+  BlockHandle current;
+  if (!read_block(block_num, current)) {
+    return false;
+  }
+  std::memcpy(map.frame.data(), current.data(), BLOCK_SIZE);
+  map.block_num = block_num;
+  return true;
+}
+
+bool VirtualFileSystem::flush_map_block(MapPath &path, MapBlock &map) {
+  if (!map.dirty) {
+    return true;
+  }
+  if (!write_pending_data(path) ||
+      !write_block(map.block_num, map.frame.data())) {
+    return false;
+  }
+  map.dirty = false;
+  return true;
+}
+
+bool VirtualFileSystem::flush_map_path(MapPath &path) {
+  bool ok = true;
+  for (MapBlock &map : path.levels) {
+    ok = flush_map_block(path, map) && ok;
+  }
+  return ok;
+}
+
+bool VirtualFileSystem::write_pending_data(MapPath &path) {
+  if (path.pending == 0) {
+    return true;
+  }
+  if (!write_blocks(path.pending_blocks, path.pending_datas, path.pending,
+                    true)) {
+    return false;
+  }
+  path.pending = 0;
+  return true;
+}
+
+uint32_t VirtualFileSystem::allocate_data_block(MapPath &path, uint32_t goal) {
+  if (path.reserved == path.reserved_end) {
+    if (path.wanted <= 1) {
+      path.wanted = 0;
+      return allocate_block(goal);
+    }
+    // Reserve the rest of the transfer as one run, so its data stays
+    // contiguous even when other files allocate meanwhile
+    uint32_t length = 0;
+    uint32_t start = allocate_range(path.wanted, goal, length);
+    if (start == static_cast<uint32_t>(-1)) {
+      return start;
+    }
+    path.reserved = start;
+    path.reserved_end = start + length;
+  }
+  if (path.wanted > 0) {
+    path.wanted--;
+  }
+  return path.reserved++;
+}
+
+void VirtualFileSystem::release_reservation(MapPath &path) {
+  for (; path.reserved < path.reserved_end; ++path.reserved) {
+    free_block(path.reserved);
+  }
+  path.wanted = 0;
+}
+
+void VirtualFileSystem::free_inode_blocks(Inode &inode) {
+  // Freed blocks may be reused by any file; drop every cached translation
+  map_generation_++;
+
+  if (uses_extents()) {
+    free_extent_blocks(inode);
+    return;
+  }
+
+  // Free direct blocks
+  for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
+    if (inode.direct_blocks[i] != 0) {
+      free_block(inode.direct_blocks[i]);
+      inode.direct_blocks[i] = 0;
+    }
+  }
+
+  // Free single, double and triple indirect trees
+  for (int depth = 1; depth <= 3; ++depth) {
+    uint32_t &root = indirect_root(inode, depth);
+    if (root != 0) {
+      free_indirect_tree(root, depth, true);
+      root = 0;
+    }
+  }
+  inode.blocks_count = 0;
+}
+
+bool VirtualFileSystem::map_cache_covers(const BlockMapCache &cache,
+                                         uint32_t block_index) const {
+  return cache.generation == map_generation_.load() &&
+         block_index - cache.first < cache.count;
+}
+
+void VirtualFileSystem::fill_map_cache(BlockMapCache &cache,
+                                       const Inode &inode,
+                                       uint32_t block_index, MapView &view) {
+  // The window behind one pointer block, resolved in one pass
+  uint32_t first = 0;
+  uint32_t count = DIRECT_BLOCKS;
+  if (block_index >= DIRECT_BLOCKS) {
+    first = block_index - (block_index - DIRECT_BLOCKS) % PTRS_PER_BLOCK;
+    count = PTRS_PER_BLOCK;
+  }
+  cache.generation = map_generation_.load();
+  for (uint32_t i = 0; i < count; ++i) {
+    cache.physical[i] = lookup_block(inode, first + i, view);
+  }
+  cache.first = first;
+  cache.count = count;
+}
+
+uint32_t VirtualFileSystem::lookup_cached(BlockMapCache &cache,
+                                          const Inode &inode,
+                                          uint32_t block_index,
+                                          MapView &view) {
+  if (!map_cache_covers(cache, block_index)) {
+    fill_map_cache(cache, inode, block_index, view);
+  }
+
+  // Unmapped when the window was filled, but maybe written since
+  uint32_t &physical = cache.physical[block_index - cache.first];
+  if (physical == 0) {
+    physical = lookup_block(inode, block_index, view);
+  }
+  return physical;
+}
+
+void VirtualFileSystem::free_indirect_tree(uint32_t block_num, uint32_t depth,
+                                           bool free_data) {
+  BlockHandle block;
+  if (read_block(block_num, block)) {
+    const uint32_t *ptrs = reinterpret_cast<const uint32_t *>(block.data());
+    for (uint32_t i = 0; i < PTRS_PER_BLOCK; ++i) {
+      if (ptrs[i] == 0) {
+        continue;
+      }
+      if (depth > 1) {
+        free_indirect_tree(ptrs[i], depth - 1, free_data);
+      } else if (free_data) {
+        free_block(ptrs[i]);
+      }
+    }
+  }
+  free_block(block_num);
+}
+
+namespace {
+
+// Blocks per read_blocks/write_blocks batch (1 MiB of I/O)
+constexpr size_t MAX_IO_BATCH = 256;
+
+// Readahead window for the first sequential read; doubles per read
+constexpr uint32_t INITIAL_READAHEAD = 4;
+
+// Bounce frames per batch for blocks that are partial or straddle
+// segments of a scatter list; a batch ends early when they run out
+constexpr size_t MAX_IO_BOUNCE = 8;
+
+// Byte positions in a scatter list, as if its segments were one buffer
+class IoVecCursor {
+public:
+  IoVecCursor(const struct iovec *iov, int iovcnt)
+      : iov_(iov), iovcnt_(iovcnt) {}
+
+  // The len bytes at pos when they sit in one segment, else nullptr
+  char *contiguous(size_t pos, size_t len) {
+    seek(pos);
+    if (segment_ == iovcnt_ || pos - start_ + len > iov_[segment_].iov_len) {
+      return nullptr;
+    }
+    return static_cast<char *>(iov_[segment_].iov_base) + (pos - start_);
+  }
+
+  void copy_out(size_t pos, const char *src, size_t len) {
+    for_pieces(pos, len, [&](char *piece, size_t n) {
+      std::memcpy(piece, src, n);
+      src += n;
+    });
+  }
+
+  void copy_in(size_t pos, char *dst, size_t len) {
+    for_pieces(pos, len, [&](char *piece, size_t n) {
+      std::memcpy(dst, piece, n);
+      dst += n;
+    });
+  }
+
+private:
+  void seek(size_t pos) {
+    if (pos < start_) {
+      segment_ = 0;
+      start_ = 0;
+    }
+    while (segment_ < iovcnt_ && pos >= start_ + iov_[segment_].iov_len) {
+      start_ += iov_[segment_].iov_len;
+      ++segment_;
+    }
+  }
+
+  template <typename Fn> void for_pieces(size_t pos, size_t len, Fn fn) {
+    while (len > 0) {
+      seek(pos);
+      size_t n = std::min(len, iov_[segment_].iov_len - (pos - start_));
+      fn(static_cast<char *>(iov_[segment_].iov_base) + (pos - start_), n);
+      pos += n;
+      len -= n;
+    }
+  }
+
+  const struct iovec *iov_;
+  int iovcnt_;
+  int segment_ = 0;
+  size_t start_ = 0; // list position of segment_
+};
+
+// Total length of a scatter list, or -1 if it is invalid
+ssize_t iov_length(const struct iovec *iov, int iovcnt) {
+  if (iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt > 0 && iov == nullptr)) {
+    return -1;
+  }
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    if (iov[i].iov_len > static_cast<size_t>(SSIZE_MAX) - total) {
+      return -1;
+    }
+    total += iov[i].iov_len;
+  }
+  return static_cast<ssize_t>(total);
+}
+
+} // namespace
+
+void VirtualFileSystem::plan_readahead(FileDescriptor &file_desc,
+                                       const Inode &inode,
+                                       uint32_t first_block,
+                                       uint32_t last_block, uint32_t &start,
+                                       uint32_t &stop) {
+  start = stop = 0;
+
+  // A read is sequential if it starts where the previous one ended (in
+  // the same block or the next); a fresh fd at offset 0 counts too
+  bool sequential = first_block == file_desc.ra_last ||
+                    first_block == file_desc.ra_last + 1;
+  file_desc.ra_last = last_block;
+  if (!sequential || readahead_max_ == 0) {
+    file_desc.ra_window = 0;
+    file_desc.ra_end = 0;
+    return;
+  }
+
+  file_desc.ra_window =
+      file_desc.ra_window == 0
+          ? std::min(INITIAL_READAHEAD, readahead_max_)
+          : std::min(file_desc.ra_window * 2, readahead_max_);
+
+  // Top the window up only once less than half of it is left ahead of
+  // the reader, so prefetches go out in reasonably large batches
+  uint32_t ahead = last_block + 1;
+  if (file_desc.ra_end >= ahead + file_desc.ra_window / 2) {
+    return;
+  }
+  uint32_t file_blocks =
+      static_cast<uint32_t>((inode.size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  start = std::max(file_desc.ra_end, ahead);
+  stop = std::min(ahead + file_desc.ra_window, file_blocks);
+  file_desc.ra_end = std::max(file_desc.ra_end, stop);
+}
+
+void VirtualFileSystem::start_readahead(const Inode &inode, uint32_t start,
+                                        uint32_t stop) {
+  // Mapping goes through the cache, so map blocks are fetched (and stay
+  // cached) along with the window
+  MapView map;
+  std::array<uint32_t, MAX_IO_BATCH> blocks;
+  size_t nblocks = 0;
+  for (uint32_t i = start; i < stop && nblocks < MAX_IO_BATCH; ++i) {
+    uint32_t physical_block = lookup_block(inode, i, map);
+    if (physical_block != 0) {
+      blocks[nblocks++] = physical_block;
+    }
+  }
+  if (nblocks == 0) {
+    return;
+  }
+
+  // Register the blocks under their I/O locks: a concurrent write either
+  // finished first (its block is cached or on the device) or will cancel
+  // the prefetch
+  std::vector<uint32_t> block_nums;
+  {
+    BlockStripeGuard io_locks(*this, blocks.data(), nblocks);
+    size_t wanted = 0;
+    for (size_t i = 0; i < nblocks; ++i) {
+      if (!cache_->contains(blocks[i]) &&
+          !(write_back_ && find_dirty(blocks[i]))) {
+        blocks[wanted++] = blocks[i];
+      }
+    }
+    std::lock_guard<std::mutex> lock(readahead_mutex_);
+    for (size_t i = 0; i < wanted; ++i) {
+      if (readahead_inflight_.insert(blocks[i]).second) {
+        block_nums.push_back(blocks[i]);
+      }
+    }
+    if (block_nums.empty()) {
+      return;
+    }
+    readahead_batches_++;
+  }
+
+  std::vector<BlockBuffer *> buffers(block_nums.size());
+  std::vector<void *> outs(block_nums.size());
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    buffers[i] = BlockBuffer::create();
+    outs[i] = buffers[i]->data;
+  }
+
+  if (!device_->IsAsync()) {
+    bool ok = device_->ReadBlocks(block_nums.data(), outs.data(),
+                                  block_nums.size());
+    finish_readahead(block_nums.data(), buffers.data(), block_nums.size(), ok);
+    return;
+  }
+
+  std::vector<uint32_t> ids = block_nums;
+  device_->ReadBlocksAsync(
+      std::move(ids), std::move(outs),
+      [this, block_nums, buffers](bool ok) {
+        finish_readahead(block_nums.data(), buffers.data(),
+                         block_nums.size(), ok);
+      });
+}
+
+void VirtualFileSystem::finish_readahead(const uint32_t *block_nums,
+                                         BlockBuffer *const *buffers,
+                                         size_t count, bool ok) {
+  std::lock_guard<std::mutex> lock(readahead_mutex_);
+  for (size_t i = 0; i < count; ++i) {
+    BlockHandle handle = BlockHandle::adopt(buffers[i]);
+    // Blocks written meanwhile were taken out of the set by the writer
+    if (readahead_inflight_.erase(block_nums[i]) > 0 && ok) {
+      cache_->prefetch(block_nums[i], handle);
+    }
+  }
+  if (--readahead_batches_ == 0) {
+    readahead_cv_.notify_all();
+  }
+}
+
+void VirtualFileSystem::cancel_readahead(const uint32_t *block_nums,
+                                         size_t count) {
+  // Callers hold the blocks' I/O locks, which order this check after any
+  // registration of the same blocks
+  if (readahead_batches_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(readahead_mutex_);
+  for (size_t i = 0; i < count; ++i) {
+    readahead_inflight_.erase(block_nums[i]);
+  }
+}
+
+void VirtualFileSystem::wait_for_readahead() {
+  std::unique_lock<std::mutex> lock(readahead_mutex_);
+  readahead_cv_.wait(lock, [this]() { return readahead_batches_ == 0; });
+}
+
 ssize_t VirtualFileSystem::read(int fd, void *buffer, size_t count) {
+  struct iovec iov = {buffer, count};
+  return read_vec(fd, &iov, 1, -1);
+}
+
+ssize_t VirtualFileSystem::readv(int fd, const struct iovec *iov, int iovcnt) {
+  return read_vec(fd, iov, iovcnt, -1);
+}
+
+ssize_t VirtualFileSystem::preadv(int fd, const struct iovec *iov, int iovcnt,
+                                  off_t offset) {
+  return offset < 0 ? -1 : read_vec(fd, iov, iovcnt, offset);
+}
+
+ssize_t VirtualFileSystem::read_vec(int fd, const struct iovec *iov,
+                                    int iovcnt, off_t offset) {
   std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
   }
 
-  auto it = fd_table_.find(fd);
-  if (it == fd_table_.end() || !it->second.is_open) {
+  ssize_t count = iov_length(iov, iovcnt);
+  if (count < 0) {
+    return -1;
+  }
+
+  FileDescriptor file_desc;
+  if (!get_fd(fd, file_desc)) {
     return -1;
   }
+  // Positional reads leave the shared offset alone; others take it under
+  // the descriptor's offset lock and hold that until they move it on
+  bool positional = offset >= 0;
+  std::unique_lock<std::mutex> offset_lock;
+  if (!positional) {
+    offset_lock = std::unique_lock<std::mutex>(*file_desc.offset_mutex);
+    if (!get_fd(fd, file_desc)) {
+      return -1;
+    }
+  }
+  uint64_t start = positional ? offset : file_desc.offset;
 
-  FileDescriptor &file_desc = it->second;
+  auto inode_lock = inode_locks_.lock_shared(file_desc.inode_num);
 
   Inode inode;
   if (!read_inode(file_desc.inode_num, inode)) {
@@ -110,85 +647,157 @@ ssize_t VirtualFileSystem::read(int fd, void *buffer, size_t count) {
   }
 
   // Calculate how much to read
-  if (file_desc.offset >= inode.size) {
+  if (start >= inode.size || count == 0) {
     return 0; // EOF
   }
 
   size_t to_read =
-      std::min(count, static_cast<size_t>(inode.size - file_desc.offset));
+      std::min(static_cast<size_t>(count),
+               static_cast<size_t>(inode.size - start));
   size_t bytes_read = 0;
-  char *buf = static_cast<char *>(buffer);
+  IoVecCursor cursor(iov, iovcnt);
+
+  // Prefetch ahead of sequential readers before serving this read, so an
+  // asynchronous device overlaps the two
+  uint32_t ra_start, ra_stop;
+  plan_readahead(file_desc, inode, start / BLOCK_SIZE,
+                 (start + to_read - 1) / BLOCK_SIZE, ra_start, ra_stop);
+  if (ra_start < ra_stop) {
+    start_readahead(inode, ra_start, ra_stop);
+  }
+
+  // Everything below lives on the stack or in pooled frames: whole blocks
+  // that land in one segment are read in place, the rest (partial blocks
+  // at the edges, blocks straddling segments) go through bounce frames.
+  // The map cache is only locked while a batch is mapped, so positional
+  // readers of one fd overlap their I/O; the shared inode lock keeps the
+  // mapped blocks from being freed meanwhile.
+  BlockMapCache &map_cache = *file_desc.map_cache;
+  MapView map;
+  std::array<uint32_t, MAX_IO_BATCH> blocks;
+  std::array<char *, MAX_IO_BATCH> outs;
+  std::array<std::optional<ScratchBlock>, MAX_IO_BOUNCE> bounce;
+  struct PartialCopy {
+    const char *src;
+    size_t pos; // in the scatter list
+    size_t size;
+  } partials[MAX_IO_BOUNCE];
 
   while (bytes_read < to_read) {
-    uint64_t current_pos = file_desc.offset + bytes_read;
-    uint32_t block_index = current_pos / BLOCK_SIZE;
-    uint32_t offset_in_block = current_pos % BLOCK_SIZE;
-
-    // Get physical block number
-    uint32_t physical_block = 0;
-    if (block_index < DIRECT_BLOCKS) {
-      physical_block = inode.direct_blocks[block_index];
-    } else {
-      // Handle single indirect blocks
-      uint32_t indirect_index = block_index - DIRECT_BLOCKS;
-      uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
-
-      if (indirect_index < ptrs_per_block) {
-        if (inode.indirect_block != 0) {
-          std::vector<char> indirect_data;
-          if (const_cast<VirtualFileSystem *>(this)->read_block(
-                  inode.indirect_block, indirect_data)) {
-            uint32_t *ptrs = reinterpret_cast<uint32_t *>(indirect_data.data());
-            physical_block = ptrs[indirect_index];
-          }
-        }
-      } else {
-        // Handle double indirect blocks if needed, but for now we stop here
+    // Map up to MAX_IO_BATCH blocks, then fetch them in one go
+    size_t nblocks = 0;
+    size_t npartials = 0;
+    size_t batched = 0;
+    bool hole = false;
+
+    std::unique_lock<std::mutex> map_lock(map_cache.mutex);
+    while (bytes_read + batched < to_read && nblocks < MAX_IO_BATCH) {
+      uint64_t current_pos = start + bytes_read + batched;
+      uint32_t block_index = current_pos / BLOCK_SIZE;
+      uint32_t offset_in_block = current_pos % BLOCK_SIZE;
+
+      size_t copy_size =
+          std::min(to_read - bytes_read - batched,
+                   static_cast<size_t>(BLOCK_SIZE - offset_in_block));
+      char *dst = copy_size == BLOCK_SIZE
+                      ? cursor.contiguous(bytes_read + batched, copy_size)
+                      : nullptr;
+      if (dst == nullptr && npartials == MAX_IO_BOUNCE) {
+        break;
+      }
+
+      uint32_t physical_block =
+          lookup_cached(map_cache, inode, block_index, map);
+      if (physical_block == 0) {
+        hole = true; // Sparse file or reaching end of allocated blocks
         break;
       }
-    }
 
-    if (physical_block == 0) {
-      break; // Sparse file or reaching end of allocated blocks
+      if (dst != nullptr) {
+        outs[nblocks] = dst;
+      } else {
+        if (!bounce[npartials]) {
+          bounce[npartials].emplace();
+        }
+        char *block = bounce[npartials]->data();
+        partials[npartials++] = {block + offset_in_block, bytes_read + batched,
+                                 copy_size};
+        outs[nblocks] = block;
+      }
+      blocks[nblocks++] = physical_block;
+      batched += copy_size;
     }
+    map_lock.unlock();
 
-    // Read from block
-    std::vector<char> block_data;
-    if (!const_cast<VirtualFileSystem *>(this)->read_block(physical_block,
-                                                           block_data)) {
+    if (nblocks == 0 || !read_blocks(blocks.data(), outs.data(), nblocks)) {
       break;
     }
+    for (size_t i = 0; i < npartials; ++i) {
+      cursor.copy_out(partials[i].pos, partials[i].src, partials[i].size);
+    }
+    bytes_read += batched;
 
-    size_t copy_size =
-        std::min(to_read - bytes_read,
-                 static_cast<size_t>(BLOCK_SIZE - offset_in_block));
-    std::memcpy(buf + bytes_read, block_data.data() + offset_in_block,
-                copy_size);
-    bytes_read += copy_size;
+    if (hole) {
+      break;
+    }
   }
 
-  // Update offset and access time
-  const_cast<FileDescriptor &>(file_desc).offset += bytes_read;
-  inode.atime = std::time(nullptr);
-  const_cast<VirtualFileSystem *>(this)->write_inode(file_desc.inode_num,
-                                                     inode);
+  // Update offset, readahead state and access time
+  if (!positional) {
+    set_fd_offset(fd, start + bytes_read);
+  }
+  save_fd_readahead(fd, file_desc);
+  update_atime(file_desc.inode_num, inode);
 
   return bytes_read;
 }
 
 ssize_t VirtualFileSystem::write(int fd, const void *buffer, size_t count) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  struct iovec iov = {const_cast<void *>(buffer), count};
+  return write_vec(fd, &iov, 1, -1);
+}
+
+ssize_t VirtualFileSystem::writev(int fd, const struct iovec *iov,
+                                  int iovcnt) {
+  return write_vec(fd, iov, iovcnt, -1);
+}
+
+ssize_t VirtualFileSystem::pwritev(int fd, const struct iovec *iov, int iovcnt,
+                                   off_t offset) {
+  return offset < 0 ? -1 : write_vec(fd, iov, iovcnt, offset);
+}
+
+ssize_t VirtualFileSystem::write_vec(int fd, const struct iovec *iov,
+                                     int iovcnt, off_t offset) {
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
   }
 
-  auto it = fd_table_.find(fd);
-  if (it == fd_table_.end() || !it->second.is_open) {
+  ssize_t total = iov_length(iov, iovcnt);
+  if (total < 0) {
     return -1;
   }
+  size_t count = total;
 
-  FileDescriptor &file_desc = it->second;
+  FileDescriptor file_desc;
+  if (!get_fd(fd, file_desc)) {
+    return -1;
+  }
+  // Positional writes leave the shared offset alone; others take it under
+  // the descriptor's offset lock and hold that until they move it on
+  bool positional = offset >= 0;
+  std::unique_lock<std::mutex> offset_lock;
+  if (!positional) {
+    offset_lock = std::unique_lock<std::mutex>(*file_desc.offset_mutex);
+    if (!get_fd(fd, file_desc)) {
+      return -1;
+    }
+  }
+  uint64_t start = positional ? offset : file_desc.offset;
+
+  auto inode_lock = inode_locks_.lock_exclusive(file_desc.inode_num);
 
   Inode inode;
   if (!read_inode(file_desc.inode_num, inode)) {
@@ -196,112 +805,186 @@ ssize_t VirtualFileSystem::write(int fd, const void *buffer, size_t count) {
   }
 
   size_t bytes_written = 0;
-  const char *buf = static_cast<const char *>(buffer);
+  IoVecCursor cursor(iov, iovcnt);
+  if (count == 0) {
+    return 0;
+  }
+  uint32_t last_block = (start + count - 1) / BLOCK_SIZE;
+
+  BlockMapCache &map_cache = *file_desc.map_cache;
+  std::unique_lock<std::mutex> map_lock(map_cache.mutex);
+  MapView view;
+  MapPath map;
+  std::array<uint32_t, MAX_IO_BATCH> blocks;
+  std::array<const char *, MAX_IO_BATCH> datas;
+  std::array<bool, MAX_IO_BATCH> fresh_blocks;
+  std::array<std::optional<ScratchBlock>, MAX_IO_BOUNCE> bounce;
+  map.pending_blocks = blocks.data();
+  map.pending_datas = datas.data();
+  bool failed = false;
+
+  // The inode and map blocks as they were before the open batch mapped
+  // anything, to go back to if its data cannot be written
+  Inode saved_inode = inode;
+  MapPath saved_map;
+  auto save_map = [&] {
+    saved_inode = inode;
+    for (size_t level = 0; level < MAP_LEVELS; ++level) {
+      MapBlock &from = map.levels[level];
+      MapBlock &to = saved_map.levels[level];
+      to.block_num = from.block_num;
+      to.dirty = from.dirty;
+      if (from.block_num != 0) {
+        std::memcpy(to.frame.data(), from.frame.data(), BLOCK_SIZE);
+      }
+    }
+  };
+  auto restore_map = [&] {
+    inode = saved_inode;
+    map.pending = 0;
+    for (size_t level = 0; level < MAP_LEVELS; ++level) {
+      MapBlock &from = saved_map.levels[level];
+      MapBlock &to = map.levels[level];
+      to.block_num = from.block_num;
+      to.dirty = from.dirty;
+      if (from.block_num != 0) {
+        std::memcpy(to.frame.data(), from.frame.data(), BLOCK_SIZE);
+      }
+    }
+  };
 
   while (bytes_written < count) {
-    uint64_t current_pos = file_desc.offset + bytes_written;
-    uint32_t block_index = current_pos / BLOCK_SIZE;
-    uint32_t offset_in_block = current_pos % BLOCK_SIZE;
-
-    // Get or allocate physical block
-    uint32_t physical_block = 0;
-    if (block_index < DIRECT_BLOCKS) {
-      if (inode.direct_blocks[block_index] == 0) {
-        // Allocate new block
-        physical_block = allocate_block();
-        if (physical_block == static_cast<uint32_t>(-1)) {
-          break; // No free blocks
-        }
-        inode.direct_blocks[block_index] = physical_block;
-        inode.blocks_count++;
-
-        // Zero out new block
-        std::vector<char> zero_block(BLOCK_SIZE, 0);
-        write_block(physical_block, zero_block);
-      } else {
-        physical_block = inode.direct_blocks[block_index];
+    // Map (allocating as needed) up to MAX_IO_BATCH blocks and submit them
+    // as one batch. Whole blocks in one segment are written straight from
+    // the caller's buffer; others are gathered into bounce frames, and only
+    // partial edges of existing blocks are read first. New blocks are
+    // zero-filled in memory rather than on disk.
+    size_t nblocks = 0;
+    size_t nbounce = 0;
+    size_t batched = 0;
+    bool stop = false;
+    save_map();
+
+    // Writing a map block writes the open batch first (write_pending_data);
+    // once that happened the batch starts over
+    auto take_written = [&] {
+      if (map.pending < nblocks) {
+        bytes_written += batched;
+        nblocks = nbounce = batched = 0;
+        save_map();
+      }
+    };
+
+    while (bytes_written + batched < count && nblocks < MAX_IO_BATCH) {
+      uint64_t current_pos = start + bytes_written + batched;
+      uint32_t block_index = current_pos / BLOCK_SIZE;
+      uint32_t offset_in_block = current_pos % BLOCK_SIZE;
+
+      size_t copy_size =
+          std::min(count - bytes_written - batched,
+                   static_cast<size_t>(BLOCK_SIZE - offset_in_block));
+      const char *src =
+          copy_size == BLOCK_SIZE
+              ? cursor.contiguous(bytes_written + batched, copy_size)
+              : nullptr;
+      if (src == nullptr && nbounce == MAX_IO_BOUNCE) {
+        break;
       }
-    } else {
-      // Handle single indirect blocks
-      uint32_t indirect_index = block_index - DIRECT_BLOCKS;
-      uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
-
-      if (indirect_index < ptrs_per_block) {
-        if (inode.indirect_block == 0) {
-          // Allocate indirect block
-          uint32_t indirect_block_num = allocate_block();
-          if (indirect_block_num == static_cast<uint32_t>(-1)) {
-            break;
-          }
-          inode.indirect_block = indirect_block_num;
-          // Zero out indirect block
-          std::vector<char> zero_block(BLOCK_SIZE, 0);
-          write_block(indirect_block_num, zero_block);
-        }
 
-        // Read indirect block
-        std::vector<char> indirect_data;
-        if (!read_block(inode.indirect_block, indirect_data)) {
+      // Overwrites are translated through the fd's cache; unmapped blocks
+      // go down the block map to be allocated. The window is filled from
+      // map blocks as stored, so pending map updates are written first.
+      if (!map_cache_covers(map_cache, block_index)) {
+        bool flushed = flush_map_path(map);
+        take_written();
+        if (!flushed) {
+          stop = true;
           break;
         }
+        fill_map_cache(map_cache, inode, block_index, view);
+      }
+      bool fresh = false;
+      uint32_t &physical_block =
+          map_cache.physical[block_index - map_cache.first];
+      if (physical_block == 0) {
+        map.wanted = last_block - block_index + 1;
+        physical_block = map_block_for_write(inode, block_index, map, fresh);
+        take_written();
+        if (physical_block == 0) {
+          stop = true; // No free blocks, file too large or a failed write
+          break;
+        }
+      }
 
-        uint32_t *ptrs = reinterpret_cast<uint32_t *>(indirect_data.data());
-        if (ptrs[indirect_index] == 0) {
-          // Allocate new data block
-          uint32_t data_block_num = allocate_block();
-          if (data_block_num == static_cast<uint32_t>(-1)) {
-            break;
-          }
-          ptrs[indirect_index] = data_block_num;
-          inode.blocks_count++;
-
-          // Write updated indirect block
-          if (!write_block(inode.indirect_block, indirect_data)) {
-            break;
-          }
-
-          // Zero out new data block
-          std::vector<char> zero_block(BLOCK_SIZE, 0);
-          write_block(data_block_num, zero_block);
-          physical_block = data_block_num;
+      if (src != nullptr) {
+        datas[nblocks] = src;
+      } else {
+        if (!bounce[nbounce]) {
+          bounce[nbounce].emplace();
+        }
+        char *block = bounce[nbounce++]->data();
+        BlockHandle current;
+        if (copy_size == BLOCK_SIZE || fresh) {
+          std::memset(block, 0, BLOCK_SIZE);
+        } else if (read_block(physical_block, current)) {
+          std::memcpy(block, current.data(), BLOCK_SIZE);
         } else {
-          physical_block = ptrs[indirect_index];
+          stop = true;
+          break;
         }
-      } else {
-        // Double indirect omitted for now
-        break;
+        cursor.copy_in(bytes_written + batched, block + offset_in_block,
+                       copy_size);
+        datas[nblocks] = block;
       }
+      fresh_blocks[nblocks] = fresh;
+      blocks[nblocks++] = physical_block;
+      map.pending = nblocks;
+      batched += copy_size;
     }
 
-    if (physical_block == 0) {
-      break;
-    }
-
-    // Read existing block data
-    std::vector<char> block_data;
-    if (!read_block(physical_block, block_data)) {
+    if (nblocks > 0 &&
+        !write_blocks(blocks.data(), datas.data(), nblocks, true)) {
+      // Unmap the batch and give its new blocks back; nothing stored
+      // points at them yet. Earlier batches stay.
+      restore_map();
+      for (size_t i = 0; i < nblocks; ++i) {
+        if (fresh_blocks[i]) {
+          free_block(blocks[i]);
+        }
+      }
+      map_generation_++; // the fd's cache still holds the dropped mappings
+      failed = true;
       break;
     }
+    map.pending = 0;
+    bytes_written += batched;
 
-    // Modify block
-    size_t copy_size =
-        std::min(count - bytes_written,
-                 static_cast<size_t>(BLOCK_SIZE - offset_in_block));
-    std::memcpy(block_data.data() + offset_in_block, buf + bytes_written,
-                copy_size);
-
-    // Write back
-    if (!write_block(physical_block, block_data)) {
+    if (stop) {
       break;
     }
+  }
 
-    bytes_written += copy_size;
+  // Write updated map blocks once for the whole call, and give back
+  // reserved blocks the write did not use. If the map blocks do not reach
+  // the image, the inode keeps its stored map instead of pointing past
+  // them.
+  bool mapped = flush_map_path(map);
+  release_reservation(map);
+  if (!mapped) {
+    map_generation_++;
+    return -1;
+  }
+  if (failed && bytes_written == 0) {
+    return -1;
   }
 
   // Update file size and times
-  file_desc.offset += bytes_written;
-  if (file_desc.offset > inode.size) {
-    inode.size = file_desc.offset;
+  uint64_t end = start + bytes_written;
+  if (!positional) {
+    set_fd_offset(fd, end);
+  }
+  if (end > inode.size) {
+    inode.size = end;
   }
   inode.mtime = inode.atime = std::time(nullptr);
   write_inode(file_desc.inode_num, inode);
@@ -310,18 +993,22 @@ ssize_t VirtualFileSystem::write(int fd, const void *buffer, size_t count) {
 }
 
 off_t VirtualFileSystem::seek(int fd, off_t offset, int whence) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
   }
 
-  auto it = fd_table_.find(fd);
-  if (it == fd_table_.end() || !it->second.is_open) {
+  FileDescriptor file_desc;
+  if (!get_fd(fd, file_desc)) {
+    return -1;
+  }
+  std::lock_guard<std::mutex> offset_lock(*file_desc.offset_mutex);
+  if (!get_fd(fd, file_desc)) {
     return -1;
   }
 
-  FileDescriptor &file_desc = it->second;
+  auto inode_lock = inode_locks_.lock_shared(file_desc.inode_num);
 
   Inode inode;
   if (!read_inode(file_desc.inode_num, inode)) {
@@ -347,12 +1034,12 @@ off_t VirtualFileSystem::seek(int fd, off_t offset, int whence) {
     return -1;
   }
 
-  file_desc.offset = new_offset;
+  set_fd_offset(fd, new_offset);
   return new_offset;
 }
 
 int VirtualFileSystem::delete_file(const std::string &path) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
@@ -364,7 +1051,8 @@ int VirtualFileSystem::delete_file(const std::string &path) {
     return -1;
   }
 
-  int32_t inode_num = find_dir_entry(parent_inode, name);
+  int32_t inode_num = -1;
+  auto locks = lock_dir_entry(parent_inode, name, inode_num);
   if (inode_num < 0) {
     return -1; // File not found
   }
@@ -378,28 +1066,7 @@ int VirtualFileSystem::delete_file(const std::string &path) {
     return -2; // Not a regular file
   }
 
-  // Free direct blocks
-  for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
-    if (inode.direct_blocks[i] != 0) {
-      free_block(inode.direct_blocks[i]);
-    }
-  }
-
-  // Free indirect block
-  if (inode.indirect_block != 0) {
-    std::vector<char> indirect_data;
-    if (read_block(inode.indirect_block, indirect_data)) {
-      uint32_t *ptrs = reinterpret_cast<uint32_t *>(indirect_data.data());
-      uint32_t ptrs_per_block = BLOCK_SIZE / sizeof(uint32_t);
-
-      for (uint32_t i = 0; i < ptrs_per_block; ++i) {
-        if (ptrs[i] != 0) {
-          free_block(ptrs[i]);
-        }
-      }
-    }
-    free_block(inode.indirect_block);
-  }
+  free_inode_blocks(inode);
 
   // Free inode
   free_inode(inode_num);
@@ -411,7 +1078,7 @@ int VirtualFileSystem::delete_file(const std::string &path) {
 }
 
 int VirtualFileSystem::rmdir(const std::string &path) {
-  std::unique_lock<std::shared_mutex> lock(fs_mutex_);
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
 
   if (!mounted_) {
     return -1;
@@ -423,7 +1090,8 @@ int VirtualFileSystem::rmdir(const std::string &path) {
     return -1;
   }
 
-  int32_t inode_num = find_dir_entry(parent_inode, name);
+  int32_t inode_num = -1;
+  auto locks = lock_dir_entry(parent_inode, name, inode_num);
   if (inode_num < 0) {
     return -1;
   }
@@ -438,16 +1106,14 @@ int VirtualFileSystem::rmdir(const std::string &path) {
   }
 
   // Check if directory is empty
-  std::vector<DirEntry> entries;
-  int result = const_cast<VirtualFileSystem *>(this)->readdir(path, entries);
+  std::vector<DirEntryInfo> entries;
+  int result = read_dir_entries(inode_num, entries);
   if (result != 0 || !entries.empty()) {
     return -3; // Directory not empty or error
   }
 
   // Free directory blocks
-  for (uint32_t i = 0; i < DIRECT_BLOCKS && inode.direct_blocks[i] != 0; ++i) {
-    free_block(inode.direct_blocks[i]);
-  }
+  free_inode_blocks(inode);
 
   // Free inode
   free_inode(inode_num);
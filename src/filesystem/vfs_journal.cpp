@@ -0,0 +1,511 @@
+#include "filesystem/vfs.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vfs {
+
+namespace {
+
+// The region must hold two of the largest transactions, so one can be
+// written while the other waits to be checkpointed
+constexpr uint32_t MIN_JOURNAL_BLOCKS = 2 * (JOURNAL_MAX_TX_BLOCKS + 2);
+
+off_t region_offset(uint64_t pos, uint32_t capacity) {
+  return static_cast<off_t>(1 + pos % capacity) * BLOCK_SIZE;
+}
+
+bool pread_full(int fd, void *buf, size_t size, off_t offset) {
+  char *p = static_cast<char *>(buf);
+  while (size > 0) {
+    ssize_t n = ::pread(fd, p, size, offset);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Writes n consecutive region blocks starting at log position pos,
+// wrapping at the end of the region
+bool write_region(int fd, uint32_t capacity, uint64_t pos,
+                  const char *const *blocks, size_t n) {
+  std::array<struct iovec, JOURNAL_MAX_TX_BLOCKS + 2> iov;
+  while (n > 0) {
+    size_t run = std::min<size_t>(n, capacity - pos % capacity);
+    for (size_t i = 0; i < run; ++i) {
+      iov[i] = {const_cast<char *>(blocks[i]), BLOCK_SIZE};
+    }
+    off_t offset = region_offset(pos, capacity);
+    size_t remaining = run * BLOCK_SIZE;
+    struct iovec *next = iov.data();
+    while (remaining > 0) {
+      ssize_t written = ::pwritev(fd, next, static_cast<int>(run), offset);
+      if (written <= 0) {
+        return false;
+      }
+      remaining -= written;
+      offset += written;
+      // Skip what went out; a short write can end mid-block
+      while (written > 0 && static_cast<size_t>(written) >= next->iov_len) {
+        written -= next->iov_len;
+        ++next;
+        --run;
+      }
+      if (written > 0) {
+        next->iov_base = static_cast<char *>(next->iov_base) + written;
+        next->iov_len -= written;
+      }
+    }
+    blocks += (next - iov.data());
+    pos += next - iov.data();
+    n -= next - iov.data();
+  }
+  return true;
+}
+
+} // namespace
+
+bool VirtualFileSystem::open_journal() {
+  journal_capacity_ =
+      std::max<uint32_t>(mount_options_.journal_blocks, MIN_JOURNAL_BLOCKS);
+  journal_txs_.assign(journal_capacity_ / 2, LiveTx{});
+  journal_txs_first_ = journal_txs_count_ = 0;
+  journal_stats_ = JournalStats();
+  ordered_gen_ = ordered_flushed_gen_ = 0;
+  journal_failed_seq_ = 0;
+
+  journal_fd_ = ::open(journal_path_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (journal_fd_ < 0) {
+    std::cerr << "[JOURNAL] cannot open " << journal_path_ << "\n";
+    return false;
+  }
+
+  // Recover what the previous mount committed but did not checkpoint
+  journal_next_seq_ = 1;
+  JournalHeader header{};
+  struct stat st {};
+  if (pread_full(journal_fd_, &header, sizeof(header), 0) &&
+      header.magic == JOURNAL_MAGIC && header.capacity >= MIN_JOURNAL_BLOCKS) {
+    // Starting a new log over transactions not safely replayed would lose
+    // them
+    if (!replay_journal(header)) {
+      std::cerr << "[JOURNAL] recovery failed\n";
+      ::close(journal_fd_);
+      journal_fd_ = -1;
+      return false;
+    }
+  } else if (::fstat(journal_fd_, &st) == 0 && st.st_size > 0) {
+    std::cerr << "[JOURNAL] unrecognized journal discarded\n";
+  }
+
+  // Start a new log at the front of the region. Records left from the old
+  // one carry lower sequence numbers, so recovery never mistakes them for
+  // new transactions.
+  journal_head_ = journal_tail_ = 0;
+  journal_head_seq_ = journal_next_seq_;
+  journal_synced_seq_ = journal_next_seq_ - 1;
+  if (::ftruncate(journal_fd_,
+                  static_cast<off_t>(journal_capacity_ + 1) * BLOCK_SIZE) !=
+          0 ||
+      !write_journal_header(journal_head_, journal_head_seq_)) {
+    std::cerr << "[JOURNAL] cannot initialize " << journal_path_ << "\n";
+    ::close(journal_fd_);
+    journal_fd_ = -1;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(checkpointer_mutex_);
+    checkpointer_stop_ = false;
+  }
+  checkpointer_ = std::thread(&VirtualFileSystem::checkpointer_loop, this);
+  return true;
+}
+
+void VirtualFileSystem::close_journal() {
+  if (checkpointer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(checkpointer_mutex_);
+      checkpointer_stop_ = true;
+    }
+    checkpointer_cv_.notify_one();
+    checkpointer_.join();
+  }
+  if (journal_fd_ < 0) {
+    return;
+  }
+  checkpoint_journal();
+  ::close(journal_fd_);
+  journal_fd_ = -1;
+}
+
+bool VirtualFileSystem::replay_journal(const JournalHeader &header) {
+  uint32_t capacity = header.capacity;
+  uint64_t pos = header.head;
+  uint64_t seq = header.head_seq;
+  ScratchBlock descriptor_block, commit_block;
+  std::vector<char> data;
+
+  auto read_region = [&](uint64_t at, char *out) {
+    return pread_full(journal_fd_, out, BLOCK_SIZE,
+                      region_offset(at, capacity));
+  };
+
+  while (true) {
+    const auto *descriptor =
+        reinterpret_cast<const JournalDescriptor *>(descriptor_block.data());
+    if (!read_region(pos, descriptor_block.data()) ||
+        descriptor->magic != JOURNAL_MAGIC ||
+        (descriptor->type != JOURNAL_DESCRIPTOR &&
+         descriptor->type != JOURNAL_SKIP) ||
+        descriptor->seq != seq || descriptor->count == 0 ||
+        descriptor->count > JOURNAL_MAX_TX_BLOCKS) {
+      break;
+    }
+    uint32_t count = descriptor->count;
+    if (descriptor->type == JOURNAL_SKIP) {
+      pos += count + 2;
+      seq++;
+      continue;
+    }
+
+    // Only a transaction whose commit block and every block check out
+    // is applied; anything else is the torn end of the log
+    const auto *commit =
+        reinterpret_cast<const JournalCommit *>(commit_block.data());
+    if (!read_region(pos + 1 + count, commit_block.data()) ||
+        commit->magic != JOURNAL_MAGIC || commit->type != JOURNAL_COMMIT ||
+        commit->seq != seq || commit->count != count ||
+        commit->checksum !=
+            calc_checksum(descriptor_block.data(), BLOCK_SIZE)) {
+      break;
+    }
+    data.resize(static_cast<size_t>(count) * BLOCK_SIZE);
+    bool intact = true;
+    for (uint32_t i = 0; i < count && intact; ++i) {
+      char *block = data.data() + static_cast<size_t>(i) * BLOCK_SIZE;
+      intact = read_region(pos + 1 + i, block) &&
+               descriptor->tags[i].block_num < superblock_.total_blocks &&
+               calc_checksum(block, BLOCK_SIZE) ==
+                   descriptor->tags[i].checksum;
+    }
+    if (!intact) {
+      std::cerr << "[JOURNAL] transaction " << seq
+                << " is damaged, recovery stops there\n";
+      break;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!device_->WriteBlock(descriptor->tags[i].block_num,
+                               data.data() +
+                                   static_cast<size_t>(i) * BLOCK_SIZE)) {
+        std::cerr << "[JOURNAL] failed to replay block "
+                  << descriptor->tags[i].block_num << "\n";
+        return false;
+      }
+      journal_stats_.replayed++;
+    }
+    pos += count + 2;
+    seq++;
+  }
+
+  journal_next_seq_ = seq;
+  if (journal_stats_.replayed > 0) {
+    journal_stats_.recovered = true;
+    // Replayed blocks must be durable before the new log overwrites them
+    return device_->Flush();
+  }
+  return true;
+}
+
+bool VirtualFileSystem::write_journal_header(uint64_t head,
+                                             uint64_t head_seq) {
+  JournalHeader header{JOURNAL_MAGIC, journal_capacity_,
+                       head % journal_capacity_, head_seq};
+  return ::pwrite(journal_fd_, &header, sizeof(header), 0) ==
+             static_cast<ssize_t>(sizeof(header)) &&
+         ::fdatasync(journal_fd_) == 0;
+}
+
+bool VirtualFileSystem::begin_tx(JournalTx &tx, size_t count) {
+  tx = JournalTx();
+  if (journal_fd_ < 0 || count == 0) {
+    return true; // not journaled
+  }
+  if (count > JOURNAL_MAX_TX_BLOCKS) {
+    return false;
+  }
+
+  uint64_t need = count + 2; // descriptor and commit blocks
+  std::unique_lock<std::mutex> lock(journal_mutex_);
+  if (journal_failed_seq_ != 0) {
+    return false; // aborted: nothing more can be made durable
+  }
+  while (journal_tail_ + need - journal_head_ > journal_capacity_) {
+    // Out of space: reclaim ended transactions ourselves, or wait for the
+    // oldest one to end
+    if (journal_txs_count_ > 0 && live_tx(0).done) {
+      lock.unlock();
+      bool ok = checkpoint_journal();
+      lock.lock();
+      if (!ok) {
+        return false;
+      }
+    } else {
+      journal_cv_.wait(lock);
+    }
+  }
+
+  tx.seq = journal_next_seq_++;
+  tx.start = journal_tail_;
+  tx.count = count;
+  journal_tail_ += need;
+  live_tx(journal_txs_count_++) =
+      LiveTx{tx.seq, journal_tail_, count, false, false};
+  if ((journal_tail_ - journal_head_) * 2 >= journal_capacity_) {
+    checkpointer_cv_.notify_one();
+  }
+  return true;
+}
+
+bool VirtualFileSystem::commit_tx(JournalTx &tx, const uint32_t *block_nums,
+                                  const char *const *datas) {
+  if (tx.seq == 0) {
+    return true;
+  }
+
+  // The records go to the space begin_tx() reserved, without the lock
+  ScratchBlock descriptor_block, commit_block;
+  std::memset(descriptor_block.data(), 0, BLOCK_SIZE);
+  std::memset(commit_block.data(), 0, BLOCK_SIZE);
+  auto *descriptor =
+      reinterpret_cast<JournalDescriptor *>(descriptor_block.data());
+  descriptor->magic = JOURNAL_MAGIC;
+  descriptor->type = JOURNAL_DESCRIPTOR;
+  descriptor->seq = tx.seq;
+  descriptor->count = tx.count;
+  for (size_t i = 0; i < tx.count; ++i) {
+    descriptor->tags[i] = {block_nums[i], calc_checksum(datas[i], BLOCK_SIZE)};
+  }
+  auto *commit = reinterpret_cast<JournalCommit *>(commit_block.data());
+  commit->magic = JOURNAL_MAGIC;
+  commit->type = JOURNAL_COMMIT;
+  commit->seq = tx.seq;
+  commit->count = tx.count;
+  commit->checksum = calc_checksum(descriptor_block.data(), BLOCK_SIZE);
+
+  std::array<const char *, JOURNAL_MAX_TX_BLOCKS + 2> blocks;
+  blocks[0] = descriptor_block.data();
+  std::copy(datas, datas + tx.count, blocks.begin() + 1);
+  blocks[tx.count + 1] = commit_block.data();
+  bool written = flush_ordered_data() &&
+                 write_region(journal_fd_, journal_capacity_, tx.start,
+                              blocks.data(), tx.count + 2);
+
+  // A torn record would end recovery there and lose every transaction
+  // after it, so a failed one is turned into a skip record replay steps
+  // over. If even that cannot be written the journal is aborted.
+  bool skipped = false;
+  if (!written) {
+    std::cerr << "[JOURNAL] failed to write transaction " << tx.seq << "\n";
+    std::memset(descriptor_block.data(), 0, BLOCK_SIZE);
+    descriptor->magic = JOURNAL_MAGIC;
+    descriptor->type = JOURNAL_SKIP;
+    descriptor->seq = tx.seq;
+    descriptor->count = tx.count;
+    skipped = write_region(journal_fd_, journal_capacity_, tx.start,
+                           blocks.data(), 1);
+  }
+
+  std::unique_lock<std::mutex> lock(journal_mutex_);
+  LiveTx &live = live_tx(tx.seq - live_tx(0).seq);
+  journal_cv_.notify_all();
+  if (!written) {
+    live.count = 0; // nothing to checkpoint
+    if (skipped) {
+      live.written = true;
+    } else if (journal_failed_seq_ == 0) {
+      std::cerr << "[JOURNAL] journal aborted\n";
+      journal_failed_seq_ = tx.seq;
+    }
+    return false;
+  }
+  live.written = true;
+  journal_stats_.journaled += tx.count;
+  journal_stats_.pending += tx.count;
+  journal_stats_.dirty = true;
+  journal_stats_.commits++;
+
+  // Group commit: one committer syncs every transaction written so far
+  // while the others wait for it. Only a gap-free run of written
+  // transactions is synced, since recovery stops at the first gap.
+  while (journal_synced_seq_ < tx.seq) {
+    // Syncs never pass an aborted transaction
+    if (journal_failed_seq_ != 0 && journal_failed_seq_ < tx.seq) {
+      return false;
+    }
+    if (journal_syncing_) {
+      journal_cv_.wait(lock);
+      continue;
+    }
+    uint64_t target = journal_synced_seq_;
+    for (size_t i = 0; i < journal_txs_count_; ++i) {
+      const LiveTx &live = live_tx(i);
+      if (live.seq <= target) {
+        continue;
+      }
+      if (!live.written) {
+        break;
+      }
+      target = live.seq;
+    }
+    if (target < tx.seq) {
+      journal_cv_.wait(lock); // an older transaction is still being written
+      continue;
+    }
+
+    journal_syncing_ = true;
+    lock.unlock();
+    bool synced = ::fdatasync(journal_fd_) == 0;
+    lock.lock();
+    journal_syncing_ = false;
+    journal_stats_.syncs++;
+    journal_cv_.notify_all();
+    if (!synced) {
+      std::cerr << "[JOURNAL] fdatasync failed\n";
+      return false;
+    }
+    journal_synced_seq_ = target;
+  }
+  return true;
+}
+
+void VirtualFileSystem::end_tx(const JournalTx &tx) {
+  if (tx.seq == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(journal_mutex_);
+  live_tx(tx.seq - live_tx(0).seq).done = true;
+  journal_cv_.notify_all();
+}
+
+void VirtualFileSystem::note_ordered_data(size_t count) {
+  std::lock_guard<std::mutex> lock(journal_mutex_);
+  ordered_gen_++;
+  journal_stats_.ordered += count;
+}
+
+bool VirtualFileSystem::flush_ordered_data() {
+  {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    if (ordered_gen_ == ordered_flushed_gen_) {
+      return true;
+    }
+  }
+
+  // Committers that arrive while the image is being flushed find their
+  // data covered by that flush
+  std::lock_guard<std::mutex> checkpoint(checkpoint_mutex_);
+  uint64_t gen;
+  {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    gen = ordered_gen_;
+    if (gen == ordered_flushed_gen_) {
+      return true;
+    }
+  }
+  if (!device_->Flush()) {
+    std::cerr << "[JOURNAL] failed to flush file data before commit\n";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(journal_mutex_);
+  ordered_flushed_gen_ = gen;
+  journal_stats_.data_flushes++;
+  return true;
+}
+
+bool VirtualFileSystem::checkpoint_journal() {
+  std::lock_guard<std::mutex> checkpoint(checkpoint_mutex_);
+
+  // The oldest transactions that are durable and written in place
+  size_t released = 0;
+  size_t blocks = 0;
+  uint64_t head = 0;
+  uint64_t head_seq = 0;
+  uint64_t gen;
+  {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    gen = ordered_gen_;
+    for (size_t i = 0; i < journal_txs_count_; ++i) {
+      const LiveTx &live = live_tx(i);
+      if (!live.done || live.seq > journal_synced_seq_) {
+        break;
+      }
+      released++;
+      blocks += live.count;
+      head = live.end;
+      head_seq = live.seq + 1;
+    }
+  }
+
+  // The image must hold those blocks before the journal lets go of them,
+  // and the new head must be durable before their space is reused
+  if (!device_->Flush()) {
+    return false;
+  }
+  if (released == 0 || journal_fd_ < 0) {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    ordered_flushed_gen_ = gen;
+    return true;
+  }
+  if (!write_journal_header(head, head_seq)) {
+    std::cerr << "[JOURNAL] failed to write journal header\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(journal_mutex_);
+  ordered_flushed_gen_ = gen;
+  journal_txs_first_ = (journal_txs_first_ + released) % journal_txs_.size();
+  journal_txs_count_ -= released;
+  journal_head_ = head;
+  journal_head_seq_ = head_seq;
+  journal_stats_.pending -= blocks;
+  journal_stats_.dirty = journal_stats_.pending > 0;
+  journal_stats_.checkpoints++;
+  journal_cv_.notify_all();
+  return true;
+}
+
+void VirtualFileSystem::checkpointer_loop() {
+  // Checkpoint every expiry period, or early once begin_tx() finds half
+  // the region in use
+  auto interval = std::chrono::milliseconds(
+      std::max<uint32_t>(10, mount_options_.dirty_expire_ms));
+
+  std::unique_lock<std::mutex> lock(checkpointer_mutex_);
+  while (!checkpointer_stop_) {
+    checkpointer_cv_.wait_for(lock, interval);
+    if (checkpointer_stop_) {
+      break;
+    }
+    bool due;
+    {
+      std::lock_guard<std::mutex> journal_lock(journal_mutex_);
+      due = journal_txs_count_ > 0 && live_tx(0).done;
+    }
+    if (due) {
+      lock.unlock();
+      checkpoint_journal();
+      lock.lock();
+    }
+  }
+}
+
+} // namespace vfs
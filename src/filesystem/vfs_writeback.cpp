@@ -0,0 +1,250 @@
+#include "filesystem/vfs.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace vfs {
+
+namespace {
+
+// Blocks journaled and written per device call during writeback
+constexpr size_t WRITEBACK_BATCH = 256;
+
+} // namespace
+
+int VirtualFileSystem::sync() {
+  std::shared_lock<std::shared_mutex> lock(fs_mutex_);
+
+  if (!mounted_) {
+    return -1;
+  }
+
+  // Inodes are flushed into their table blocks outside the writeback
+  // pass, which the resulting block writes may need to start themselves
+  if (!flush_inodes()) {
+    return -1;
+  }
+
+  if (write_back_) {
+    std::lock_guard<std::mutex> pass(writeback_mutex_);
+    if (!writeback_dirty(true)) {
+      return -1;
+    }
+  }
+  // Makes the device durable and releases the journal space of every
+  // transaction written in place; ones still in flight stay journaled
+  return checkpoint_journal() ? 0 : -1;
+}
+
+size_t VirtualFileSystem::get_dirty_block_count() const {
+  std::lock_guard<std::mutex> lock(dirty_mutex_);
+  return dirty_blocks_.size();
+}
+
+size_t VirtualFileSystem::get_dirty_inode_count() const {
+  return inode_cache_->dirty_count();
+}
+
+bool VirtualFileSystem::mark_dirty(const uint32_t *block_nums,
+                                   const char *const *datas, size_t count,
+                                   bool file_data) {
+  auto now = std::chrono::steady_clock::now();
+  size_t dirty;
+  {
+    BlockStripeGuard io_locks(*this, block_nums, count);
+    cancel_readahead(block_nums, count);
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t block_num = block_nums[i];
+      if (block_num < block_checksums_.size()) {
+        block_checksums_[block_num] = calc_checksum(datas[i], BLOCK_SIZE);
+      }
+
+      // The cache and the dirty table share one buffer; a later write of
+      // the block replaces it in both
+      BlockBuffer *buffer = BlockBuffer::create();
+      BlockHandle handle = BlockHandle::adopt(buffer);
+      std::memcpy(buffer->data, datas[i], BLOCK_SIZE);
+      cache_->put(block_num, handle);
+
+      std::lock_guard<std::mutex> dirty_lock(dirty_mutex_);
+      auto it = dirty_blocks_.find(block_num);
+      if (it != dirty_blocks_.end()) {
+        it->second.data = std::move(handle); // keeps its original age
+        it->second.file_data = file_data;
+      } else {
+        dirty_blocks_.emplace(block_num,
+                              DirtyBlock{std::move(handle), file_data, now});
+      }
+    }
+    std::lock_guard<std::mutex> dirty_lock(dirty_mutex_);
+    dirty = dirty_blocks_.size();
+  }
+
+  // Dirty blocks are pinned in the cache. Once they would fill it, the
+  // writer cleans them itself; past the dirty ratio the flusher is woken.
+  size_t capacity = std::max<size_t>(1, cache_->get_capacity());
+  if (dirty >= capacity) {
+    std::lock_guard<std::mutex> pass(writeback_mutex_);
+    return writeback_dirty(true);
+  }
+  if (dirty * 100 >= capacity * mount_options_.dirty_ratio) {
+    flusher_cv_.notify_one();
+  }
+  return true;
+}
+
+BlockHandle VirtualFileSystem::find_dirty(uint32_t block_num) {
+  std::lock_guard<std::mutex> lock(dirty_mutex_);
+  auto it = dirty_blocks_.find(block_num);
+  return it != dirty_blocks_.end() ? it->second.data : BlockHandle();
+}
+
+bool VirtualFileSystem::writeback_dirty(bool all) {
+  // Snapshot the selected blocks in block order, unjournaled file data
+  // first so the commits of the metadata that follows cover it. The
+  // handles keep the buffers alive even if the blocks are rewritten
+  // meanwhile.
+  std::vector<uint32_t> blocks;
+  std::vector<BlockHandle> handles;
+  size_t unjournaled = 0;
+  {
+    auto expired = std::chrono::steady_clock::now() -
+                   std::chrono::milliseconds(mount_options_.dirty_expire_ms);
+    std::lock_guard<std::mutex> lock(dirty_mutex_);
+    blocks.reserve(dirty_blocks_.size());
+    handles.reserve(dirty_blocks_.size());
+    // Metadata may point at any dirty file data, so writing some of it
+    // takes all the file data along
+    bool all_data = all;
+    for (const auto &kv : dirty_blocks_) {
+      if (journals(kv.second.file_data) && kv.second.since <= expired) {
+        all_data = true;
+        break;
+      }
+    }
+    for (const auto &kv : dirty_blocks_) {
+      if (!journals(kv.second.file_data) &&
+          (all_data || kv.second.since <= expired)) {
+        blocks.push_back(kv.first);
+        handles.push_back(kv.second.data);
+      }
+    }
+    unjournaled = blocks.size();
+    for (const auto &kv : dirty_blocks_) {
+      if (journals(kv.second.file_data) &&
+          (all || kv.second.since <= expired)) {
+        blocks.push_back(kv.first);
+        handles.push_back(kv.second.data);
+      }
+    }
+  }
+
+  std::array<const char *, WRITEBACK_BATCH> datas;
+  for (size_t start = 0; start < blocks.size();) {
+    // Batches do not mix file data and journaled blocks
+    size_t end = start < unjournaled ? unjournaled : blocks.size();
+    size_t count = std::min(WRITEBACK_BATCH, end - start);
+    bool journaled = start >= unjournaled;
+    const uint32_t *block_nums = blocks.data() + start;
+    for (size_t i = 0; i < count; ++i) {
+      datas[i] = handles[start + i].data();
+    }
+
+    // Each journaled batch is one transaction. A batch takes whatever is
+    // dirty, so it may hold part of an operation's blocks.
+    JournalTx tx;
+    if (journaled && !begin_tx(tx, count)) {
+      return false;
+    }
+    if (!commit_tx(tx, block_nums, datas.data())) {
+      end_tx(tx);
+      return false;
+    }
+
+    // Sorted batches let the device merge adjacent blocks into one call.
+    // A block leaves the dirty table under its I/O lock once the device has
+    // it, so a reader that misses the cache never sees the stale copy.
+    BlockStripeGuard io_locks(*this, block_nums, count);
+    bool written = device_->WriteBlocks(
+        block_nums, reinterpret_cast<const void *const *>(datas.data()),
+        count);
+    end_tx(tx);
+    if (written && !journaled) {
+      note_ordered_data(count);
+    }
+    if (!written) {
+      std::cerr << "[VFS ERROR] writeback: Failed to write " << count
+                << " blocks starting at " << block_nums[0] << "\n";
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(dirty_mutex_);
+    for (size_t i = 0; i < count; ++i) {
+      auto it = dirty_blocks_.find(block_nums[i]);
+      // Rewritten since the snapshot: the newer copy is still dirty
+      if (it != dirty_blocks_.end() &&
+          it->second.data.buffer() == handles[start + i].buffer()) {
+        dirty_blocks_.erase(it);
+      }
+    }
+    start += count;
+  }
+  return true;
+}
+
+void VirtualFileSystem::start_flusher() {
+  {
+    std::lock_guard<std::mutex> lock(flusher_mutex_);
+    flusher_stop_ = false;
+  }
+  flusher_ = std::thread(&VirtualFileSystem::flusher_loop, this);
+}
+
+void VirtualFileSystem::stop_flusher() {
+  if (!flusher_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flusher_mutex_);
+    flusher_stop_ = true;
+  }
+  flusher_cv_.notify_one();
+  flusher_.join();
+}
+
+void VirtualFileSystem::flush_dirty_blocks() {
+  size_t capacity = std::max<size_t>(1, cache_->get_capacity());
+  bool over_ratio =
+      get_dirty_block_count() * 100 >= capacity * mount_options_.dirty_ratio;
+
+  // Journal space is reclaimed by the checkpointer
+  std::lock_guard<std::mutex> pass(writeback_mutex_);
+  writeback_dirty(over_ratio);
+}
+
+void VirtualFileSystem::flusher_loop() {
+  // Wake a few times per expiry period, or early when writers pass the
+  // dirty ratio
+  auto interval = std::chrono::milliseconds(
+      std::max<uint32_t>(10, mount_options_.dirty_expire_ms / 4));
+
+  std::unique_lock<std::mutex> lock(flusher_mutex_);
+  while (!flusher_stop_) {
+    flusher_cv_.wait_for(lock, interval);
+    if (flusher_stop_) {
+      break;
+    }
+    lock.unlock();
+    {
+      std::shared_lock<std::shared_mutex> fs_lock(fs_mutex_);
+      flush_inodes();
+      // Write-through mounts only run the flusher for lazytime inodes
+      if (write_back_) {
+        flush_dirty_blocks();
+      }
+    }
+    lock.lock();
+  }
+}
+
+} // namespace vfs
@@ -345,13 +345,13 @@ int AssignmentService::get_active_load(const std::string &reviewer) {
   int load = 0;
 
   // Scan all papers
-  std::vector<vfs::DirEntry> papers;
+  std::vector<vfs::DirEntryInfo> papers;
   if (vfs_->readdir("/papers", papers) != 0) {
     return 0;
   }
 
   for (const auto &entry : papers) {
-    std::string paper_id(entry.name, entry.name_len);
+    const std::string &paper_id = entry.name;
     std::vector<Assignment> assignments;
     
     if (load_assignments(paper_id, assignments)) {
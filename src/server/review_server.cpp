@@ -315,11 +315,11 @@ ReviewServer::handle_upload_paper(const protocol::Message &msg,
   std::string username = auth_manager_->get_username(session_id);
 
   // 1. Generate persistent paper ID by scanning /papers directory
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   int max_id = 0;
   if (vfs_->readdir("/papers", entries) == 0) {
     for (const auto &entry : entries) {
-      std::string name(entry.name, entry.name_len);
+      const std::string &name = entry.name;
       if (!name.empty() && name[0] == 'P') {
         try {
           int id = std::stoi(name.substr(1));
@@ -490,13 +490,13 @@ ReviewServer::handle_submit_revision(const protocol::Message &msg,
   }
 
   // Find next version
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   int max_ver = 0;
   if (vfs_->readdir(versions_dir, entries) == 0) {
     for (const auto &entry : entries) {
       if (entry.inode_num == 0)
         continue;
-      std::string name(entry.name, entry.name_len);
+      const std::string &name = entry.name;
       // Format vN.pdf
       if (name.size() > 5 && name[0] == 'v' &&
           name.substr(name.size() - 4) == ".pdf") {
@@ -604,11 +604,11 @@ ReviewServer::handle_view_paper_status(const protocol::Message &msg,
   // List Versions
   oss << "\nVersions:\n";
   std::string versions_dir = paper_dir + "/versions";
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   if (vfs_->readdir(versions_dir, entries) == 0) {
     for (const auto &entry : entries) {
       if (entry.inode_num != 0) {
-        oss << " - " << std::string(entry.name, entry.name_len) << "\n";
+        oss << " - " << entry.name << "\n";
       }
     }
   }
@@ -621,7 +621,7 @@ ReviewServer::handle_view_paper_status(const protocol::Message &msg,
     int idx = 1;
     for (const auto &entry : entries) {
       if (entry.inode_num != 0) {
-        std::string name(entry.name, entry.name_len);
+        const std::string &name = entry.name;
         if (role == protocol::Role::AUTHOR ||
             status.blind == protocol::BlindPolicy::DOUBLE_BLIND) {
           oss << " - Reviewer_" << idx << "\n";
@@ -667,11 +667,11 @@ ReviewServer::handle_download_paper(const protocol::Message &msg,
 
 
   // Choose latest version
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   int max_ver = 1;
   if (vfs_->readdir(versions_dir, entries) == 0) {
     for (const auto &entry : entries) {
-      std::string name(entry.name, entry.name_len);
+      const std::string &name = entry.name;
       if (name.size() > 5 && name[0] == 'v' &&
           name.substr(name.size() - 4) == ".pdf") {
         try {
@@ -988,6 +988,9 @@ ReviewServer::handle_system_status(const std::string &session_id) {
   }
 
   oss << "Free blocks: " << fs_stats.free_blocks << "\n";
+  oss << "Free extents: " << fs_stats.free_extents << " (largest "
+      << fs_stats.largest_free_extent << " blocks, "
+      << fs_stats.fragmentation_percent() << "% fragmented)\n";
   oss << "Usage: " << fs_stats.usage_percent() << "%\n\n";
 
   oss << "=== Cache Stats ===\n";
@@ -995,6 +998,9 @@ ReviewServer::handle_system_status(const std::string &session_id) {
   oss << "Misses: " << cache_stats.misses << "\n";
   oss << "Hit rate: " << cache_stats.hit_rate() * 100 << "%\n";
   oss << "Evictions: " << cache_stats.evictions << "\n";
+  oss << "Readahead: " << cache_stats.readahead_blocks << " blocks, "
+      << cache_stats.readahead_hits << " hits, "
+      << cache_stats.readahead_waste << " wasted\n";
 
   oss << "\n=== Journal ===\n";
   oss << "Pending: " << journal_stats.pending << "\n";
@@ -1045,7 +1051,7 @@ ReviewServer::handle_system_status(const std::string &session_id) {
   oss << "Admins: " << admins << "\n";
 
   oss << "\n=== Paper Statistics ===\n";
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   int papers = 0;
   if (vfs_->readdir("/papers", entries) == 0) {
     for (const auto &entry : entries) {
@@ -1183,12 +1189,12 @@ ReviewServer::handle_download_reviews(const protocol::Message &msg,
   std::ostringstream oss;
   oss << "=== Reviews for " << it_paper_id->second << " ===\n\n";
 
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   int idx = 1;
   if (vfs_->readdir(reviews_dir, entries) == 0) {
     for (const auto &entry : entries) {
       if (entry.inode_num != 0) {
-        std::string rname(entry.name, entry.name_len);
+        const std::string &rname = entry.name;
         std::string rpath = reviews_dir + "/" + rname;
         int fd = vfs_->open(rpath, O_RDONLY);
         if (fd >= 0) {
@@ -1227,13 +1233,13 @@ ReviewServer::handle_view_review_status(const protocol::Message &msg,
 
 protocol::Response
 ReviewServer::handle_view_pending_papers(const std::string &session_id) {
-  std::vector<vfs::DirEntry> entries;
+  std::vector<vfs::DirEntryInfo> entries;
   std::ostringstream oss;
   oss << "=== Pending Papers ===\n";
 
   if (vfs_->readdir("/papers", entries) == 0) {
     for (const auto &entry : entries) {
-      std::string name(entry.name, entry.name_len);
+      const std::string &name = entry.name;
       if (!name.empty() && name[0] == 'P') {
         PaperStatus status = load_paper_status("/papers/" + name);
         if (status.state != protocol::LifecycleState::ACCEPTED &&
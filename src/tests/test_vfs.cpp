@@ -1,8 +1,15 @@
 #include "filesystem/vfs.h"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <fcntl.h>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <cstring>  
+#include <string>
+#include <thread>
+#include <vector>
 using namespace vfs;
 
 void test_format_and_mount() {
@@ -46,11 +53,11 @@ void test_directory_operations() {
   assert(vfs.is_directory("/papers"));
 
   // List root directory
-  std::vector<DirEntry> entries;
+  std::vector<DirEntryInfo> entries;
   vfs.readdir("/", entries);
   std::cout << "Root directory contains " << entries.size() << " entries:\n";
   for (const auto &entry : entries) {
-    std::cout << "  - " << std::string(entry.name, entry.name_len) << "\n";
+    std::cout << "  - " << entry.name << "\n";
   }
 
   std::cout << "✓ Directory operations test passed\n\n";
@@ -127,6 +134,165 @@ void test_cache_statistics() {
   std::cout << "✓ Cache statistics test passed\n\n";
 }
 
+void test_block_cache() {
+  std::cout << "Testing sharded block cache->..\n";
+
+  auto cache = make_block_cache(CachePolicy::CLOCK, 64, 4);
+  assert(cache->get_shard_count() == 4);
+
+  std::vector<char> block(4096);
+  for (uint32_t b = 0; b < 64; ++b) {
+    block[0] = static_cast<char>(b);
+    cache->put(b, block);
+  }
+  assert(cache->get_size() == 64);
+
+  // Reference half of every shard (blocks are sharded by b % 4), then
+  // overflow each shard by 8: CLOCK must give the referenced blocks a
+  // second chance and evict the others
+  auto hot = [](uint32_t b) { return (b / 4) % 2 == 0; };
+  for (uint32_t b = 0; b < 64; ++b) {
+    if (hot(b)) {
+      assert(cache->get(b, block));
+      assert(block[0] == static_cast<char>(b));
+    }
+  }
+  for (uint32_t b = 64; b < 96; ++b) {
+    cache->put(b, block);
+  }
+  for (uint32_t b = 0; b < 64; ++b) {
+    if (hot(b)) {
+      assert(cache->get(b, block));
+    }
+  }
+  assert(!cache->get(4, block));
+
+  cache->invalidate(0);
+  assert(!cache->get(0, block));
+
+  // Statistics are summed over all shards
+  auto stats = cache->get_stats();
+  assert(stats.hits == 64);
+  assert(stats.misses == 2);
+  assert(stats.evictions == 32);
+  assert(stats.total_requests == 66);
+
+  cache->set_capacity(8);
+  assert(cache->get_size() <= 8);
+
+  // Pinned handles: a hit shares the cached buffer, eviction skips it and
+  // a later put replaces the buffer instead of changing pinned bytes
+  auto single = make_block_cache(CachePolicy::CLOCK, 2, 1);
+  block[0] = 'a';
+  single->put(100, block);
+  BlockHandle pinned = single->get(100);
+  assert(pinned && pinned.data()[0] == 'a');
+  assert(single->get(100).data() == pinned.data());
+  for (uint32_t b = 200; b < 210; ++b) {
+    single->put(b, block);
+  }
+  assert(single->get(100).data() == pinned.data());
+  block[0] = 'b';
+  single->put(100, block);
+  assert(pinned.data()[0] == 'a');
+  assert(single->get(100).data()[0] == 'b');
+  single->clear();
+  assert(pinned.data()[0] == 'a'); // still owned by the handle
+
+  std::cout << "✓ Sharded block cache test passed\n\n";
+}
+
+void test_cache_policies() {
+  std::cout << "Testing cache replacement policies...\n";
+
+  const CachePolicy policies[] = {CachePolicy::LRU, CachePolicy::CLOCK,
+                                  CachePolicy::TWO_Q, CachePolicy::ARC,
+                                  CachePolicy::CLOCK_PRO};
+  std::vector<char> block(4096, 'x');
+
+  for (CachePolicy policy : policies) {
+    auto cache = make_block_cache(policy, 64, 1);
+    assert(cache->get_policy() == policy);
+
+    // Hot metadata: 16 blocks used over and over, interleaved with
+    // unrelated one-off blocks
+    uint32_t other = 100;
+    for (int round = 0; round < 8; ++round) {
+      for (uint32_t b = 0; b < 16; ++b) {
+        if (!cache->get(b, block)) {
+          cache->put(b, block);
+        }
+      }
+      for (int i = 0; i < 40; ++i, ++other) {
+        cache->put(other, block);
+      }
+    }
+
+    // One pinned block survives anything
+    cache->put(5000, block);
+    BlockHandle pinned = cache->get(5000);
+
+    // A one-shot stream five times the cache size
+    for (uint32_t b = 1000; b < 1320; ++b) {
+      if (!cache->get(b, block)) {
+        cache->put(b, block);
+      }
+    }
+    assert(cache->get_size() <= 64);
+    assert(cache->get(5000).data() == pinned.data());
+
+    int hot_hits = 0;
+    for (uint32_t b = 0; b < 16; ++b) {
+      hot_hits += cache->get(b, block) ? 1 : 0;
+    }
+    std::cout << "  " << cache_policy_name(policy) << ": " << hot_hits
+              << "/16 hot blocks survived the scan\n";
+    if (policy == CachePolicy::TWO_Q || policy == CachePolicy::ARC ||
+        policy == CachePolicy::CLOCK_PRO) {
+      assert(hot_hits == 16);
+    } else if (policy == CachePolicy::LRU) {
+      assert(hot_hits == 0);
+    }
+
+    // Invalidation frees a slot without disturbing the rest
+    cache->invalidate(3);
+    assert(!cache->get(3, block));
+    cache->put(3, block);
+    assert(cache->get(3, block));
+  }
+
+  std::cout << "✓ Cache replacement policies test passed\n\n";
+}
+
+void test_block_pool() {
+  std::cout << "Testing block frame pool...\n";
+
+  auto before = BlockPool::instance().get_stats();
+  {
+    ScratchBlock a;
+    ScratchBlock b;
+    assert(reinterpret_cast<uintptr_t>(a.data()) % 4096 == 0);
+    assert(reinterpret_cast<uintptr_t>(b.data()) % 4096 == 0);
+    assert(a.data() != b.data());
+    std::memset(a.data(), 0x5a, a.size());
+    assert(BlockPool::instance().get_stats().frames_in_use ==
+           before.frames_in_use + 2);
+  }
+  assert(BlockPool::instance().get_stats().frames_in_use ==
+         before.frames_in_use);
+
+  // Freed frames are recycled instead of carving new slabs
+  auto warm = BlockPool::instance().get_stats();
+  for (int i = 0; i < 1000; ++i) {
+    ScratchBlock scratch;
+    scratch.data()[0] = static_cast<char>(i);
+  }
+  assert(BlockPool::instance().get_stats().slab_allocations ==
+         warm.slab_allocations);
+
+  std::cout << "✓ Block frame pool test passed\n\n";
+}
+
 void test_backup_operations() {
   std::cout << "Testing backup operations...\n";
 
@@ -144,15 +310,1427 @@ void test_backup_operations() {
   std::cout << "✓ Backup test passed\n\n";
 }
 
+void test_concurrent_access() {
+  std::cout << "Testing concurrent access...\n";
+
+  VirtualFileSystem vfs;
+  vfs.mount("/tmp/test_fs.img", 128);
+
+  vfs.mkdir("/concurrent");
+  constexpr int kThreads = 4;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kThreads, 0);
+
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&vfs, &failures, t]() {
+      std::string dir = "/concurrent/P" + std::to_string(t);
+      std::string file = dir + "/paper.txt";
+      if (vfs.mkdir(dir) != 0 || vfs.create_file(file) != 0) {
+        failures[t]++;
+        return;
+      }
+      std::vector<char> data(3 * 4096 + 100, static_cast<char>('a' + t));
+      for (int round = 0; round < 10; ++round) {
+        int fd = vfs.open(file, O_RDWR | O_TRUNC);
+        if (vfs.write(fd, data.data(), data.size()) !=
+            static_cast<ssize_t>(data.size())) {
+          failures[t]++;
+        }
+        vfs.seek(fd, 0, SEEK_SET);
+        std::vector<char> back(data.size());
+        if (vfs.read(fd, back.data(), back.size()) !=
+                static_cast<ssize_t>(back.size()) ||
+            back != data) {
+          failures[t]++;
+        }
+        vfs.close(fd);
+        if (!vfs.exists(file)) {
+          failures[t]++;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 0; t < kThreads; ++t) {
+    assert(failures[t] == 0 && "Concurrent file access failed");
+  }
+
+  std::vector<DirEntryInfo> entries;
+  vfs.readdir("/concurrent", entries);
+  assert(entries.size() == kThreads);
+
+  // Writes sharing one descriptor each continue where the last one ended
+  assert(vfs.create_file("/concurrent/shared.log") == 0);
+  int shared = vfs.open("/concurrent/shared.log", O_RDWR);
+  constexpr int kRecords = 1000;
+  threads.clear();
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&vfs, shared, t]() {
+      std::vector<char> record(100, static_cast<char>('a' + t));
+      for (int i = 0; i < kRecords; ++i) {
+        assert(vfs.write(shared, record.data(), record.size()) == 100);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  assert(vfs.seek(shared, 0, SEEK_CUR) == kThreads * kRecords * 100);
+  assert(vfs.seek(shared, 0, SEEK_END) == kThreads * kRecords * 100);
+  vfs.close(shared);
+
+  std::cout << "✓ Concurrent access test passed\n\n";
+}
+
+void test_mmap_backend() {
+  std::cout << "Testing mmap block backend...\n";
+
+  VirtualFileSystem vfs;
+  MountOptions options;
+  options.cache_capacity = 128;
+  options.backend = BlockBackend::MMAP;
+  assert(vfs.mount("/tmp/test_fs.img", options));
+
+  // Data written through the pread backend must be visible in the mapping
+  int fd = vfs.open("/papers/paper1.txt", O_RDONLY);
+  assert(fd >= 0);
+  char buffer[256] = {0};
+  assert(vfs.read(fd, buffer, sizeof(buffer)) > 0);
+  assert(strncmp(buffer, "This is a research paper", 24) == 0);
+  vfs.close(fd);
+
+  assert(vfs.create_file("/papers/mapped.txt") == 0);
+  fd = vfs.open("/papers/mapped.txt", O_RDWR);
+  std::vector<char> data(2 * 4096 + 17, 'm');
+  assert(vfs.write(fd, data.data(), data.size()) ==
+         static_cast<ssize_t>(data.size()));
+  vfs.close(fd);
+  vfs.unmount();
+
+  // ...and the other way round after msync/unmount
+  assert(vfs.mount("/tmp/test_fs.img", 128));
+  fd = vfs.open("/papers/mapped.txt", O_RDONLY);
+  std::vector<char> back(data.size());
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == data);
+  vfs.close(fd);
+
+  std::cout << "✓ mmap backend test passed\n\n";
+}
+
+void test_io_uring_backend() {
+  std::cout << "Testing io_uring block backend...\n";
+
+  VirtualFileSystem vfs;
+  MountOptions options;
+  options.cache_capacity = 64;
+  options.backend = BlockBackend::IO_URING; // falls back to pread if absent
+  assert(vfs.mount("/tmp/test_fs.img", options));
+
+  // Large unaligned write spanning direct, indirect and several batches
+  assert(vfs.create_file("/papers/batched.bin") == 0);
+  int fd = vfs.open("/papers/batched.bin", O_RDWR);
+  assert(fd >= 0);
+  std::vector<char> data(300 * 4096 + 123);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 7 + 3);
+  }
+  assert(vfs.write(fd, data.data(), 100) == 100);
+  assert(vfs.write(fd, data.data() + 100, data.size() - 100) ==
+         static_cast<ssize_t>(data.size() - 100));
+
+  // Overwrite a range straddling two blocks in the middle
+  std::vector<char> patch(5000, 'p');
+  std::copy(patch.begin(), patch.end(), data.begin() + 20 * 4096 - 10);
+  vfs.seek(fd, 20 * 4096 - 10, SEEK_SET);
+  assert(vfs.write(fd, patch.data(), patch.size()) ==
+         static_cast<ssize_t>(patch.size()));
+  vfs.close(fd);
+  vfs.unmount();
+
+  assert(vfs.mount("/tmp/test_fs.img", 64));
+  fd = vfs.open("/papers/batched.bin", O_RDONLY);
+  std::vector<char> back(data.size());
+  size_t got = 0;
+  ssize_t n;
+  while ((n = vfs.read(fd, back.data() + got, 4096 * 70 + 1)) > 0) {
+    got += static_cast<size_t>(n);
+  }
+  assert(got == data.size());
+  assert(back == data);
+  vfs.close(fd);
+  vfs.unmount();
+
+  std::cout << "✓ io_uring backend test passed\n\n";
+}
+
+void test_write_back() {
+  std::cout << "Testing write-back cache...\n";
+
+  VirtualFileSystem vfs;
+  MountOptions options;
+  options.cache_capacity = 64;
+  options.write_back = true;
+  options.dirty_expire_ms = 60000; // only sync() and pressure write back
+  assert(vfs.mount("/tmp/test_fs.img", options));
+
+  // Small metadata-heavy updates stay in memory
+  assert(vfs.create_file("/papers/wb_small.txt") == 0);
+  int fd = vfs.open("/papers/wb_small.txt", O_RDWR);
+  assert(fd >= 0);
+  const char note[] = "review pending";
+  assert(vfs.write(fd, note, sizeof(note)) == sizeof(note));
+  assert(vfs.get_dirty_block_count() > 0);
+  vfs.seek(fd, 0, SEEK_SET);
+  char back_note[sizeof(note)] = {};
+  assert(vfs.read(fd, back_note, sizeof(note)) == sizeof(note));
+  assert(std::memcmp(back_note, note, sizeof(note)) == 0);
+  vfs.close(fd);
+
+  // A file larger than the cache forces writeback under pressure and must
+  // read back intact while parts of it are still dirty
+  assert(vfs.create_file("/papers/wb_large.bin") == 0);
+  fd = vfs.open("/papers/wb_large.bin", O_RDWR);
+  std::vector<char> data(200 * 4096 + 77);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 13 + 5);
+  }
+  assert(vfs.write(fd, data.data(), data.size()) ==
+         static_cast<ssize_t>(data.size()));
+  assert(vfs.get_dirty_block_count() <= 64);
+  vfs.seek(fd, 0, SEEK_SET);
+  std::vector<char> back(data.size());
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == data);
+  vfs.close(fd);
+
+  assert(vfs.sync() == 0);
+  assert(vfs.get_dirty_block_count() == 0);
+  assert(vfs.get_journal_stats().pending == 0);
+  vfs.unmount();
+
+  // Everything reached the image: remount write-through and compare
+  assert(vfs.mount("/tmp/test_fs.img", 64));
+  fd = vfs.open("/papers/wb_large.bin", O_RDONLY);
+  std::fill(back.begin(), back.end(), 0);
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == data);
+  vfs.close(fd);
+  vfs.unmount();
+
+  // Aged blocks are written back by the flusher on its own
+  options.dirty_expire_ms = 20;
+  assert(vfs.mount("/tmp/test_fs.img", options));
+  fd = vfs.open("/papers/wb_small.txt", O_RDWR);
+  assert(vfs.write(fd, note, sizeof(note)) == sizeof(note));
+  vfs.close(fd);
+  for (int i = 0; i < 100 && vfs.get_dirty_block_count() > 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  assert(vfs.get_dirty_block_count() == 0);
+  vfs.unmount();
+
+  std::cout << "✓ Write-back cache test passed\n\n";
+}
+
+void test_readahead() {
+  std::cout << "Testing sequential readahead...\n";
+
+  VirtualFileSystem vfs;
+  assert(vfs.mount("/tmp/test_fs.img", 256));
+  assert(vfs.create_file("/papers/stream.pdf") == 0);
+  int fd = vfs.open("/papers/stream.pdf", O_WRONLY);
+  std::vector<char> data(150 * 4096);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 11 + 1);
+  }
+  assert(vfs.write(fd, data.data(), data.size()) ==
+         static_cast<ssize_t>(data.size()));
+  vfs.close(fd);
+  vfs.unmount();
+
+  for (BlockBackend backend : {BlockBackend::PREAD, BlockBackend::IO_URING}) {
+    MountOptions options;
+    options.cache_capacity = 256;
+    options.backend = backend;
+    assert(vfs.mount("/tmp/test_fs.img", options));
+
+    // Small sequential reads: later ones are served by prefetched blocks
+    fd = vfs.open("/papers/stream.pdf", O_RDONLY);
+    std::vector<char> back(data.size());
+    size_t got = 0;
+    ssize_t n;
+    while ((n = vfs.read(fd, back.data() + got, 6000)) > 0) {
+      got += static_cast<size_t>(n);
+    }
+    vfs.close(fd);
+    assert(got == data.size());
+    assert(back == data);
+
+    CacheStats stats = vfs.get_cache_stats();
+    std::cout << "  readahead " << stats.readahead_blocks << " blocks, "
+              << stats.readahead_hits << " hits, " << stats.readahead_waste
+              << " wasted\n";
+    assert(stats.readahead_blocks > 0);
+    assert(stats.readahead_hits > 0);
+
+    // Random access does not trigger readahead
+    uint64_t prefetched = stats.readahead_blocks;
+    fd = vfs.open("/papers/stream.pdf", O_RDONLY);
+    char byte;
+    for (int i = 0; i < 20; ++i) {
+      vfs.seek(fd, static_cast<off_t>((i * 37 % 150) * 4096 + 100), SEEK_SET);
+      assert(vfs.read(fd, &byte, 1) == 1);
+    }
+    vfs.close(fd);
+    assert(vfs.get_cache_stats().readahead_blocks <= prefetched + 4);
+    vfs.unmount();
+  }
+
+  std::cout << "✓ Readahead test passed\n\n";
+}
+
+void test_extents() {
+  std::cout << "Testing extent-based block maps...\n";
+
+  const std::string image = "/tmp/test_extents.img";
+  auto fill = [](std::vector<char> &data, int seed) {
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<char>(i * 7 + seed);
+    }
+  };
+  auto read_back = [](VirtualFileSystem &vfs, const std::string &path,
+                      size_t size) {
+    std::vector<char> back(size + 1);
+    int fd = vfs.open(path, O_RDONLY);
+    assert(fd >= 0);
+    assert(vfs.read(fd, back.data(), back.size()) ==
+           static_cast<ssize_t>(size));
+    vfs.close(fd);
+    back.resize(size);
+    return back;
+  };
+
+  // A contiguous paper on a v2 image maps as one extent
+  VirtualFileSystem vfs;
+  assert(vfs.format(image, 32, 256));
+  assert(vfs.mkdir("/papers") == 0);
+  assert(vfs.create_file("/papers/big.pdf") == 0);
+  std::vector<char> paper(5 * 1024 * 1024);
+  fill(paper, 3);
+  int fd = vfs.open("/papers/big.pdf", O_WRONLY);
+  assert(vfs.write(fd, paper.data(), paper.size()) ==
+         static_cast<ssize_t>(paper.size()));
+  vfs.close(fd);
+  std::cout << "  5 MB paper: " << vfs.get_extent_count("/papers/big.pdf")
+            << " extent(s)\n";
+  assert(vfs.get_extent_count("/papers/big.pdf") <= 2);
+  assert(read_back(vfs, "/papers/big.pdf", paper.size()) == paper);
+
+  // Interleaved writers fragment both files past the inline root
+  assert(vfs.create_file("/papers/a.bin") == 0);
+  assert(vfs.create_file("/papers/b.bin") == 0);
+  std::vector<char> a(64 * 4096), b(64 * 4096);
+  fill(a, 5);
+  fill(b, 9);
+  int fa = vfs.open("/papers/a.bin", O_WRONLY);
+  int fb = vfs.open("/papers/b.bin", O_WRONLY);
+  for (size_t off = 0; off < a.size(); off += 4096) {
+    assert(vfs.write(fa, a.data() + off, 4096) == 4096);
+    assert(vfs.write(fb, b.data() + off, 4096) == 4096);
+  }
+  vfs.close(fa);
+  vfs.close(fb);
+  assert(vfs.get_extent_count("/papers/a.bin") > 5);
+  assert(read_back(vfs, "/papers/a.bin", a.size()) == a);
+  assert(read_back(vfs, "/papers/b.bin", b.size()) == b);
+
+  uint32_t free_before = vfs.get_fs_stats().free_blocks;
+  assert(vfs.delete_file("/papers/a.bin") == 0);
+  assert(vfs.get_fs_stats().free_blocks > free_before + 64);
+
+  // Past 5 leaves of extents the tree grows another index level, so
+  // fragmented files keep growing as far as they would on v1
+  const int appends = 2000;
+  assert(vfs.create_file("/papers/c.bin") == 0);
+  assert(vfs.create_file("/papers/d.bin") == 0);
+  std::vector<char> c(appends * 4096), d(appends * 4096);
+  fill(c, 11);
+  fill(d, 13);
+  int fc = vfs.open("/papers/c.bin", O_WRONLY);
+  int fd2 = vfs.open("/papers/d.bin", O_WRONLY);
+  for (size_t off = 0; off < c.size(); off += 4096) {
+    assert(vfs.write(fc, c.data() + off, 4096) == 4096);
+    assert(vfs.write(fd2, d.data() + off, 4096) == 4096);
+  }
+  vfs.close(fc);
+  vfs.close(fd2);
+  assert(vfs.get_extent_count("/papers/c.bin") > 5 * 340);
+  vfs.unmount();
+  assert(vfs.mount(image, 256));
+  assert(read_back(vfs, "/papers/c.bin", c.size()) == c);
+  assert(read_back(vfs, "/papers/d.bin", d.size()) == d);
+  free_before = vfs.get_fs_stats().free_blocks;
+  assert(vfs.delete_file("/papers/c.bin") == 0);
+  assert(vfs.delete_file("/papers/d.bin") == 0);
+  assert(vfs.get_fs_stats().free_blocks >= free_before + 2 * appends);
+  vfs.unmount();
+
+  // v1 images are converted in place
+  FormatOptions v1;
+  v1.version = FORMAT_V1;
+  assert(vfs.format(image, 16, v1, 256));
+  assert(vfs.mkdir("/papers") == 0);
+  assert(vfs.create_file("/papers/old.pdf") == 0);
+  std::vector<char> old(600 * 4096 + 123);
+  fill(old, 1);
+  fd = vfs.open("/papers/old.pdf", O_WRONLY);
+  assert(vfs.write(fd, old.data(), old.size()) ==
+         static_cast<ssize_t>(old.size()));
+  vfs.close(fd);
+  assert(vfs.get_extent_count("/papers/old.pdf") == 0);
+  vfs.unmount();
+
+  assert(vfs.upgrade_image(image));
+  assert(vfs.mount(image, 256));
+  assert(read_back(vfs, "/papers/old.pdf", old.size()) == old);
+  std::cout << "  upgraded v1 file: "
+            << vfs.get_extent_count("/papers/old.pdf") << " extent(s)\n";
+  assert(vfs.get_extent_count("/papers/old.pdf") >= 1);
+  assert(vfs.get_extent_count("/papers/old.pdf") <= 3);
+
+  // Converted files keep growing through the extent tree
+  fd = vfs.open("/papers/old.pdf", O_WRONLY);
+  vfs.seek(fd, 0, SEEK_END);
+  assert(vfs.write(fd, paper.data(), paper.size()) ==
+         static_cast<ssize_t>(paper.size()));
+  vfs.close(fd);
+  std::vector<char> grown = old;
+  grown.insert(grown.end(), paper.begin(), paper.end());
+  assert(read_back(vfs, "/papers/old.pdf", grown.size()) == grown);
+  vfs.unmount();
+
+  // An upgrade that cannot convert every inode changes none of them
+  assert(vfs.format(image, 32, v1, 256));
+  assert(vfs.create_file("/kept.pdf") == 0);
+  fd = vfs.open("/kept.pdf", O_WRONLY);
+  assert(vfs.write(fd, old.data(), old.size()) ==
+         static_cast<ssize_t>(old.size()));
+  vfs.close(fd);
+  // Two files written a block at a time in turn leave one extent per block
+  assert(vfs.create_file("/even.bin") == 0);
+  assert(vfs.create_file("/odd.bin") == 0);
+  int even = vfs.open("/even.bin", O_WRONLY);
+  int odd = vfs.open("/odd.bin", O_WRONLY);
+  for (int i = 0; i < 1800; ++i) {
+    assert(vfs.write(even, old.data(), 4096) == 4096);
+    assert(vfs.write(odd, old.data(), 4096) == 4096);
+  }
+  vfs.close(even);
+  vfs.close(odd);
+  // ...and fill the image, leaving no room for their extent tree blocks
+  assert(vfs.create_file("/filler.bin") == 0);
+  int filler = vfs.open("/filler.bin", O_WRONLY);
+  while (vfs.write(filler, old.data(), 4096) == 4096) {
+  }
+  vfs.close(filler);
+  vfs.unmount();
+
+  assert(!vfs.upgrade_image(image));
+  assert(vfs.mount(image, 256));
+  assert(vfs.get_extent_count("/kept.pdf") == 0); // still v1
+  assert(read_back(vfs, "/kept.pdf", old.size()) == old);
+  assert(vfs.delete_file("/filler.bin") == 0);
+  vfs.unmount();
+
+  // With room again every file converts, the fragmented ones two levels
+  // deep
+  assert(vfs.upgrade_image(image));
+  assert(vfs.mount(image, 256));
+  assert(read_back(vfs, "/kept.pdf", old.size()) == old);
+  assert(vfs.get_extent_count("/even.bin") == 1800);
+  std::vector<char> blocks(1800 * 4096);
+  for (size_t off = 0; off < blocks.size(); off += 4096) {
+    std::copy(old.begin(), old.begin() + 4096, blocks.begin() + off);
+  }
+  assert(read_back(vfs, "/even.bin", blocks.size()) == blocks);
+  assert(read_back(vfs, "/odd.bin", blocks.size()) == blocks);
+  vfs.unmount();
+
+  std::cout << "✓ Extent test passed\n\n";
+}
+
+void test_indirect_blocks() {
+  std::cout << "Testing double/triple indirect blocks...\n";
+
+  const std::string image = "/tmp/test_indirect.img";
+  VirtualFileSystem vfs;
+  FormatOptions v1;
+  v1.version = FORMAT_V1;
+  assert(vfs.format(image, 32, v1, 256));
+  assert(vfs.mkdir("/papers") == 0);
+
+  // 12 MB reaches well into the double indirect range (past ~4 MB)
+  assert(vfs.create_file("/papers/supplement.zip") == 0);
+  std::vector<char> data(12 * 1024 * 1024);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 13 + i / 4096);
+  }
+  int fd = vfs.open("/papers/supplement.zip", O_WRONLY);
+  for (size_t off = 0; off < data.size(); off += 100000) {
+    size_t n = std::min<size_t>(100000, data.size() - off);
+    assert(vfs.write(fd, data.data() + off, n) == static_cast<ssize_t>(n));
+  }
+  vfs.close(fd);
+  vfs.unmount();
+
+  assert(vfs.mount(image, 256));
+  std::vector<char> back(data.size());
+  fd = vfs.open("/papers/supplement.zip", O_RDONLY);
+  size_t got = 0;
+  ssize_t n;
+  while ((n = vfs.read(fd, back.data() + got, 65536)) > 0) {
+    got += static_cast<size_t>(n);
+  }
+  vfs.close(fd);
+  assert(got == data.size());
+  assert(back == data);
+
+  // A block past 4 GB goes through the triple indirect tree
+  assert(vfs.create_file("/papers/sparse.bin") == 0);
+  fd = vfs.open("/papers/sparse.bin", O_RDWR);
+  off_t far = static_cast<off_t>(5) * 1024 * 1024 * 1024;
+  const char tail[] = "triple indirect";
+  assert(vfs.seek(fd, far, SEEK_SET) == far);
+  assert(vfs.write(fd, tail, sizeof(tail)) ==
+         static_cast<ssize_t>(sizeof(tail)));
+  char check[sizeof(tail)] = {};
+  assert(vfs.seek(fd, far, SEEK_SET) == far);
+  assert(vfs.read(fd, check, sizeof(check)) ==
+         static_cast<ssize_t>(sizeof(check)));
+  assert(std::memcmp(check, tail, sizeof(tail)) == 0);
+  vfs.close(fd);
+
+  // Deleting frees data and pointer blocks alike
+  uint32_t free_before = vfs.get_fs_stats().free_blocks;
+  assert(vfs.delete_file("/papers/sparse.bin") == 0);
+  assert(vfs.get_fs_stats().free_blocks == free_before + 4);
+  free_before = vfs.get_fs_stats().free_blocks;
+  assert(vfs.delete_file("/papers/supplement.zip") == 0);
+  assert(vfs.get_fs_stats().free_blocks ==
+         free_before + 3072 + 1 + 1 + (3072 - 12 - 1024 + 1023) / 1024);
+  vfs.unmount();
+
+  std::cout << "✓ Indirect block test passed\n\n";
+}
+
+void test_map_cache() {
+  std::cout << "Testing per-fd block map cache...\n";
+
+  const std::string image = "/tmp/test_map_cache.img";
+  VirtualFileSystem vfs;
+  FormatOptions v1;
+  v1.version = FORMAT_V1;
+  assert(vfs.format(image, 16, v1, 256));
+  assert(vfs.create_file("/paper.pdf") == 0);
+  std::vector<char> data(1000 * 4096);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 3 + i / 4096);
+  }
+  int fd = vfs.open("/paper.pdf", O_WRONLY);
+  assert(vfs.write(fd, data.data(), data.size()) ==
+         static_cast<ssize_t>(data.size()));
+  vfs.close(fd);
+  vfs.unmount();
+
+  // Block-sized reads through the indirect region: the pointer block is
+  // fetched once per window instead of once per read
+  MountOptions options;
+  options.cache_capacity = 64;
+  options.readahead_blocks = 0;
+  assert(vfs.mount(image, options));
+  fd = vfs.open("/paper.pdf", O_RDONLY);
+  std::vector<char> back(data.size());
+  uint64_t before = vfs.get_cache_stats().total_requests;
+  size_t reads = 0;
+  for (size_t off = 0; off < back.size(); off += 4096) {
+    assert(vfs.read(fd, back.data() + off, 4096) == 4096);
+    reads++;
+  }
+  uint64_t requests = vfs.get_cache_stats().total_requests - before;
+  assert(back == data);
+  // Per read: at most an atime update and the data block
+  std::cout << "  " << reads << " reads, " << requests
+            << " cache lookups\n";
+  assert(requests <= reads * 3 + 4);
+
+  // Truncation through another fd invalidates the translations
+  assert(vfs.create_file("/other.pdf") == 0);
+  int trunc_fd = vfs.open("/paper.pdf", O_WRONLY | O_TRUNC);
+  int other_fd = vfs.open("/other.pdf", O_WRONLY);
+  std::vector<char> filler(64 * 4096, 'x');
+  assert(vfs.write(other_fd, filler.data(), filler.size()) ==
+         static_cast<ssize_t>(filler.size()));
+  std::vector<char> fresh(data.size(), 'n');
+  assert(vfs.write(trunc_fd, fresh.data(), fresh.size()) ==
+         static_cast<ssize_t>(fresh.size()));
+  vfs.close(other_fd);
+  vfs.close(trunc_fd);
+
+  assert(vfs.seek(fd, 0, SEEK_SET) == 0);
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == fresh);
+  vfs.close(fd);
+  vfs.unmount();
+
+  std::cout << "✓ Block map cache test passed\n\n";
+}
+
+void test_bitmap() {
+  std::cout << "Testing block bitmap...\n";
+
+  // Sizes that end mid-word and mid-byte
+  Bitmap bitmap(8195);
+  assert(bitmap.get_free_count() == 8195);
+  assert(bitmap.size() == 1025);
+
+  // Next fit continues after the previous allocation
+  assert(bitmap.allocate() == 0);
+  assert(bitmap.allocate() == 1);
+  assert(bitmap.free(0));
+  assert(bitmap.allocate() == 2);
+
+  // Goals wrap around past the end
+  assert(bitmap.allocate(8194) == 8194);
+  assert(bitmap.allocate(8194) == 0);
+  assert(bitmap.allocate(9000) == 3);
+
+  // Fill the rest; bits past the end are never handed out
+  std::vector<int32_t> blocks;
+  int32_t block;
+  while ((block = bitmap.allocate()) >= 0) {
+    assert(block < 8195);
+    blocks.push_back(block);
+  }
+  assert(blocks.size() == 8195 - 5);
+  assert(bitmap.get_free_count() == 0);
+  assert(bitmap.free(5000));
+  assert(bitmap.allocate(6000) == 5000);
+
+  // Round trip through the on-disk byte layout
+  assert(bitmap.free(4097));
+  std::vector<uint8_t> bytes = bitmap.serialize();
+  assert(bytes.size() == 1025);
+  assert(bytes[4097 / 8] == static_cast<uint8_t>(~(1 << (4097 % 8))));
+  assert(bytes.back() == 0x07);
+  Bitmap loaded(8195);
+  assert(loaded.deserialize(bytes));
+  assert(loaded.get_free_count() == 1);
+  assert(!loaded.is_allocated(4097));
+  assert(loaded.allocate() == 4097);
+
+  // Ranges: smallest run that fits, else the longest run
+  Bitmap ranges(1000);
+  uint32_t length = 0;
+  assert(ranges.allocate_range(1000, 0, length) == 0 && length == 1000);
+  for (uint32_t i = 100; i < 120; ++i) {
+    ranges.free(i); // run of 20
+  }
+  for (uint32_t i = 500; i < 505; ++i) {
+    ranges.free(i); // run of 5
+  }
+  assert(ranges.allocate_range(4, 0, length) == 500 && length == 4);
+  assert(ranges.allocate_range(8, 0, length) == 100 && length == 8);
+  assert(ranges.allocate_range(50, 0, length) == 108 && length == 12);
+  uint32_t runs = 0, longest = 0;
+  ranges.get_free_extents(runs, longest);
+  assert(runs == 1 && longest == 1);
+
+  std::cout << "✓ Bitmap test passed\n\n";
+}
+
+void test_allocate_range() {
+  std::cout << "Testing contiguous range allocation...\n";
+
+  VirtualFileSystem vfs;
+  assert(vfs.format("/tmp/test_range.img", 16, 256));
+  assert(vfs.mkdir("/reviews") == 0);
+
+  // Punch one-block holes into the free space (a directory block holds
+  // 15 entries)
+  std::vector<char> block(4096, 'r');
+  for (int i = 0; i < 14; ++i) {
+    std::string path = "/reviews/r" + std::to_string(i) + ".txt";
+    assert(vfs.create_file(path) == 0);
+    int fd = vfs.open(path, O_WRONLY);
+    assert(vfs.write(fd, block.data(), block.size()) == 4096);
+    vfs.close(fd);
+  }
+  for (int i = 0; i < 14; i += 2) {
+    assert(vfs.delete_file("/reviews/r" + std::to_string(i) + ".txt") == 0);
+  }
+  FileSystemStats stats = vfs.get_fs_stats();
+  std::cout << "  " << stats.free_extents << " free extents, "
+            << stats.fragmentation_percent() << "% fragmented\n";
+  assert(stats.free_extents > 5);
+  assert(stats.fragmentation_percent() > 0.0);
+
+  // A large write skips the holes and lands in one run
+  assert(vfs.create_file("/reviews/paper.pdf") == 0);
+  std::vector<char> paper(256 * 4096, 'p');
+  int fd = vfs.open("/reviews/paper.pdf", O_WRONLY);
+  assert(vfs.write(fd, paper.data(), paper.size()) ==
+         static_cast<ssize_t>(paper.size()));
+  vfs.close(fd);
+  assert(vfs.get_extent_count("/reviews/paper.pdf") == 1);
+  assert(vfs.get_fs_stats().free_extents == stats.free_extents);
+  vfs.unmount();
+
+  std::cout << "✓ Range allocation test passed\n\n";
+}
+
+void test_inode_allocation() {
+  std::cout << "Testing inode allocation...\n";
+
+  VirtualFileSystem vfs;
+  assert(vfs.format("/tmp/test_inodes.img", 16, 256));
+
+  // Cache lookups made by one create in an empty directory
+  auto create_cost = [&vfs](const std::string &dir) {
+    assert(vfs.mkdir(dir) == 0);
+    uint64_t before = vfs.get_cache_stats().total_requests;
+    assert(vfs.create_file(dir + "/paper.pdf") == 0);
+    return vfs.get_cache_stats().total_requests - before;
+  };
+  uint64_t first = create_cost("/first");
+
+  for (int d = 0; d < 10; ++d) {
+    std::string dir = "/papers" + std::to_string(d);
+    assert(vfs.mkdir(dir) == 0);
+    for (int i = 0; i < 14; ++i) {
+      assert(vfs.create_file(dir + "/f" + std::to_string(i)) == 0);
+    }
+  }
+  uint64_t later = create_cost("/later");
+  std::cout << "  create: " << first << " lookups at first, " << later
+            << " after 150 inodes\n";
+  assert(later == first);
+
+  // Freed inodes are counted and handed out again after a remount
+  uint32_t free_inodes = vfs.get_fs_stats().free_inodes;
+  assert(vfs.delete_file("/papers0/f0") == 0);
+  assert(vfs.get_fs_stats().free_inodes == free_inodes + 1);
+  vfs.unmount();
+
+  assert(vfs.mount("/tmp/test_inodes.img", 256));
+  assert(vfs.get_fs_stats().free_inodes == free_inodes + 1);
+  assert(vfs.create_file("/papers0/f0") == 0);
+  assert(vfs.get_fs_stats().free_inodes == free_inodes);
+  assert(vfs.exists("/papers9/f13"));
+  vfs.unmount();
+
+  std::cout << "✓ Inode allocation test passed\n\n";
+}
+
+void test_inode_cache() {
+  std::cout << "Testing inode cache...\n";
+
+  {
+    VirtualFileSystem vfs;
+    assert(vfs.format("/tmp/test_icache.img", 16, 256));
+    assert(vfs.create_file("/paper.pdf") == 0);
+    int fd = vfs.open("/paper.pdf", O_RDWR);
+    std::vector<char> data(4096, 'i');
+    assert(vfs.write(fd, data.data(), data.size()) == 4096);
+
+    // Repeated reads find the inode decoded in memory
+    CacheStats before = vfs.get_inode_cache_stats();
+    std::vector<char> buf(4096);
+    for (int i = 0; i < 50; ++i) {
+      vfs.seek(fd, 0, SEEK_SET);
+      assert(vfs.read(fd, buf.data(), buf.size()) == 4096);
+    }
+    CacheStats after = vfs.get_inode_cache_stats();
+    assert(after.misses == before.misses);
+    assert(after.hits >= before.hits + 50);
+    vfs.close(fd);
+    vfs.unmount();
+  }
+
+  {
+    // With write-back, inode updates stay in memory until sync
+    VirtualFileSystem vfs;
+    MountOptions options;
+    options.write_back = true;
+    options.dirty_expire_ms = 60000;
+    options.inode_cache_capacity = 8;
+    assert(vfs.mount("/tmp/test_icache.img", options));
+    for (int i = 0; i < 12; ++i) {
+      assert(vfs.create_file("/f" + std::to_string(i)) == 0);
+    }
+    int fd = vfs.open("/f3", O_WRONLY);
+    std::vector<char> data(10000, 'w');
+    assert(vfs.write(fd, data.data(), data.size()) == 10000);
+    vfs.close(fd);
+    assert(vfs.get_dirty_inode_count() > 0);
+    assert(vfs.sync() == 0);
+    assert(vfs.get_dirty_inode_count() == 0);
+
+    // Clean inodes are evicted past capacity, then read back from disk
+    for (int i = 0; i < 12; ++i) {
+      assert(vfs.exists("/f" + std::to_string(i)));
+    }
+    assert(vfs.get_inode_cache_stats().evictions > 0);
+    fd = vfs.open("/f7", O_WRONLY);
+    assert(vfs.write(fd, data.data(), 100) == 100);
+    vfs.close(fd);
+    vfs.unmount(); // writes the remaining dirty inodes
+  }
+
+  VirtualFileSystem vfs;
+  assert(vfs.mount("/tmp/test_icache.img", 256));
+  std::vector<char> buf(20000);
+  int fd = vfs.open("/f3", O_RDONLY);
+  assert(vfs.read(fd, buf.data(), buf.size()) == 10000);
+  vfs.close(fd);
+  fd = vfs.open("/f7", O_RDONLY);
+  assert(vfs.read(fd, buf.data(), buf.size()) == 100);
+  vfs.close(fd);
+  assert(vfs.exists("/f11"));
+  vfs.unmount();
+
+  std::cout << "✓ Inode cache test passed\n\n";
+}
+
+void test_atime_modes() {
+  std::cout << "Testing atime mount modes...\n";
+
+  const std::string image = "/tmp/test_atime.img";
+  {
+    VirtualFileSystem vfs;
+    assert(vfs.format(image, 16, 256));
+    assert(vfs.create_file("/paper.pdf") == 0);
+    int fd = vfs.open("/paper.pdf", O_WRONLY);
+    std::vector<char> data(8192, 'a');
+    assert(vfs.write(fd, data.data(), data.size()) == 8192);
+    vfs.close(fd);
+    vfs.unmount();
+  }
+
+  // Journaled block writes made by opening the file and reading it 20 times
+  auto read_writes = [&image](const MountOptions &options, size_t &dirty) {
+    VirtualFileSystem vfs;
+    assert(vfs.mount(image, options));
+    uint64_t before = vfs.get_journal_stats().journaled;
+    int fd = vfs.open("/paper.pdf", O_RDONLY);
+    std::vector<char> buf(4096);
+    for (int i = 0; i < 20; ++i) {
+      assert(vfs.seek(fd, 0, SEEK_SET) == 0);
+      assert(vfs.read(fd, buf.data(), buf.size()) == 4096);
+    }
+    vfs.close(fd);
+    uint64_t writes = vfs.get_journal_stats().journaled - before;
+    dirty = vfs.get_dirty_inode_count();
+    assert(vfs.sync() == 0);
+    assert(vfs.get_dirty_inode_count() == 0);
+    vfs.unmount();
+    return writes;
+  };
+
+  MountOptions options;
+  size_t dirty = 0;
+  options.atime_mode = AtimeMode::STRICT;
+  assert(read_writes(options, dirty) >= 21);
+
+  options.atime_mode = AtimeMode::NOATIME;
+  assert(read_writes(options, dirty) == 0);
+  assert(dirty == 0);
+
+  options.atime_mode = AtimeMode::STRICT;
+  options.lazytime = true;
+  options.dirty_expire_ms = 60000;
+  assert(read_writes(options, dirty) == 0);
+  assert(dirty == 1);
+
+  std::cout << "✓ atime mount modes test passed\n\n";
+}
+
+void test_directory_index() {
+  std::cout << "Testing indexed directories...\n";
+
+  const std::string image = "/tmp/test_dir_index.img";
+  auto listed = [](VirtualFileSystem &vfs, const std::string &path) {
+    std::vector<DirEntryInfo> entries;
+    assert(vfs.readdir(path, entries) == 0);
+    std::vector<std::string> names;
+    for (const auto &entry : entries) {
+      names.push_back(entry.name);
+    }
+    std::sort(names.begin(), names.end());
+    assert(std::adjacent_find(names.begin(), names.end()) == names.end());
+    return names.size();
+  };
+
+  struct Layout {
+    uint32_t version;
+    bool compact;
+    int files;
+  };
+  // Enough slot entries on v2 for the root to grow a level of interior
+  // nodes; packed records split leaves far less often
+  uint64_t listing_requests[2] = {};
+  for (const Layout &layout : {Layout{FORMAT_V1, false, 600},
+                               Layout{FORMAT_V2, false, 8000},
+                               Layout{FORMAT_V2, true, 8000}}) {
+    const int files = layout.files;
+    FormatOptions format;
+    format.version = layout.version;
+    format.total_inodes = 10000;
+    format.compact_dirs = layout.compact;
+    VirtualFileSystem vfs;
+    assert(vfs.format(image, 64, format, 256));
+    vfs.unmount();
+
+    MountOptions options;
+    options.write_back = true;
+    assert(vfs.mount(image, options));
+    assert(vfs.mkdir("/papers") == 0);
+    for (int i = 0; i < files; ++i) {
+      assert(vfs.create_file("/papers/P" + std::to_string(i)) == 0);
+    }
+    assert(vfs.create_file("/papers/P17") == -2);
+    assert(listed(vfs, "/papers") == static_cast<size_t>(files));
+
+    for (int i = 0; i < files; i += 3) {
+      assert(vfs.delete_file("/papers/P" + std::to_string(i)) == 0);
+    }
+    for (int i = 0; i < files; ++i) {
+      assert(vfs.exists("/papers/P" + std::to_string(i)) == (i % 3 != 0));
+    }
+    for (int i = 0; i < files; i += 3) {
+      assert(vfs.create_file("/papers/P" + std::to_string(i)) == 0);
+    }
+    vfs.unmount();
+
+    assert(vfs.mount(image, 256));
+    uint64_t requests = vfs.get_cache_stats().total_requests;
+    assert(listed(vfs, "/papers") == static_cast<size_t>(files));
+    if (layout.files == 8000) {
+      listing_requests[layout.compact] =
+          vfs.get_cache_stats().total_requests - requests;
+    }
+    for (int i = 0; i < files; ++i) {
+      assert(vfs.exists("/papers/P" + std::to_string(i)));
+    }
+    assert(!vfs.exists("/papers/P" + std::to_string(files)));
+    vfs.unmount();
+  }
+
+  // Listing the same directory reads several times fewer blocks
+  std::cout << "  8000-entry listing: " << listing_requests[0]
+            << " block reads with slots, " << listing_requests[1]
+            << " with packed records\n";
+  assert(listing_requests[1] * 5 < listing_requests[0]);
+
+  // Packed records of very different lengths reuse freed space
+  VirtualFileSystem vfs;
+  assert(vfs.format(image, 16, 256));
+  assert(vfs.mkdir("/mixed") == 0);
+  auto mixed_name = [](int i) {
+    std::string name = std::to_string(i);
+    size_t pad = i % 2 ? MAX_FILENAME - name.size() : i % 7;
+    return name + std::string(pad, 'a' + i % 26);
+  };
+  for (int i = 0; i < 200; ++i) {
+    assert(vfs.create_file("/mixed/" + mixed_name(i)) == 0);
+  }
+  for (int i = 0; i < 200; i += 4) {
+    assert(vfs.delete_file("/mixed/" + mixed_name(i)) == 0);
+  }
+  assert(listed(vfs, "/mixed") == 150);
+  for (int i = 0; i < 200; ++i) {
+    assert(vfs.exists("/mixed/" + mixed_name(i)) == (i % 4 != 0));
+  }
+  vfs.unmount();
+
+  std::cout << "✓ Indexed directory test passed\n\n";
+}
+
+void test_dentry_cache() {
+  std::cout << "Testing dentry cache...\n";
+
+  VirtualFileSystem vfs;
+  assert(vfs.format("/tmp/test_dentry.img", 16, 256));
+  for (const char *dir : {"/papers", "/papers/P7", "/papers/P7/rounds",
+                          "/papers/P7/rounds/R2",
+                          "/papers/P7/rounds/R2/reviews"}) {
+    assert(vfs.mkdir(dir) == 0);
+  }
+  const std::string deep = "/papers/P7/rounds/R2/reviews";
+  const std::string missing = deep + "/review.txt";
+  assert(vfs.exists(deep));
+  assert(!vfs.exists(missing));
+
+  // Both resolve from the cache alone, the missing name included
+  uint64_t blocks = vfs.get_cache_stats().total_requests;
+  uint64_t inodes = vfs.get_inode_cache_stats().total_requests;
+  uint64_t hits = vfs.get_dentry_cache_stats().hits;
+  for (int i = 0; i < 10; ++i) {
+    assert(vfs.exists(deep));
+    assert(!vfs.exists(missing));
+  }
+  assert(vfs.get_cache_stats().total_requests == blocks);
+  assert(vfs.get_inode_cache_stats().total_requests == inodes);
+  assert(vfs.get_dentry_cache_stats().hits == hits + 10 * (5 + 6));
+
+  // Adding and removing entries keeps cached results exact
+  assert(vfs.create_file(missing) == 0);
+  assert(vfs.exists(missing));
+  assert(vfs.delete_file(missing) == 0);
+  assert(!vfs.exists(missing));
+  assert(vfs.rmdir(deep) == 0);
+  assert(!vfs.exists(deep));
+  assert(!vfs.exists(missing));
+  assert(vfs.mkdir(deep) == 0);
+  assert(vfs.exists(deep));
+  assert(!vfs.exists(missing));
+  vfs.unmount();
+
+  std::cout << "✓ Dentry cache test passed\n\n";
+}
+
+void test_path_resolution() {
+  std::cout << "Testing path resolution...\n";
+
+  PathComponents parts("//papers/./P7/../P8/rounds/");
+  assert(parts.size() == 3);
+  assert(parts[0] == "papers" && parts[1] == "P8" && parts[2] == "rounds");
+  assert(PathComponents("/").empty());
+  assert(PathComponents("../..").empty());
+  assert(PathComponents("/../papers").back() == "papers");
+
+  // Deeper than the inline storage spills to the heap and stays correct
+  std::string deep;
+  for (size_t i = 0; i < PathComponents::INLINE_DEPTH + 8; ++i) {
+    deep += "/d" + std::to_string(i);
+  }
+  PathComponents long_parts(deep + "/..");
+  assert(long_parts.size() == PathComponents::INLINE_DEPTH + 7);
+  assert(long_parts.back() == "d38");
+
+  VirtualFileSystem vfs;
+  assert(vfs.format("/tmp/test_path.img", 16, 256));
+  assert(vfs.mkdir("/papers") == 0);
+  assert(vfs.mkdir("/papers/P7") == 0);
+  assert(vfs.create_file("/papers/./P7/../P7/review.txt") == 0);
+  assert(vfs.exists("/papers/P7/review.txt"));
+  assert(vfs.exists("papers//P7/./review.txt"));
+  assert(vfs.exists("/papers/missing/../P7/review.txt"));
+  assert(!vfs.exists("/papers/P7/review.txt/x"));
+  assert(vfs.is_directory("/papers/P7/.."));
+  assert(vfs.create_file("/") != 0);
+  vfs.unmount();
+
+  std::cout << "✓ Path resolution test passed\n\n";
+}
+
+void test_vectored_io() {
+  std::cout << "Testing vectored I/O...\n";
+
+  VirtualFileSystem vfs;
+  assert(vfs.format("/tmp/test_vectored.img", 16, 256));
+  assert(vfs.create_file("/paper.pdf") == 0);
+  int fd = vfs.open("/paper.pdf", O_RDWR);
+  assert(fd >= 0);
+
+  // Segments of odd sizes, one empty, so blocks straddle segments
+  std::vector<char> expected(40000);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    expected[i] = static_cast<char>('a' + (i * 7) % 26);
+  }
+  const size_t sizes[] = {100, 0, 5000, 4096, 9000, 21804};
+  std::vector<struct iovec> iov;
+  size_t pos = 0;
+  for (size_t size : sizes) {
+    iov.push_back({expected.data() + pos, size});
+    pos += size;
+  }
+  assert(pos == expected.size());
+  assert(vfs.writev(fd, iov.data(), iov.size()) ==
+         static_cast<ssize_t>(expected.size()));
+  assert(vfs.seek(fd, 0, SEEK_CUR) == static_cast<off_t>(expected.size()));
+
+  // Many small segments use more bounce frames than one batch holds
+  std::vector<char> back(expected.size());
+  iov.clear();
+  for (pos = 0; pos < back.size(); pos += 333) {
+    iov.push_back({back.data() + pos, std::min<size_t>(333, back.size() - pos)});
+  }
+  assert(vfs.seek(fd, 0, SEEK_SET) == 0);
+  assert(vfs.readv(fd, iov.data(), iov.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == expected);
+
+  // Positional calls neither use nor move the descriptor's offset
+  assert(vfs.seek(fd, 5, SEEK_SET) == 5);
+  char patch[6000];
+  std::memset(patch, 'Z', sizeof(patch));
+  struct iovec patch_iov[2] = {{patch, 10}, {patch + 10, sizeof(patch) - 10}};
+  assert(vfs.pwritev(fd, patch_iov, 2, 4000) ==
+         static_cast<ssize_t>(sizeof(patch)));
+  std::memset(expected.data() + 4000, 'Z', sizeof(patch));
+  char head[3];
+  struct iovec head_iov = {head, sizeof(head)};
+  assert(vfs.preadv(fd, &head_iov, 1, 0) == 3);
+  assert(std::memcmp(head, expected.data(), 3) == 0);
+  assert(vfs.seek(fd, 0, SEEK_CUR) == 5);
+  assert(vfs.preadv(fd, &head_iov, 1, -1) < 0);
+  assert(vfs.readv(fd, &head_iov, -1) < 0);
+
+  // Several threads read disjoint ranges of one fd at once
+  constexpr int kThreads = 4;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kThreads, 0);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      size_t chunk = expected.size() / kThreads;
+      std::vector<char> part(chunk);
+      for (int round = 0; round < 50; ++round) {
+        struct iovec part_iov = {part.data(), chunk};
+        if (vfs.preadv(fd, &part_iov, 1, t * chunk) !=
+                static_cast<ssize_t>(chunk) ||
+            std::memcmp(part.data(), expected.data() + t * chunk, chunk) != 0) {
+          failures[t]++;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    assert(failures[t] == 0);
+  }
+  assert(vfs.seek(fd, 0, SEEK_CUR) == 5);
+
+  vfs.close(fd);
+  vfs.unmount();
+
+  std::cout << "✓ Vectored I/O test passed\n\n";
+}
+
+void test_journal_transactions() {
+  std::cout << "Testing journal transactions...\n";
+
+  const std::string image = "/tmp/test_journal.img";
+  const std::string journal = image + ".journal";
+  VirtualFileSystem vfs;
+  assert(vfs.format(image, 16, 256));
+  vfs.unmount();
+
+  MountOptions options;
+  options.journal_blocks = 600;
+  options.journal_mode = JournalMode::FULL; // file data recovers too
+  options.dirty_expire_ms = 60000; // only sync() and a full region checkpoint
+  assert(vfs.mount(image, options));
+
+  // Concurrent writers share journal syncs
+  const int threads = 8;
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    assert(vfs.create_file("/w" + std::to_string(t)) == 0);
+  }
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([&vfs, t]() {
+      int fd = vfs.open("/w" + std::to_string(t), O_RDWR);
+      assert(fd >= 0);
+      std::vector<char> chunk(512, static_cast<char>('a' + t));
+      for (int i = 0; i < 40; ++i) {
+        assert(vfs.write(fd, chunk.data(), chunk.size()) ==
+               static_cast<ssize_t>(chunk.size()));
+      }
+      vfs.close(fd);
+    });
+  }
+  for (auto &w : writers) {
+    w.join();
+  }
+  auto stats = vfs.get_journal_stats();
+  assert(stats.commits >= threads * 40);
+  assert(stats.syncs < stats.commits);
+
+  // The region stays its configured size while far more is journaled
+  assert(vfs.create_file("/big.bin") == 0);
+  int fd = vfs.open("/big.bin", O_RDWR);
+  std::vector<char> big(3 * 1024 * 1024, 'z');
+  assert(vfs.write(fd, big.data(), big.size()) ==
+         static_cast<ssize_t>(big.size()));
+  vfs.close(fd);
+  stats = vfs.get_journal_stats();
+  assert(stats.journaled > options.journal_blocks);
+  assert(stats.checkpoints > 0);
+  assert(std::filesystem::file_size(journal) ==
+         (options.journal_blocks + 1) * 4096ull);
+
+  // Crash after commit: keep the image from before the overwrite and the
+  // journal from before the checkpoint, then recover from them
+  assert(vfs.create_file("/crash.bin") == 0);
+  fd = vfs.open("/crash.bin", O_RDWR);
+  std::vector<char> before(10000, 'A');
+  assert(vfs.write(fd, before.data(), before.size()) ==
+         static_cast<ssize_t>(before.size()));
+  assert(vfs.sync() == 0);
+  std::filesystem::copy_file(image, image + ".saved",
+                             std::filesystem::copy_options::overwrite_existing);
+  std::vector<char> after(10000, 'B');
+  assert(vfs.seek(fd, 0, SEEK_SET) == 0);
+  assert(vfs.write(fd, after.data(), after.size()) ==
+         static_cast<ssize_t>(after.size()));
+  vfs.close(fd);
+  std::filesystem::copy_file(journal, journal + ".saved",
+                             std::filesystem::copy_options::overwrite_existing);
+  vfs.unmount();
+
+  std::filesystem::rename(image + ".saved", image);
+  std::filesystem::rename(journal + ".saved", journal);
+  assert(vfs.mount(image, options));
+  stats = vfs.get_journal_stats();
+  assert(stats.recovered && stats.replayed > 0);
+  fd = vfs.open("/crash.bin", O_RDONLY);
+  std::vector<char> back(after.size());
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  assert(back == after);
+  vfs.close(fd);
+
+  // Recovery steps over a transaction that failed to write and was
+  // replaced by a skip record: the first block's overwrite is lost, the
+  // later one still replays
+  assert(vfs.sync() == 0);
+  std::filesystem::copy_file(image, image + ".saved",
+                             std::filesystem::copy_options::overwrite_existing);
+  std::vector<char> first(4096, 'C'), second(4096, 'D');
+  fd = vfs.open("/crash.bin", O_RDWR);
+  assert(vfs.write(fd, first.data(), first.size()) == 4096);
+  assert(vfs.write(fd, second.data(), second.size()) == 4096);
+  vfs.close(fd);
+  std::filesystem::copy_file(journal, journal + ".saved",
+                             std::filesystem::copy_options::overwrite_existing);
+  vfs.unmount();
+  {
+    std::fstream jf(journal + ".saved",
+                    std::ios::in | std::ios::out | std::ios::binary);
+    JournalHeader header{};
+    jf.read(reinterpret_cast<char *>(&header), sizeof(header));
+    // Find the transaction carrying the first overwrite
+    uint64_t pos = header.head;
+    JournalDescriptor descriptor{};
+    std::vector<char> block(4096);
+    while (true) {
+      jf.seekg((1 + pos) * 4096);
+      jf.read(reinterpret_cast<char *>(&descriptor), sizeof(descriptor));
+      assert(descriptor.type == JOURNAL_DESCRIPTOR);
+      jf.seekg((2 + pos) * 4096);
+      jf.read(block.data(), block.size());
+      if (descriptor.count == 1 && block == first) {
+        break;
+      }
+      pos += descriptor.count + 2;
+    }
+    descriptor.type = JOURNAL_SKIP;
+    jf.seekp((1 + pos) * 4096);
+    jf.write(reinterpret_cast<const char *>(&descriptor), sizeof(descriptor));
+  }
+  std::filesystem::rename(image + ".saved", image);
+  std::filesystem::rename(journal + ".saved", journal);
+  assert(vfs.mount(image, options));
+  assert(vfs.get_journal_stats().replayed > 0);
+  fd = vfs.open("/crash.bin", O_RDONLY);
+  assert(vfs.read(fd, back.data(), back.size()) ==
+         static_cast<ssize_t>(back.size()));
+  std::vector<char> expected = after;
+  std::copy(second.begin(), second.end(), expected.begin() + 4096);
+  assert(back == expected);
+  vfs.close(fd);
+
+  // A clean unmount leaves nothing to replay
+  vfs.unmount();
+  assert(vfs.mount(image, options));
+  assert(!vfs.get_journal_stats().recovered);
+  vfs.unmount();
+
+  // Without a usable journal the image is not mounted
+  std::filesystem::remove(journal);
+  std::filesystem::create_directory(journal);
+  assert(!vfs.mount(image, options));
+  std::filesystem::remove(journal);
+  assert(vfs.mount(image, options));
+  vfs.unmount();
+
+  std::cout << "✓ Journal transactions test passed\n\n";
+}
+
+void test_ordered_journal() {
+  std::cout << "Testing ordered journaling...\n";
+
+  const std::string image = "/tmp/test_ordered.img";
+  VirtualFileSystem vfs;
+  assert(vfs.format(image, 16, 256));
+  vfs.unmount();
+
+  std::vector<char> paper(1024 * 1024 + 300);
+  for (size_t i = 0; i < paper.size(); ++i) {
+    paper[i] = static_cast<char>(i * 31 + 7);
+  }
+  const size_t paper_blocks = paper.size() / 4096 + 1;
+
+  // Both write policies: only metadata is journaled, and the file data
+  // written in place is flushed before a commit that follows it
+  for (bool write_back : {false, true}) {
+    MountOptions options;
+    options.write_back = write_back;
+    options.journal_mode = JournalMode::ORDERED;
+    assert(vfs.mount(image, options));
+    std::string path = write_back ? "/wb.pdf" : "/wt.pdf";
+    assert(vfs.create_file(path) == 0);
+    int fd = vfs.open(path, O_RDWR);
+    assert(vfs.write(fd, paper.data(), paper.size()) ==
+           static_cast<ssize_t>(paper.size()));
+    vfs.close(fd);
+    assert(vfs.sync() == 0);
+    auto stats = vfs.get_journal_stats();
+    assert(stats.ordered >= paper_blocks);
+    assert(stats.journaled < paper_blocks / 4);
+    assert(stats.data_flushes > 0);
+    vfs.unmount();
+
+    assert(vfs.mount(image, options));
+    fd = vfs.open(path, O_RDONLY);
+    std::vector<char> back(paper.size());
+    assert(vfs.read(fd, back.data(), back.size()) ==
+           static_cast<ssize_t>(back.size()));
+    assert(back == paper);
+    vfs.close(fd);
+    vfs.unmount();
+  }
+
+  // Map blocks written in the middle of a batch (v1 crossing into the
+  // double indirect range, v2 leaves splitting while holes are filled)
+  // come after the data they point at, and the write still adds up
+  {
+    MountOptions options;
+    options.journal_mode = JournalMode::ORDERED;
+    FormatOptions v1;
+    v1.version = FORMAT_V1;
+    assert(vfs.format(image, 16, v1));
+    vfs.unmount();
+    assert(vfs.mount(image, options));
+    std::vector<char> big(1100 * 4096);
+    for (size_t i = 0; i < big.size(); ++i) {
+      big[i] = static_cast<char>(i * 13 + 5);
+    }
+    assert(vfs.create_file("/deep.bin") == 0);
+    int fd = vfs.open("/deep.bin", O_RDWR);
+    assert(vfs.write(fd, big.data(), big.size()) ==
+           static_cast<ssize_t>(big.size()));
+    vfs.close(fd);
+    vfs.unmount();
+    assert(vfs.mount(image, options));
+    fd = vfs.open("/deep.bin", O_RDONLY);
+    std::vector<char> back(big.size());
+    assert(vfs.read(fd, back.data(), back.size()) ==
+           static_cast<ssize_t>(back.size()));
+    assert(back == big);
+    vfs.close(fd);
+    vfs.unmount();
+
+    assert(vfs.format(image, 16));
+    vfs.unmount();
+    assert(vfs.mount(image, options));
+    const size_t holes = 400;
+    assert(vfs.create_file("/holes.bin") == 0);
+    assert(vfs.create_file("/other.bin") == 0);
+    fd = vfs.open("/holes.bin", O_RDWR);
+    int other = vfs.open("/other.bin", O_RDWR);
+    std::vector<char> block(4096, 'h');
+    for (size_t i = 0; i < holes; ++i) {
+      assert(vfs.seek(fd, 2 * i * 4096, SEEK_SET) ==
+             static_cast<off_t>(2 * i * 4096));
+      assert(vfs.write(fd, block.data(), block.size()) == 4096);
+      assert(vfs.write(other, block.data(), block.size()) == 4096);
+    }
+    vfs.close(other);
+    big.resize(2 * holes * 4096);
+    assert(vfs.seek(fd, 0, SEEK_SET) == 0);
+    assert(vfs.write(fd, big.data(), big.size()) ==
+           static_cast<ssize_t>(big.size()));
+    vfs.close(fd);
+    vfs.unmount();
+    assert(vfs.mount(image, options));
+    fd = vfs.open("/holes.bin", O_RDONLY);
+    back.assign(big.size(), 0);
+    assert(vfs.read(fd, back.data(), back.size()) ==
+           static_cast<ssize_t>(back.size()));
+    assert(back == big);
+    vfs.close(fd);
+    vfs.unmount();
+  }
+
+  // Full journaling carries the same data through the journal
+  MountOptions full;
+  full.journal_mode = JournalMode::FULL;
+  assert(vfs.mount(image, full));
+  assert(vfs.create_file("/full.pdf") == 0);
+  int fd = vfs.open("/full.pdf", O_RDWR);
+  assert(vfs.write(fd, paper.data(), paper.size()) ==
+         static_cast<ssize_t>(paper.size()));
+  vfs.close(fd);
+  auto stats = vfs.get_journal_stats();
+  assert(stats.journaled >= paper_blocks);
+  assert(stats.ordered == 0);
+  vfs.unmount();
+
+  std::cout << "✓ Ordered journaling test passed\n\n";
+}
+
 int main() {
   std::cout << "=== VFS Test Suite ===\n\n";
 
   try {
+    test_bitmap();
     test_format_and_mount();
     test_directory_operations();
     test_file_operations();
     test_cache_statistics();
+    test_block_cache();
+    test_cache_policies();
+    test_block_pool();
     test_backup_operations();
+    test_concurrent_access();
+    test_mmap_backend();
+    test_io_uring_backend();
+    test_write_back();
+    test_readahead();
+    test_extents();
+    test_indirect_blocks();
+    test_map_cache();
+    test_allocate_range();
+    test_inode_allocation();
+    test_inode_cache();
+    test_atime_modes();
+    test_directory_index();
+    test_dentry_cache();
+    test_path_resolution();
+    test_vectored_io();
+    test_journal_transactions();
+    test_ordered_journal();
 
     std::cout << "=== All tests passed! ===\n";
     return 0;